@@ -4,20 +4,44 @@
 //  Created by John Watson on 1/14/20.
 //
 
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
 
 #include <vulkan/vulkan.h>
 
+// SIMD kernels of the CPU reference rasterizer. AVX2 is enabled per function and picked at runtime.
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define REFERENCE_AVX2 1
+#endif
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 typedef struct queue_family_indices {
     uint32_t graphicsFamily;
     bool didSetGraphicsFamily;
 
     uint32_t presentFamily;
     bool didSetPresentFamily;
+
+    // A transfer-only family when the device has one, so uploads run beside rendering; otherwise the graphics family.
+    uint32_t transferFamily;
 } queue_family_indices_t;
 
 typedef struct swapchain_support_details {
@@ -30,35 +54,792 @@ typedef struct swapchain_support_details {
     uint32_t presentModeCount;
 } swapchain_support_details_t;
 
+// 32 hex digits plus four dashes and the terminator.
+#define DEVICE_UUID_STRING_SIZE 37
+
+typedef struct device_candidate {
+    VkPhysicalDevice device;
+    VkPhysicalDeviceProperties properties;
+    VkDeviceSize localHeapSize;
+
+    char uuid[DEVICE_UUID_STRING_SIZE];
+    bool hasUUID;
+
+    int64_t score;
+    const char *rejectReason;
+} device_candidate_t;
+
+// Offscreen frames in flight per device, so one can be read back while the next renders.
+#define OFFSCREEN_FRAMES_PER_DEVICE 2
+
+typedef struct offscreen_frame {
+    VkImage image;
+    VkDeviceMemory imageMemory;
+    VkImageView imageView;
+    VkFramebuffer framebuffer;
+
+    VkBuffer readbackBuffer;
+    VkDeviceMemory readbackMemory;
+    void *readbackData;
+    bool readbackCoherent;
+
+    // Without and with the depth pre-pass.
+    VkCommandBuffer commandBuffers[2];
+    VkFence fence;
+    // Index of the frame's query in the renderer's statistics pool.
+    uint32_t statisticsQuery;
+} offscreen_frame_t;
+
+// An image the renderer owns purely as a render pass attachment.
+typedef struct attachment_image {
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+} attachment_image_t;
+
+#define MAX_DESCRIPTOR_BINDINGS 8
+
+// The bindings of a descriptor set layout, sorted by binding number. Layouts are cached by their signature.
+typedef struct descriptor_signature {
+    uint32_t bindingCount;
+    VkDescriptorSetLayoutBinding bindings[MAX_DESCRIPTOR_BINDINGS];
+} descriptor_signature_t;
+
+typedef struct descriptor_layout_entry {
+    uint64_t hash;
+    descriptor_signature_t signature;
+    VkDescriptorSetLayout layout;
+} descriptor_layout_entry_t;
+
+typedef struct descriptor_layout_cache {
+    descriptor_layout_entry_t *entries;
+    uint32_t count;
+    uint32_t capacity;
+} descriptor_layout_cache_t;
+
+// Descriptor pools that sets are carved out of and released all at once with vkResetDescriptorPool, never one by one.
+// When the current pool runs out another, larger one is added; the pools are kept across resets.
+typedef struct descriptor_allocator {
+    VkDescriptorPool *pools;
+    uint32_t poolCount;
+    uint32_t currentPool;
+} descriptor_allocator_t;
+
+// Collects the descriptors of one set; BuildDescriptorSet() then finds its layout, allocates and writes it.
+typedef struct descriptor_set_builder {
+    descriptor_allocator_t *allocator;
+    descriptor_signature_t signature;
+    VkWriteDescriptorSet writes[MAX_DESCRIPTOR_BINDINGS];
+    VkDescriptorBufferInfo bufferInfos[MAX_DESCRIPTOR_BINDINGS];
+    VkDescriptorImageInfo imageInfos[MAX_DESCRIPTOR_BINDINGS];
+} descriptor_set_builder_t;
+
+// A sampled 2D texture, created through CreateTexture().
+typedef struct texture {
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+    VkExtent2D extent;
+    VkFormat format;
+    uint32_t mipLevels;
+    // Slot in the bindless texture array, or UINT32_MAX.
+    uint32_t bindlessIndex;
+} texture_t;
+
+// Upper bound of the bindless texture array, lowered to the device's update-after-bind limits.
+#define BINDLESS_MAX_TEXTURES 16384
+// Procedural textures the instanced scene's materials sample with --bindless.
+#define BINDLESS_MATERIAL_COUNT 256
+#define MATERIAL_TEXTURE_SIZE 64
+
+// An array of every texture, bound once per command buffer and indexed by the shaders. There is one copy of the set
+// per frame in flight: a set may not change while a pending command buffer uses it, so a slot that changes mid-run
+// is marked stale in every copy and rewritten in each one once its frame has retired.
+#define BINDLESS_MAX_SETS 8
+
+typedef struct bindless_table {
+    VkDescriptorSetLayout layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet sets[BINDLESS_MAX_SETS];
+    uint32_t setCount;
+    uint32_t capacity;
+    uint32_t count;
+    // What each slot should show, and a bit per set that does not show it yet.
+    VkImageView *views;
+    uint8_t *staleSets;
+    // The slots with any stale bit set.
+    uint32_t *staleSlots;
+    uint32_t staleCount;
+} bindless_table_t;
+
+#define MAX_MIP_LEVELS 16
+
+// Block-compressed texture families the device samples natively. The others are decoded on the CPU where possible.
+typedef struct texture_compression {
+    bool bc;
+    bool etc2;
+    bool astc;
+} texture_compression_t;
+
+// Every mip level of an image in host memory, packed back to back from level 0 as vkCmdCopyBufferToImage reads them.
+typedef struct mip_chain {
+    VkFormat format;
+    VkExtent2D extent;
+    uint32_t levelCount;
+    uint8_t *data;
+    size_t size;
+    size_t offsets[MAX_MIP_LEVELS];
+} mip_chain_t;
+
+// Levels no larger than this are the mip tail, uploaded together as the first step of a streamed texture.
+#define STREAM_TAIL_SIZE 32
+// Textures that grow by a level per update, to spread uploads over frames.
+#define STREAM_UPLOADS_PER_UPDATE 4
+
+typedef enum stream_state {
+    STREAM_QUEUED,
+    STREAM_LOADED,
+    STREAM_FAILED,
+} stream_state_t;
+
+typedef struct streamed_texture {
+    char *path;
+    // Set by a loader thread under the streamer's mutex; the mips are read-only once loaded.
+    stream_state_t state;
+    mip_chain_t mips;
+    // Holds levels residentLevel and below of the mip chain, or nothing while residentLevel == mips.levelCount.
+    texture_t texture;
+    uint32_t residentLevel;
+    VkDeviceSize residentBytes;
+    uint32_t bindlessIndex;
+} streamed_texture_t;
+
+// A grown copy of a streamed texture, swapped in once the transfer that fills it completes.
+typedef struct stream_upload {
+    uint32_t textureIndex;
+    uint32_t level;
+    texture_t texture;
+    VkDeviceSize bytes;
+} stream_upload_t;
+
+// A replaced texture, destroyed once every copy of the bindless table has stopped pointing at it.
+typedef struct stream_retired {
+    texture_t texture;
+    // A bit per bindless set that may still be sampling it.
+    uint8_t pendingSets;
+} stream_retired_t;
+
+// Loads image files on background threads and uploads them smallest mip first on the transfer queue. Each texture
+// starts as its mip tail and gains a level at a time while the resident total stays within the memory budget.
+// Until a texture's tail arrives, its bindless slot shows a placeholder.
+typedef struct texture_streamer {
+    streamed_texture_t *textures;
+    uint32_t textureCount;
+    uint32_t decodedCount;
+    texture_compression_t compression;
+    texture_t placeholder;
+
+    SDL_mutex *mutex;
+    SDL_Thread **loaders;
+    uint32_t loaderCount;
+    uint32_t nextToLoad;
+    bool stopping;
+
+    VkDeviceSize budget;
+    VkDeviceSize residentBytes;
+    uint32_t nextToGrow;
+
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    void *stagingData;
+    VkDeviceSize stagingSize;
+    stream_upload_t pending[STREAM_UPLOADS_PER_UPDATE];
+    uint32_t pendingCount;
+    stream_retired_t *retired;
+    uint32_t retiredCount;
+    uint32_t retiredCapacity;
+} texture_streamer_t;
+
+// Screen tile size of the compute rasterizer, matching the workgroup size in shaders/raster-shade.comp.
+#define RASTER_TILE_SIZE 16
+
+// What the compute rasterizer renders one target through: a storage image it shades into and then blits from,
+// and the per-tile triangle lists the binning pass fills. Each tile's list is sized for every triangle that can
+// touch it, so no triangle is ever dropped.
+typedef struct compute_target {
+    attachment_image_t color;
+    VkBuffer binBuffer;
+    VkDeviceMemory binMemory;
+    // Where each tile's list starts in the bins, and one past the last list's end.
+    VkBuffer offsetBuffer;
+    VkDeviceMemory offsetMemory;
+    VkDescriptorSet descriptorSet;
+    uint32_t tilesX;
+    uint32_t tilesY;
+} compute_target_t;
+
+// What one recorded pass draws into. The framebuffer is only used on the render pass path.
+// With MSAA the pass draws into msaaColor and resolves into image.
+typedef struct render_target {
+    VkImage image;
+    VkImageView imageView;
+    attachment_image_t msaaColor;
+    attachment_image_t depth;
+    VkFramebuffer framebuffer;
+    VkExtent2D extent;
+    // Only set when rendering with the compute rasterizer.
+    const compute_target_t *compute;
+    // Which copy of the bindless table the pass binds: the one of the frame slot it is submitted in.
+    uint32_t bindlessSet;
+} render_target_t;
+
+#define MAX_FRAMES_IN_FLIGHT 2
+
+// Present timing arrives a few frames late, so frames wait here until their display time is known.
+#define LATENCY_PENDING_FRAMES 16
+
+// CPU timestamps of one presented frame, in CLOCK_MONOTONIC nanoseconds.
+typedef struct frame_timing {
+    // Zero marks a free slot.
+    uint32_t presentID;
+    uint64_t inputTime;
+    uint64_t recordTime;
+    uint64_t submitTime;
+    uint64_t presentTime;
+} frame_timing_t;
+
+typedef struct latency_samples {
+    double *values;
+    size_t count;
+    size_t capacity;
+} latency_samples_t;
+
+// Distributions of the time from input sampling to each later stage of a frame, in milliseconds.
+typedef struct latency_stats {
+    latency_samples_t record;
+    latency_samples_t submit;
+    latency_samples_t present;
+    latency_samples_t photon;
+    uint64_t droppedFrames;
+} latency_stats_t;
+
+#define PACER_HISTORY 16
+
+// Delays input sampling so a frame finishes just before its deadline rather than queueing behind earlier frames.
+typedef struct frame_pacer {
+    // Zero disables pacing.
+    uint64_t period;
+    // When the frame about to start should be done on the GPU, in CLOCK_MONOTONIC nanoseconds.
+    uint64_t nextDeadline;
+    // Input sampling to submit, and GPU execution time, of recent frames.
+    uint64_t cpuTimes[PACER_HISTORY];
+    uint64_t gpuTimes[PACER_HISTORY];
+    uint32_t historyIndex;
+} frame_pacer_t;
+
+// Everything that belongs to one output window. Windows of a renderer share its device, render pass and pipeline.
+typedef struct window_target {
+    SDL_Window *window;
+    VkSurfaceKHR surface;
+
+    VkSwapchainKHR swapchain;
+    VkPresentModeKHR presentMode;
+    VkExtent2D extent;
+    VkImage *swapchainImages;
+    uint32_t swapchainImageCount;
+    VkImageView *swapchainImageViews;
+    VkFramebuffer *swapchainFramebuffers;
+    // Shared by every swapchain image; the render pass dependencies order their reuse.
+    attachment_image_t msaaColor;
+    attachment_image_t depth;
+    compute_target_t compute;
+    // Sets that live as long as the swapchain, reset when it is recreated.
+    descriptor_allocator_t descriptors;
+    VkCommandBuffer *commandBuffers;
+    VkCommandBuffer *prepassCommandBuffers;
+    VkSemaphore imageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT];
+    // Fence of the frame last rendering into each swapchain image, as an image can come back before that frame retires.
+    VkFence *imageFences;
+
+    uint32_t nextPresentID;
+    frame_timing_t pendingTimings[LATENCY_PENDING_FRAMES];
+} window_target_t;
+
+// Layout of the instance vertex buffer, matching shaders/instanced.vert and shaders/bindless.vert.
+typedef struct instance_data {
+    // x and y offset in normalized device coordinates, depth, and scale.
+    float offsetScale[4];
+    float color[4];
+    // Index of the instance's texture in the bindless array; only read with --bindless.
+    uint32_t material;
+} instance_data_t;
+
+#define MESH_MAX_LODS 8
+
+// One level of detail: a range of the index buffer, drawn with the shared vertices.
+typedef struct mesh_lod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Farthest any vertex moved from the full mesh, in the units of the mesh's unit cube.
+    float error;
+} mesh_lod_t;
+
+// Owns every Vulkan object of one renderer, so several can coexist in a process or run on separate threads.
+// A renderer draws either to one or more windows or, when headless, into offscreen frames that are read back.
+typedef struct renderer {
+    VkInstance instance;
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceProperties deviceProperties;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDevice logicalDevice;
+    queue_family_indices_t queueFamilyIndices;
+    VkQueue graphicsQueue;
+    VkQueue presentQueue;
+    VkQueue transferQueue;
+
+    // Every window presents with this format so that they can share one render pass.
+    VkFormat colorFormat;
+
+    window_target_t *windows;
+    uint32_t windowCount;
+    VkSemaphore renderFinishedSemaphores[MAX_FRAMES_IN_FLIGHT];
+    VkFence inFlightFences[MAX_FRAMES_IN_FLIGHT];
+    uint32_t currentFrame;
+
+    descriptor_layout_cache_t descriptorLayouts;
+    // Sets that live as long as the renderer.
+    descriptor_allocator_t persistentDescriptors;
+
+    // GPU timestamps bracketing each frame slot's submission, only created when frames are paced.
+    VkQueryPool timestampPool;
+
+    // One pipeline statistics query per offscreen frame, summed as the frames are read back.
+    VkQueryPool statisticsPool;
+    uint64_t statistics[3];
+    uint64_t statisticsFrames;
+    VkCommandBuffer timestampBeginCommands[MAX_FRAMES_IN_FLIGHT];
+    VkCommandBuffer timestampEndCommands[MAX_FRAMES_IN_FLIGHT];
+    bool timestampsPending[MAX_FRAMES_IN_FLIGHT];
+    uint64_t lastSubmitTime;
+    uint64_t lastGPUTime;
+
+    // Optional present timing extensions, enabled with --latency when the device has them.
+    bool displayTiming;
+    bool presentWait;
+    PFN_vkGetPastPresentationTimingGOOGLE vkGetPastPresentationTimingGOOGLE;
+    PFN_vkWaitForPresentKHR vkWaitForPresentKHR;
+    latency_stats_t latency;
+
+    // Size of the offscreen frames of a headless renderer.
+    VkExtent2D extent;
+    attachment_image_t offscreenMSAAColor;
+    attachment_image_t offscreenDepth;
+    compute_target_t offscreenCompute;
+
+    VkSampleCountFlagBits sampleCount;
+    VkFormat depthFormat;
+
+    // Textures are indexed from one descriptor array instead of being bound per draw.
+    bool bindless;
+    bindless_table_t bindlessTable;
+    VkSampler textureSampler;
+    texture_compression_t compression;
+    // Procedural material textures, unless the materials are streamed from files.
+    texture_t *materialTextures;
+    texture_streamer_t *streamer;
+    // Bindless slot of each material.
+    uint32_t *materialSlots;
+    uint32_t materialCount;
+
+    // Per-instance attributes of the instanced scene, sorted front to back.
+    VkBuffer instanceBuffer;
+    VkDeviceMemory instanceMemory;
+    uint32_t instanceCount;
+
+    // The mesh scene's vertices and triangle list, in device-local memory.
+    VkBuffer meshVertexBuffer;
+    VkDeviceMemory meshVertexMemory;
+    VkBuffer meshIndexBuffer;
+    VkDeviceMemory meshIndexMemory;
+    uint32_t meshIndexCount;
+    float meshOffset[3];
+    float meshScale[3];
+
+    // Instances of the mesh scene in draw order, grouped by LOD into the instance buffer.
+    mesh_lod_t meshLods[MESH_MAX_LODS];
+    uint32_t meshLodCount;
+    instance_data_t *meshInstances;
+    uint32_t lodInstanceCounts[MESH_MAX_LODS];
+
+    // With dynamic rendering there is no render pass and no framebuffers.
+    bool dynamicRendering;
+    PFN_vkCmdBeginRenderingKHR vkCmdBeginRenderingKHR;
+    PFN_vkCmdEndRenderingKHR vkCmdEndRenderingKHR;
+    VkRenderPass renderPass;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline graphicsPipeline;
+    // Depth pre-pass variants: depth only, then color with an EQUAL depth test and no depth writes.
+    VkPipeline depthPrepassPipeline;
+    VkPipeline depthEqualPipeline;
+    // Selects which recorded variant DrawFrame() submits.
+    bool depthPrepass;
+    // Animated frames are re-recorded before every submission with new draw constants for animationTime.
+    bool animate;
+    double animationTime;
+    uint64_t animationStart;
+    VkCommandPool commandPool;
+
+    // The compute rasterizer replaces the graphics pipeline when set. It reads the scene as a flat triangle list.
+    bool computeRaster;
+    VkBuffer triangleBuffer;
+    VkDeviceMemory triangleMemory;
+    uint32_t triangleCount;
+    // Each triangle's bounds in normalized device coordinates, min x, min y, max x, max y, to size the tile bins.
+    float (*triangleBounds)[4];
+    VkPipelineLayout rasterPipelineLayout;
+    VkPipeline rasterBinPipeline;
+    VkPipeline rasterShadePipeline;
+
+    // Downsampler for formats that cannot be blitted with linear filtering, created on first use.
+    VkPipelineLayout mipPipelineLayout;
+    VkPipeline mipPipeline;
+
+    offscreen_frame_t offscreenFrames[OFFSCREEN_FRAMES_PER_DEVICE];
+    uint64_t framesRendered;
+} renderer_t;
+
+typedef enum present_policy {
+    // MAILBOX, then IMMEDIATE: newest frame on screen without blocking the CPU.
+    PRESENT_POLICY_LOW_LATENCY,
+    // IMMEDIATE: unthrottled, for benchmarking.
+    PRESENT_POLICY_MAX_THROUGHPUT,
+    // FIFO_RELAXED, then FIFO: locked to the display refresh with the fewest images.
+    PRESENT_POLICY_VSYNC,
+} present_policy_t;
+
+typedef enum scene {
+    // The tutorial triangle.
+    SCENE_TRIANGLE,
+    // Many overlapping triangles at different depths, drawn with one instanced draw.
+    SCENE_INSTANCED,
+    // The instanced scene with an imported mesh in place of the triangle.
+    SCENE_MESH,
+} scene_t;
+
+// A mesh vertex as imported and optimized.
+typedef struct mesh_vertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+} mesh_vertex_t;
+
+// Layout of the mesh vertex buffer, matching shaders/mesh.vert: 16 bytes instead of mesh_vertex_t's 32.
+typedef struct packed_vertex {
+    // Within the mesh's bounds, which map to [-1, 1] on each axis. w is unused.
+    int16_t position[4];
+    // Half floats. Not bound by the pipeline until meshes are textured.
+    uint16_t uv[2];
+    // Octahedral encoding of the unit normal.
+    int8_t normal[2];
+    uint8_t padding[2];
+} packed_vertex_t;
+
+#define MESH_CACHE_MAGIC "HTMESH\0"
+// Bumped whenever the file layout or packed_vertex_t changes, so old caches are imported again.
+#define MESH_CACHE_VERSION 4
+// Set when the triangles and vertices were reordered for the vertex cache, overdraw and vertex fetch.
+#define MESH_CACHE_OPTIMIZED 1
+
+// Header of a mesh cache file, followed by the vertex and index data exactly as the GPU buffers hold them. Fields are
+// in the writing host's byte order.
+typedef struct mesh_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    // Size and modification time of the source file, to notice when it changes.
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    // Average cache miss ratio of the stored triangle order.
+    float acmr;
+    uint32_t flags;
+    // Dequantizes positions: position * positionScale + positionOffset.
+    float positionOffset[3];
+    float positionScale[3];
+    // From the full mesh down; indexCount covers the indices of every level.
+    uint32_t lodCount;
+    uint8_t reserved[4];
+    // Pads the header to 192 bytes, so the vertex data that follows it is 16-byte aligned.
+    mesh_lod_t lods[MESH_MAX_LODS];
+} mesh_cache_header_t;
+
+// A mesh cache file mapped into memory.
+typedef struct mesh_cache {
+    void *mapping;
+    size_t size;
+    const mesh_cache_header_t *header;
+    const packed_vertex_t *vertices;
+    const uint32_t *indices;
+} mesh_cache_t;
+
+// Per-draw parameters pushed with vkCmdPushConstants, matching DrawConstants in shaders/instanced.vert, shaders/bindless.vert
+// and shaders/mesh.vert. 116 bytes, within the 128 every device guarantees.
+typedef struct draw_constants {
+    // Column-major, applied to the clip-space position.
+    float transform[16];
+    // Multiplies the instance color.
+    float color[4];
+    // Dequantize the mesh's positions; only read by the mesh scene. w is unused.
+    float meshOffset[4];
+    float meshScale[4];
+    // Seconds of animation.
+    float time;
+} draw_constants_t;
+
+// One triangle of the scene as the compute rasterizer reads it, matching Triangle in shaders/raster-*.comp.
+typedef struct scene_triangle {
+    // x, y and depth in normalized device coordinates, and 1.
+    float positions[3][4];
+    float colors[3][4];
+} scene_triangle_t;
+
+// Push constants shared by both compute raster passes.
+typedef struct raster_constants {
+    uint32_t extent[2];
+    uint32_t triangleCount;
+    uint32_t tilesX;
+    uint32_t tilesY;
+} raster_constants_t;
+
+typedef enum raster_path {
+    // Fixed-function rasterization through the graphics pipeline.
+    RASTER_GRAPHICS,
+    // Tile-binned software rasterization in compute shaders, blitted to the output.
+    RASTER_COMPUTE,
+} raster_path_t;
+
+typedef enum depth_prepass_mode {
+    DEPTH_PREPASS_OFF,
+    DEPTH_PREPASS_ON,
+    // Every other frame, to compare both modes in one run.
+    DEPTH_PREPASS_ALTERNATE,
+} depth_prepass_mode_t;
+
+// Frame counts and time attributed to frames without ([0]) and with ([1]) the depth pre-pass.
+typedef struct prepass_stats {
+    uint64_t frames[2];
+    uint64_t nanoseconds[2];
+    uint64_t lastFrameStart;
+    bool lastPrepass;
+} prepass_stats_t;
+
+// Tile size of the CPU reference rasterizer, and the granularity mismatches are reported at.
+#define REFERENCE_TILE_SIZE 16
+#define REFERENCE_BACKGROUND UINT32_MAX
+
+// One scene triangle set up for the CPU reference rasterizer, in pixel coordinates snapped to the device's
+// sub-pixel grid. Edge i is w_i = a[i] * x + b[i] * y + c[i], positive inside; w_0 weights vertex 0.
+typedef struct reference_triangle {
+    double a[3];
+    double b[3];
+    double c[3];
+    // Pixels exactly on an edge belong to the triangle only for top and left edges.
+    bool topLeft[3];
+    double area;
+    // Depth as a plane over the pixel coordinates, and its minimum over the triangle.
+    double depthPlane[3];
+    float minDepth;
+    float colors[3][4];
+    // Inclusive pixel bounds, clipped to the image.
+    int32_t minX, minY, maxX, maxY;
+} reference_triangle_t;
+
+// A run of pixels on one row that a span kernel tests against one triangle. Edge values and depth are
+// taken at the first pixel's center and step by the per-pixel deltas.
+typedef struct reference_span {
+    float w[3];
+    float dw[3];
+    uint32_t topLeft[3];
+    float depth;
+    float dDepth;
+    uint32_t index;
+} reference_span_t;
+
+// Depth tests the span's covered pixels against depth and records the winning triangle in ids.
+typedef void (*reference_span_kernel_t)(const reference_span_t *span, uint32_t count, float *depth, uint32_t *ids);
+
+// What the scene should look like, rendered once on the CPU.
+typedef struct reference_image {
+    VkExtent2D extent;
+    uint8_t *pixels;
+    // Triangle covering each pixel, or REFERENCE_BACKGROUND.
+    uint32_t *ids;
+    // Pixels next to a different triangle or the background, where rasterization rules may legitimately differ.
+    uint8_t *edges;
+} reference_image_t;
+
+// Shared by the threads rasterizing a reference image; each claims tiles until none are left.
+typedef struct reference_job {
+    reference_image_t *image;
+    const reference_triangle_t *triangles;
+    // Triangles overlapping tile t, in draw order: tileTriangles[tileStarts[t]] to tileTriangles[tileStarts[t + 1]].
+    uint32_t *tileStarts;
+    uint32_t *tileTriangles;
+    uint32_t tilesX;
+    uint32_t tilesY;
+    reference_span_kernel_t kernel;
+    SDL_atomic_t nextTile;
+} reference_job_t;
+
+typedef struct validation {
+    reference_image_t reference;
+    uint64_t framesChecked;
+    uint64_t framesFailed;
+    uint64_t edgeMismatches;
+    uint64_t interiorMismatches;
+} validation_t;
+
+typedef enum encode_format {
+    // One binary PPM file per frame.
+    ENCODE_PPM,
+    // One QOI file per frame: lossless, and several times smaller and faster to write than PPM.
+    ENCODE_QOI,
+    // Every frame in one uncompressed 4:4:4 YUV4MPEG2 stream, which video tools read directly.
+    ENCODE_Y4M,
+} encode_format_t;
+
+typedef struct byte_buffer {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} byte_buffer_t;
+
+typedef enum encoder_slot_state {
+    ENCODER_SLOT_FREE,
+    // Pixels are being copied in by the render thread.
+    ENCODER_SLOT_FILLING,
+    ENCODER_SLOT_QUEUED,
+    ENCODER_SLOT_ENCODING,
+    ENCODER_SLOT_ENCODED,
+} encoder_slot_state_t;
+
+typedef struct encoder_slot {
+    encoder_slot_state_t state;
+    uint64_t frameIndex;
+    uint8_t *pixels;
+    byte_buffer_t encoded;
+} encoder_slot_t;
+
+// Compresses read back frames on worker threads and writes them from a writer thread in frame order. The slots
+// bound the frames in flight: when all are taken the render thread waits, which is the only way it ever blocks.
+typedef struct frame_encoder {
+    encode_format_t format;
+    VkExtent2D extent;
+    encoder_slot_t *slots;
+    uint32_t slotCount;
+
+    SDL_mutex *mutex;
+    SDL_cond *slotFreed;
+    SDL_cond *frameQueued;
+    SDL_cond *frameEncoded;
+    SDL_Thread **workers;
+    uint32_t workerCount;
+    SDL_Thread *writer;
+
+    uint64_t submittedCount;
+    uint64_t nextWriteIndex;
+    bool finishing;
+    // The Y4M stream; per-frame formats open a file per frame.
+    FILE *stream;
+
+    uint64_t bytesWritten;
+    uint64_t waitNanoseconds;
+} frame_encoder_t;
+
+// One canonical rendering the golden image suite checks.
+typedef struct golden_case {
+    const char *name;
+    scene_t scene;
+    VkExtent2D extent;
+    uint32_t sampleCount;
+} golden_case_t;
+
+typedef struct options {
+    const char *deviceOverride;
+    present_policy_t presentPolicy;
+    bool measureLatency;
+    double targetFrameRate;
+    bool legacyRenderPass;
+    uint32_t sampleCount;
+    scene_t scene;
+    uint32_t instanceCount;
+    const char *meshPath;
+    bool optimizeMesh;
+    float lodError;
+    bool pipelineStatistics;
+    depth_prepass_mode_t depthPrepass;
+    raster_path_t raster;
+    bool bindless;
+    const char *textureDirectory;
+    uint32_t textureBudget;
+    bool computeMipmaps;
+    bool animate;
+    bool validate;
+    uint32_t validateTolerance;
+
+    bool headless;
+    bool multiGPU;
+    uint64_t frameCount;
+    uint32_t windowCount;
+    VkExtent2D offscreenExtent;
+    const char *outputDirectory;
+    encode_format_t encodeFormat;
+    const char *goldenDirectory;
+    bool goldenUpdate;
+} options_t;
+
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 
 const char *APP_NAME = "Test App";
 
+const char *DEVICE_OVERRIDE_ENV = "HELLO_TRIANGLE_DEVICE";
+
 const int WIDTH = 800;
 const int HEIGHT = 600;
 
-VkInstance vulkanInstance = VK_NULL_HANDLE;
-VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-VkDevice logicalDevice = VK_NULL_HANDLE;
-VkQueue graphicsQueue = VK_NULL_HANDLE;
-VkQueue presentQueue = VK_NULL_HANDLE;
-VkSurfaceKHR vulkanSurface = VK_NULL_HANDLE;
-queue_family_indices_t queueFamilyIndices;
-VkSwapchainKHR swapChain;
-VkImage *swapchainImages;
-uint32_t swapchainImageCount = 0;
-VkFormat swapchainImageFormat;
-VkExtent2D swapchainExtent;
-VkImageView *swapChainImageViews;
-VkRenderPass renderPass;
-VkPipelineLayout pipelineLayout;
-VkPipeline graphicsPipeline;
-VkFramebuffer *swapchainFramebuffers;
-VkCommandPool commandPool;
-VkCommandBuffer *commandBuffers;
-VkSemaphore imageAvailableSemaphore;
-VkSemaphore renderFinishedSemaphore;
+const VkFormat OFFSCREEN_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+// Format of the compute rasterizer's storage images; storage and blit source support for it is mandatory.
+const VkFormat RASTER_STORAGE_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+options_t options;
+
+const golden_case_t goldenCases[] = {
+    { "triangle-64x64", SCENE_TRIANGLE, { 64, 64 }, 1 },
+    { "triangle-333x197", SCENE_TRIANGLE, { 333, 197 }, 1 },
+    { "triangle-800x600", SCENE_TRIANGLE, { 800, 600 }, 1 },
+    { "triangle-1920x1080", SCENE_TRIANGLE, { 1920, 1080 }, 1 },
+    { "instanced-800x600", SCENE_INSTANCED, { 800, 600 }, 1 },
+    { "instanced-800x600-msaa4", SCENE_INSTANCED, { 800, 600 }, 4 },
+};
+
+const uint32_t goldenCaseCount = sizeof(goldenCases) / sizeof(goldenCases[0]);
+
+// Frames rendered before timing starts, and frames averaged into a case's frame time.
+const uint32_t GOLDEN_WARMUP_FRAMES = 10;
+const uint32_t GOLDEN_TIMED_FRAMES = 100;
+// Pixels count as different above this perceptual difference, and a case fails when more than this fraction differ.
+const double GOLDEN_PIXEL_THRESHOLD = 0.1;
+const double GOLDEN_MAX_DIFFERENT_PIXELS = 0.001;
+// A case fails when its frame time exceeds the recorded one by this factor.
+const double GOLDEN_MAX_SLOWDOWN = 1.5;
 
 const char *requiredExtensions[] = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME,
@@ -122,200 +903,381 @@ void _FatalError(const char *file, int line, char *fmt, ...) {
     exit(EXIT_FAILURE);
 }
 
-void InitVulkanInstance(SDL_Window *window) {
-    VkApplicationInfo appInfo = {
-        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-        .pApplicationName = APP_NAME,
-        .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
-        .pEngineName = "No Engine",
-        .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-        .apiVersion = VK_API_VERSION_1_0,
-    };
+void PrintUsage(const char *program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  --device <name|uuid|index>  Render on the given device instead of the highest scoring one.\n");
+    printf("                              May also be set through the %s environment variable.\n", DEVICE_OVERRIDE_ENV);
+    printf("  --windows <count>           Number of output windows sharing one device (default 1).\n");
+    printf("  --present <policy>          Present mode policy: low-latency (default), throughput or vsync.\n");
+    printf("  --target-fps <rate>         Pace frames to finish just in time for the given frame rate.\n");
+    printf("  --scene <triangle|instanced|mesh> Scene to render (default triangle).\n");
+    printf("  --instances <count>         Number of triangles or meshes in the instanced and mesh scenes (default 2000).\n");
+    printf("  --mesh <file.obj>           Mesh of the mesh scene, imported into a binary cache next to the file on first use.\n");
+    printf("  --mesh-optimize <on|off>    Reorder imported meshes for the vertex cache, overdraw and vertex fetch (default on).\n");
+    printf("  --lod-error <pixels>        Screen-space error mesh LODs may cause, 0 for the full mesh everywhere (default 1).\n");
+    printf("  --pipeline-stats            With --headless, count vertex and fragment shader invocations per frame.\n");
+    printf("  --depth-prepass <mode>      Depth pre-pass: off (default), on or alternate between frames. P toggles it.\n");
+    printf("  --msaa <samples>            Multisample anti-aliasing with 1, 2, 4 or 8 samples (default 1).\n");
+    printf("  --raster <graphics|compute> Rasterize with the graphics pipeline (default) or in compute shaders.\n");
+    printf("  --bindless                  Texture the instanced scene's materials from one descriptor array (VK_EXT_descriptor_indexing).\n");
+    printf("  --textures <directory>      With --bindless, stream the materials from the directory's PPM images.\n");
+    printf("  --texture-budget <MiB>      Memory streamed textures may occupy (default 256).\n");
+    printf("  --compute-mipmaps           Generate mip chains with the compute downsampler even where blits could.\n");
+    printf("  --animate                   Rotate the instanced scene through per-draw push constants, re-recording every frame.\n");
+    printf("  --legacy-render-pass        Use render pass and framebuffer objects even if dynamic rendering is available.\n");
+    printf("  --latency                   Measure input-to-photon latency and print its distribution on exit.\n");
+    printf("  --headless                  Render offscreen without a window and read the frames back.\n");
+    printf("  --multi-gpu                 With --headless, distribute frames round-robin across every suitable device.\n");
+    printf("  --frames <count>            Number of frames to render headlessly (default 1).\n");
+    printf("  --size <width>x<height>     Offscreen frame size (default %dx%d).\n", WIDTH, HEIGHT);
+    printf("  --output <directory>        Write headless frames to the directory, encoded on background threads.\n");
+    printf("  --encode <ppm|qoi|y4m>      Format of the frames written by --output (default ppm).\n");
+    printf("  --validate                  With --headless, check every frame against a CPU reference rendering.\n");
+    printf("  --tolerance <levels>        Per-channel difference --validate accepts, out of 255 (default 2).\n");
+    printf("  --golden <directory>        Render the canonical scenes headlessly and compare them with the directory's images.\n");
+    printf("  --golden-update             With --golden, record new reference images and frame times instead.\n");
+    printf("  --help                      Show this message.\n");
+}
 
-    uint32_t instanceExtensionCount;
-    SDL_Vulkan_GetInstanceExtensions(window, &instanceExtensionCount, NULL);
+const char* OptionValue(int argc, const char *argv[], int *i) {
+    if (*i + 1 >= argc) {
+        FatalError("Option %s requires a value.", argv[*i]);
+    }
 
-    const char **extensionNames = calloc(instanceExtensionCount, sizeof(char*));
-    SDL_Vulkan_GetInstanceExtensions(window, &instanceExtensionCount, extensionNames);
+    *i += 1;
+    return argv[*i];
+}
 
-    VkInstanceCreateInfo createInfo = {
-        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-        .pApplicationInfo = &appInfo,
-        .enabledExtensionCount = instanceExtensionCount,
-        .ppEnabledExtensionNames = extensionNames,
-        .enabledLayerCount = 0,
-    };
+void ParseOptions(int argc, const char *argv[]) {
+    options.frameCount = 1;
+    options.windowCount = 1;
+    options.sampleCount = 1;
+    options.instanceCount = 2000;
+    options.optimizeMesh = true;
+    options.lodError = 1.0f;
+    options.validateTolerance = 2;
+    options.textureBudget = 256;
+    options.offscreenExtent.width = WIDTH;
+    options.offscreenExtent.height = HEIGHT;
+
+    const char *deviceOverride = getenv(DEVICE_OVERRIDE_ENV);
+    if (deviceOverride && *deviceOverride) {
+        options.deviceOverride = deviceOverride;
+    }
 
-    VkResult result = vkCreateInstance(&createInfo, NULL, &vulkanInstance);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--device") == 0) {
+            options.deviceOverride = OptionValue(argc, argv, &i);
+        } else if (strcmp(argv[i], "--windows") == 0) {
+            options.windowCount = (uint32_t)strtoul(OptionValue(argc, argv, &i), NULL, 10);
+            if (options.windowCount == 0) {
+                FatalError("--windows must be at least 1.");
+            }
+        } else if (strcmp(argv[i], "--present") == 0) {
+            const char *policy = OptionValue(argc, argv, &i);
+            if (strcmp(policy, "low-latency") == 0) {
+                options.presentPolicy = PRESENT_POLICY_LOW_LATENCY;
+            } else if (strcmp(policy, "throughput") == 0) {
+                options.presentPolicy = PRESENT_POLICY_MAX_THROUGHPUT;
+            } else if (strcmp(policy, "vsync") == 0) {
+                options.presentPolicy = PRESENT_POLICY_VSYNC;
+            } else {
+                FatalError("Unknown present policy '%s'.", policy);
+            }
+        } else if (strcmp(argv[i], "--target-fps") == 0) {
+            options.targetFrameRate = strtod(OptionValue(argc, argv, &i), NULL);
+            if (options.targetFrameRate <= 0) {
+                FatalError("--target-fps must be positive.");
+            }
+        } else if (strcmp(argv[i], "--scene") == 0) {
+            const char *scene = OptionValue(argc, argv, &i);
+            if (strcmp(scene, "triangle") == 0) {
+                options.scene = SCENE_TRIANGLE;
+            } else if (strcmp(scene, "instanced") == 0) {
+                options.scene = SCENE_INSTANCED;
+            } else if (strcmp(scene, "mesh") == 0) {
+                options.scene = SCENE_MESH;
+            } else {
+                FatalError("Unknown scene '%s'.", scene);
+            }
+        } else if (strcmp(argv[i], "--instances") == 0) {
+            options.instanceCount = (uint32_t)strtoul(OptionValue(argc, argv, &i), NULL, 10);
+            if (options.instanceCount == 0) {
+                FatalError("--instances must be at least 1.");
+            }
+        } else if (strcmp(argv[i], "--mesh") == 0) {
+            options.meshPath = OptionValue(argc, argv, &i);
+        } else if (strcmp(argv[i], "--mesh-optimize") == 0) {
+            const char *mode = OptionValue(argc, argv, &i);
+            if (strcmp(mode, "on") == 0 || strcmp(mode, "off") == 0) {
+                options.optimizeMesh = strcmp(mode, "on") == 0;
+            } else {
+                FatalError("Unknown --mesh-optimize mode '%s'.", mode);
+            }
+        } else if (strcmp(argv[i], "--lod-error") == 0) {
+            options.lodError = strtof(OptionValue(argc, argv, &i), NULL);
+            if (!(options.lodError >= 0)) {
+                FatalError("--lod-error must not be negative.");
+            }
+        } else if (strcmp(argv[i], "--pipeline-stats") == 0) {
+            options.pipelineStatistics = true;
+        } else if (strcmp(argv[i], "--depth-prepass") == 0) {
+            const char *mode = OptionValue(argc, argv, &i);
+            if (strcmp(mode, "off") == 0) {
+                options.depthPrepass = DEPTH_PREPASS_OFF;
+            } else if (strcmp(mode, "on") == 0) {
+                options.depthPrepass = DEPTH_PREPASS_ON;
+            } else if (strcmp(mode, "alternate") == 0) {
+                options.depthPrepass = DEPTH_PREPASS_ALTERNATE;
+            } else {
+                FatalError("Unknown depth pre-pass mode '%s'.", mode);
+            }
+        } else if (strcmp(argv[i], "--msaa") == 0) {
+            options.sampleCount = (uint32_t)strtoul(OptionValue(argc, argv, &i), NULL, 10);
+            if (options.sampleCount != 1 && options.sampleCount != 2 && options.sampleCount != 4 && options.sampleCount != 8) {
+                FatalError("--msaa must be 1, 2, 4 or 8.");
+            }
+        } else if (strcmp(argv[i], "--raster") == 0) {
+            const char *raster = OptionValue(argc, argv, &i);
+            if (strcmp(raster, "graphics") == 0) {
+                options.raster = RASTER_GRAPHICS;
+            } else if (strcmp(raster, "compute") == 0) {
+                options.raster = RASTER_COMPUTE;
+            } else {
+                FatalError("Unknown raster path '%s'.", raster);
+            }
+        } else if (strcmp(argv[i], "--bindless") == 0) {
+            options.bindless = true;
+        } else if (strcmp(argv[i], "--textures") == 0) {
+            options.textureDirectory = OptionValue(argc, argv, &i);
+        } else if (strcmp(argv[i], "--texture-budget") == 0) {
+            options.textureBudget = (uint32_t)strtoul(OptionValue(argc, argv, &i), NULL, 10);
+            if (options.textureBudget == 0) {
+                FatalError("--texture-budget must be at least 1.");
+            }
+        } else if (strcmp(argv[i], "--compute-mipmaps") == 0) {
+            options.computeMipmaps = true;
+        } else if (strcmp(argv[i], "--animate") == 0) {
+            options.animate = true;
+        } else if (strcmp(argv[i], "--legacy-render-pass") == 0) {
+            options.legacyRenderPass = true;
+        } else if (strcmp(argv[i], "--latency") == 0) {
+            options.measureLatency = true;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            options.headless = true;
+        } else if (strcmp(argv[i], "--multi-gpu") == 0) {
+            options.multiGPU = true;
+        } else if (strcmp(argv[i], "--frames") == 0) {
+            options.frameCount = strtoull(OptionValue(argc, argv, &i), NULL, 10);
+            if (options.frameCount == 0) {
+                FatalError("--frames must be at least 1.");
+            }
+        } else if (strcmp(argv[i], "--size") == 0) {
+            const char *size = OptionValue(argc, argv, &i);
+            if (sscanf(size, "%ux%u", &options.offscreenExtent.width, &options.offscreenExtent.height) != 2 ||
+                options.offscreenExtent.width == 0 || options.offscreenExtent.height == 0) {
+                FatalError("Invalid size \"%s\", expected <width>x<height>.", size);
+            }
+        } else if (strcmp(argv[i], "--output") == 0) {
+            options.outputDirectory = OptionValue(argc, argv, &i);
+        } else if (strcmp(argv[i], "--encode") == 0) {
+            const char *format = OptionValue(argc, argv, &i);
+            if (strcmp(format, "ppm") == 0) {
+                options.encodeFormat = ENCODE_PPM;
+            } else if (strcmp(format, "qoi") == 0) {
+                options.encodeFormat = ENCODE_QOI;
+            } else if (strcmp(format, "y4m") == 0) {
+                options.encodeFormat = ENCODE_Y4M;
+            } else {
+                FatalError("Unknown encode format '%s'.", format);
+            }
+        } else if (strcmp(argv[i], "--golden") == 0) {
+            options.goldenDirectory = OptionValue(argc, argv, &i);
+        } else if (strcmp(argv[i], "--golden-update") == 0) {
+            options.goldenUpdate = true;
+        } else if (strcmp(argv[i], "--validate") == 0) {
+            options.validate = true;
+        } else if (strcmp(argv[i], "--tolerance") == 0) {
+            options.validateTolerance = (uint32_t)strtoul(OptionValue(argc, argv, &i), NULL, 10);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            PrintUsage(argv[0]);
+            exit(EXIT_SUCCESS);
+        } else {
+            PrintUsage(argv[0]);
+            FatalError("Unknown option %s", argv[i]);
+        }
+    }
 
-    free(extensionNames);
+    if (options.multiGPU && !options.headless) {
+        FatalError("--multi-gpu is only supported with --headless.");
+    }
 
-    if (result != VK_SUCCESS) {
-        FatalError("Failed to create instance");
+    if (options.pipelineStatistics && !options.headless) {
+        FatalError("--pipeline-stats is only supported with --headless.");
     }
-}
 
-bool IsDiscreteGPU(VkPhysicalDevice device) {
-    VkPhysicalDeviceProperties deviceProperties;
-    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    if (options.validate && !options.headless) {
+        FatalError("--validate is only supported with --headless.");
+    }
 
-    VkPhysicalDeviceFeatures deviceFeatures;
-    vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+    if ((options.scene == SCENE_MESH) != (options.meshPath != NULL)) {
+        FatalError("--scene mesh and --mesh must be given together.");
+    }
 
-    return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
-}
+    // The compute rasterizer and the CPU reference only know flat triangles.
+    if (options.scene == SCENE_MESH && (options.raster != RASTER_GRAPHICS || options.validate)) {
+        FatalError("--scene mesh requires the graphics raster path and cannot be combined with --validate.");
+    }
 
-void PickPhysicalVulkanDevice(void) {
-    uint32_t deviceCount = 0;
-    vkEnumeratePhysicalDevices(vulkanInstance, &deviceCount, NULL);
+    if (options.bindless && (options.scene != SCENE_INSTANCED || options.raster != RASTER_GRAPHICS)) {
+        FatalError("--bindless textures the instanced scene and requires --scene instanced with the graphics raster path.");
+    }
 
-    if (deviceCount == 0) {
-        FatalError("Failed to find Vulkan-capable GPU");
+    // The CPU reference does not sample textures.
+    if (options.bindless && options.validate) {
+        FatalError("--bindless cannot be combined with --validate.");
     }
 
-    VkPhysicalDevice *devices = calloc(deviceCount, sizeof(VkPhysicalDevice));
-    vkEnumeratePhysicalDevices(vulkanInstance, &deviceCount, devices);
+    if (options.textureDirectory && !options.bindless) {
+        FatalError("--textures requires --bindless.");
+    }
 
-    // Prefer discrete GPU, but accept integrated GPU.
-    for (size_t i = 0; i < deviceCount; i++) {
-        if (IsDiscreteGPU(devices[i])) {
-            physicalDevice = devices[i];
-            break;
-        }
+    // vertex.spv and the compute rasterizer do not read the draw constants.
+    if (options.animate && (options.scene == SCENE_TRIANGLE || options.raster != RASTER_GRAPHICS)) {
+        FatalError("--animate requires --scene instanced or mesh with the graphics raster path.");
     }
 
-    if (physicalDevice == VK_NULL_HANDLE) {
-        printf("Discrete GPU not found, falling back to integrated GPU...\n");
-        physicalDevice = devices[0];
+    if (options.animate && options.validate) {
+        FatalError("--animate cannot be combined with --validate.");
     }
 
-    free(devices);
+    if (options.goldenUpdate && !options.goldenDirectory) {
+        FatalError("--golden-update requires --golden.");
+    }
 
-    uint32_t extensionCount = 0;
-    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, NULL);
+    if (options.goldenDirectory && (options.headless || options.multiGPU)) {
+        FatalError("--golden renders headlessly on one device and cannot be combined with --headless or --multi-gpu.");
+    }
 
-    if (extensionCount == 0) {
-        FatalError("Returned zero available extensions for device.");
+    if (options.multiGPU && options.deviceOverride) {
+        FatalError("--multi-gpu uses every suitable device and cannot be combined with a device override.");
     }
+}
 
-    VkExtensionProperties *properties = calloc(extensionCount, sizeof(VkExtensionProperties));
-    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, properties);
+// Pass a NULL window for a headless renderer.
+void InitVulkanInstance(renderer_t *renderer, SDL_Window *window) {
+    VkApplicationInfo appInfo = {
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName = APP_NAME,
+        .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
+        .pEngineName = "No Engine",
+        .engineVersion = VK_MAKE_VERSION(1, 0, 0),
+        .apiVersion = VK_API_VERSION_1_1,
+    };
 
-    for (uint32_t i = 0; i < requiredExtensionCount; i++) {
-        bool found = false;
-        for (uint32_t j = 0; j < extensionCount; j++) {
-            if (strcmp(requiredExtensions[i], properties[j].extensionName) == 0) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            FatalError("Could not find required extension %s.", requiredExtensions[i]);
-        }
+    // Headless rendering needs no surface extensions.
+    uint32_t instanceExtensionCount = 0;
+    if (window) {
+        SDL_Vulkan_GetInstanceExtensions(window, &instanceExtensionCount, NULL);
     }
 
-    free(properties);
+    const char **extensionNames = calloc(MAX(instanceExtensionCount, 1), sizeof(char*));
+    if (window) {
+        SDL_Vulkan_GetInstanceExtensions(window, &instanceExtensionCount, extensionNames);
+    }
+
+    VkInstanceCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pApplicationInfo = &appInfo,
+        .enabledExtensionCount = instanceExtensionCount,
+        .ppEnabledExtensionNames = extensionNames,
+        .enabledLayerCount = 0,
+    };
+
+    VkResult result = vkCreateInstance(&createInfo, NULL, &renderer->instance);
+
+    free(extensionNames);
+
+    if (result != VK_SUCCESS) {
+        FatalError("Failed to create instance");
+    }
 }
 
-queue_family_indices_t FindQueueFamilies(void) {
+// The present family must be able to present to every window of the renderer.
+queue_family_indices_t FindQueueFamilies(renderer_t *renderer, VkPhysicalDevice device) {
     queue_family_indices_t indices;
     memset(&indices, 0, sizeof(queue_family_indices_t));
 
     uint32_t queueFamilyCount = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, NULL);
 
     if (queueFamilyCount == 0) {
         return indices;
     }
 
+    VkQueueFamilyProperties *queueFamilies = calloc(queueFamilyCount, sizeof(VkQueueFamilyProperties));
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies);
+
     for (uint32_t i = 0; i < queueFamilyCount; i++) {
-        indices.graphicsFamily = i;
-        indices.didSetGraphicsFamily = true;
+        bool graphicsSupported = queueFamilies[i].queueCount > 0 && (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT);
+
+        // Headless rendering has no surfaces, so every family trivially "presents".
+        VkBool32 surfaceSupported = VK_TRUE;
+        for (uint32_t j = 0; j < renderer->windowCount && surfaceSupported; j++) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, renderer->windows[j].surface, &surfaceSupported);
+        }
 
-        VkBool32 surfaceSupported = VK_FALSE;
-        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, vulkanSurface, &surfaceSupported);
-        if (surfaceSupported) {
+        // Prefer a single family that can both draw and present.
+        if (graphicsSupported && surfaceSupported) {
+            indices.graphicsFamily = i;
+            indices.didSetGraphicsFamily = true;
             indices.presentFamily = i;
             indices.didSetPresentFamily = true;
+            break;
         }
-    }
-
-    return indices;
-}
 
-void CreateLogicalDevice(void) {
-    queueFamilyIndices = FindQueueFamilies();
-    if (!queueFamilyIndices.didSetGraphicsFamily) {
-        FatalError("Failed to find graphics queue family.");
-    }
+        if (graphicsSupported && !indices.didSetGraphicsFamily) {
+            indices.graphicsFamily = i;
+            indices.didSetGraphicsFamily = true;
+        }
 
-    if (!queueFamilyIndices.didSetPresentFamily) {
-        FatalError("Failed to find present queue family.");
+        if (surfaceSupported && !indices.didSetPresentFamily) {
+            indices.presentFamily = i;
+            indices.didSetPresentFamily = true;
+        }
     }
 
-    float queuePriority = 1.0f;
-
-    VkDeviceQueueCreateInfo queueCreateInfos[2] = {
-        {
-            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-            .queueFamilyIndex = queueFamilyIndices.graphicsFamily,
-            .queueCount = 1,
-            .pQueuePriorities = &queuePriority,
-        },
-        {
-            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-            .queueFamilyIndex = queueFamilyIndices.presentFamily,
-            .queueCount = 1,
-            .pQueuePriorities = &queuePriority,
-        },
-    };
-
-    // Use separate queues if graphics and present queue families are different.
-    const uint32_t queueCreateInfoCount = queueFamilyIndices.graphicsFamily == queueFamilyIndices.presentFamily ? 1 : 2;
-
-    VkPhysicalDeviceFeatures features = {};
-
-    VkDeviceCreateInfo deviceCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .pQueueCreateInfos = queueCreateInfos,
-        .queueCreateInfoCount = queueCreateInfoCount,
-        .pEnabledFeatures = &features,
-        .enabledExtensionCount = 1,
-        .ppEnabledExtensionNames = requiredExtensions,
-        .enabledLayerCount = 0,
-    };
-
-    if (vkCreateDevice(physicalDevice, &deviceCreateInfo, NULL, &logicalDevice) != VK_SUCCESS) {
-        FatalError("Failed to create logical device.");
+    indices.transferFamily = indices.graphicsFamily;
+    for (uint32_t i = 0; i < queueFamilyCount; i++) {
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        if (queueFamilies[i].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            indices.transferFamily = i;
+            break;
+        }
     }
 
-    vkGetDeviceQueue(logicalDevice, queueFamilyIndices.graphicsFamily, 0, &graphicsQueue);
-    vkGetDeviceQueue(logicalDevice, queueFamilyIndices.presentFamily, 0, &presentQueue);
-}
+    free(queueFamilies);
 
-void CreateVulkanSurface(SDL_Window *window) {
-    if (!SDL_Vulkan_CreateSurface(window, vulkanInstance, &vulkanSurface)) {
-        FatalError("Failed to create Vulkan surface: %s", SDL_GetError());
-    }
+    return indices;
 }
 
-swapchain_support_details_t QuerySwapchainSupport(void) {
+swapchain_support_details_t QuerySwapchainSupport(VkPhysicalDevice device, VkSurfaceKHR surface) {
     swapchain_support_details_t details;
 
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, vulkanSurface, &details.capabilities);
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
 
-    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, vulkanSurface, &details.formatCount, NULL);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &details.formatCount, NULL);
     if (details.formatCount > 0) {
         details.formats = calloc(details.formatCount, sizeof(VkSurfaceFormatKHR));
-        vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, vulkanSurface, &details.formatCount, details.formats);
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &details.formatCount, details.formats);
     } else {
         details.formats = NULL;
     }
 
-    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, vulkanSurface, &details.presentModeCount, NULL);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &details.presentModeCount, NULL);
     if (details.presentModeCount > 0) {
         details.presentModes = calloc(details.presentModeCount, sizeof(VkPresentModeKHR));
-        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, vulkanSurface, &details.presentModeCount, details.presentModes);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &details.presentModeCount, details.presentModes);
     } else {
         details.presentModes = NULL;
     }
@@ -328,527 +1290,7152 @@ void FreeSwapchainSupportDetails(swapchain_support_details_t details) {
     free(details.presentModes);
 }
 
-VkSurfaceFormatKHR ChooseSwapSurfaceFormat(swapchain_support_details_t details) {
-    for (uint32_t i = 0; i < details.formatCount; i++) {
-        if (details.formats[i].format == VK_FORMAT_B8G8R8A8_UNORM && details.formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-            return details.formats[i];
+const char* DeviceTypeName(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return "discrete GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return "integrated GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return "virtual GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return "CPU";
+        default:
+            return "other";
+    }
+}
+
+bool HasDeviceExtension(VkPhysicalDevice device, const char *name) {
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, NULL);
+
+    VkExtensionProperties *properties = calloc(MAX(extensionCount, 1), sizeof(VkExtensionProperties));
+    vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, properties);
+
+    bool found = false;
+    for (uint32_t i = 0; i < extensionCount && !found; i++) {
+        found = strcmp(name, properties[i].extensionName) == 0;
+    }
+
+    free(properties);
+
+    return found;
+}
+
+bool HasRequiredExtensions(VkPhysicalDevice device) {
+    for (uint32_t i = 0; i < requiredExtensionCount; i++) {
+        if (!HasDeviceExtension(device, requiredExtensions[i])) {
+            return false;
         }
     }
 
-    return details.formats[0];
+    return true;
 }
 
-VkPresentModeKHR ChoosePresentMode(swapchain_support_details_t details) {
-    // Prefer VK_PRESENT_MODE_MAILBOX_KHR (triple buffering) but fall back to FIFO if not available.
-    for (uint32_t i = 0; i < details.presentModeCount; i++) {
-        if (details.presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-            return details.presentModes[i];
+void FormatDeviceUUID(const uint8_t uuid[VK_UUID_SIZE], char out[DEVICE_UUID_STRING_SIZE]) {
+    char *cursor = out;
+    for (int i = 0; i < VK_UUID_SIZE; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            *cursor++ = '-';
         }
+        cursor += sprintf(cursor, "%02x", uuid[i]);
     }
+}
 
-    return VK_PRESENT_MODE_FIFO_KHR;
+// Compares hex digits only, so the override may be given with or without dashes and in either case.
+bool DeviceUUIDMatches(const char *uuidString, const char *override) {
+    const char *a = uuidString;
+    const char *b = override;
+    while (*a && *b) {
+        if (*a == '-') {
+            a++;
+            continue;
+        }
+        if (*b == '-') {
+            b++;
+            continue;
+        }
+        if (tolower((unsigned char)*a) != tolower((unsigned char)*b)) {
+            return false;
+        }
+        a++;
+        b++;
+    }
+    return *a == '\0' && *b == '\0';
 }
 
-VkExtent2D ChooseSwapExtent(swapchain_support_details_t details) {
-    if (details.capabilities.currentExtent.width != UINT32_MAX) {
-        return details.capabilities.currentExtent;
+bool ContainsIgnoringCase(const char *haystack, const char *needle) {
+    size_t needleLength = strlen(needle);
+    for (const char *start = haystack; *start; start++) {
+        size_t i = 0;
+        while (i < needleLength && start[i] && tolower((unsigned char)start[i]) == tolower((unsigned char)needle[i])) {
+            i++;
+        }
+        if (i == needleLength) {
+            return true;
+        }
     }
+    return needleLength == 0;
+}
 
-    VkExtent2D actualExtent = {
-        .width = WIDTH,
-        .height = HEIGHT,
-    };
+void DescribePhysicalDevice(VkPhysicalDevice device, device_candidate_t *candidate) {
+    memset(candidate, 0, sizeof(device_candidate_t));
+    candidate->device = device;
 
-    actualExtent.width = MAX(details.capabilities.minImageExtent.width, MIN(details.capabilities.maxImageExtent.width, actualExtent.width));
-    actualExtent.height = MAX(details.capabilities.minImageExtent.height, MIN(details.capabilities.maxImageExtent.height, actualExtent.height));
+    vkGetPhysicalDeviceProperties(device, &candidate->properties);
 
-    return actualExtent;
-}
+    // Device UUIDs are only queryable through the 1.1 properties chain.
+    if (candidate->properties.apiVersion >= VK_API_VERSION_1_1) {
+        VkPhysicalDeviceIDProperties idProperties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+        };
 
-void CreateSwapChain(swapchain_support_details_t details) {
-    VkSurfaceFormatKHR surfaceFormat = ChooseSwapSurfaceFormat(details);
-    VkPresentModeKHR presentMode = ChoosePresentMode(details);
-    VkExtent2D extent = ChooseSwapExtent(details);
+        VkPhysicalDeviceProperties2 properties2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &idProperties,
+        };
 
-    uint32_t imageCount = details.capabilities.minImageCount + 1;
-    if (details.capabilities.maxImageCount > 0 && imageCount > details.capabilities.maxImageCount) {
-        imageCount = details.capabilities.maxImageCount;
+        vkGetPhysicalDeviceProperties2(device, &properties2);
+        FormatDeviceUUID(idProperties.deviceUUID, candidate->uuid);
+        candidate->hasUUID = true;
+    } else {
+        strcpy(candidate->uuid, "n/a");
     }
 
-    VkSwapchainCreateInfoKHR createInfo = {
-        .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-        .surface = vulkanSurface,
-        .minImageCount = imageCount,
-        .imageFormat = surfaceFormat.format,
-        .imageColorSpace = surfaceFormat.colorSpace,
-        .imageExtent = extent,
-        .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-        .preTransform = details.capabilities.currentTransform,
-        .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-        .presentMode = presentMode,
-        .clipped = VK_TRUE,
-        .oldSwapchain = VK_NULL_HANDLE,
-    };
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
 
-    if (queueFamilyIndices.graphicsFamily != queueFamilyIndices.presentFamily) {
-        uint32_t indices[] = { queueFamilyIndices.graphicsFamily, queueFamilyIndices.presentFamily };
-        createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-        createInfo.queueFamilyIndexCount = 2;
-        createInfo.pQueueFamilyIndices = indices;
-    } else {
-        createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        createInfo.queueFamilyIndexCount = 0;
-        createInfo.pQueueFamilyIndices = NULL;
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+        if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            candidate->localHeapSize = MAX(candidate->localHeapSize, memoryProperties.memoryHeaps[i].size);
+        }
     }
+}
 
-    if (vkCreateSwapchainKHR(logicalDevice, &createInfo, NULL, &swapChain) != VK_SUCCESS) {
-        FatalError("Failed to create swapchain.");
+// Returns a negative score for devices that cannot run this renderer at all.
+// Scores the device for the renderer's windows, or for headless rendering if it has none.
+int64_t ScorePhysicalDevice(renderer_t *renderer, device_candidate_t *candidate) {
+    if (renderer->windowCount > 0 && !HasRequiredExtensions(candidate->device)) {
+        candidate->rejectReason = "missing required device extensions";
+        return -1;
     }
 
-    vkGetSwapchainImagesKHR(logicalDevice, swapChain, &swapchainImageCount, NULL);
-    swapchainImages = calloc(swapchainImageCount, sizeof(VkImage));
-    vkGetSwapchainImagesKHR(logicalDevice, swapChain, &swapchainImageCount, swapchainImages);
+    queue_family_indices_t indices = FindQueueFamilies(renderer, candidate->device);
+    if (!indices.didSetGraphicsFamily) {
+        candidate->rejectReason = "no graphics queue family";
+        return -1;
+    }
 
-    swapchainImageFormat = surfaceFormat.format;
-    swapchainExtent = extent;
-}
+    if (!indices.didSetPresentFamily) {
+        candidate->rejectReason = "cannot present to every window surface";
+        return -1;
+    }
 
-void CreateImageViews(void) {
-    swapChainImageViews = calloc(swapchainImageCount, sizeof(VkImageView));
-    for (size_t i = 0; i < swapchainImageCount; i++) {
-        VkImageViewCreateInfo createInfo = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-            .image = swapchainImages[i],
-            .viewType = VK_IMAGE_VIEW_TYPE_2D,
-            .format = swapchainImageFormat,
-            .components = {
-                .r = VK_COMPONENT_SWIZZLE_IDENTITY,
-                .g = VK_COMPONENT_SWIZZLE_IDENTITY,
-                .b = VK_COMPONENT_SWIZZLE_IDENTITY,
-                .a = VK_COMPONENT_SWIZZLE_IDENTITY,
-            },
-            .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1,
-            },
-        };
+    for (uint32_t i = 0; i < renderer->windowCount; i++) {
+        swapchain_support_details_t details = QuerySwapchainSupport(candidate->device, renderer->windows[i].surface);
+        bool swapchainAdequate = details.formatCount > 0 && details.presentModeCount > 0;
+        FreeSwapchainSupportDetails(details);
 
-        if (vkCreateImageView(logicalDevice, &createInfo, NULL, &swapChainImageViews[i]) != VK_SUCCESS) {
-            FatalError("Failed to create image views.");
+        if (!swapchainAdequate) {
+            candidate->rejectReason = "no usable swapchain formats or present modes";
+            return -1;
         }
     }
-}
 
-VkShaderModule CreateShaderModule(const char *code, long size) {
-    VkShaderModuleCreateInfo createInfo = {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .codeSize = size,
-        .pCode = (const uint32_t *)code,
-    };
+    int64_t score = 0;
 
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(logicalDevice, &createInfo, NULL, &shaderModule) != VK_SUCCESS) {
-        FatalError("Failed to create shader module.");
+    switch (candidate->properties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            score += 100000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            score += 50000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            score += 20000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            score += 1000;
+            break;
+        default:
+            break;
     }
 
-    return shaderModule;
-}
+    // One point per MiB of device-local memory, capped so VRAM breaks ties within a device type but never overrides it.
+    score += (int64_t)MIN(candidate->localHeapSize >> 20, 32768);
 
-void CreateRenderPass(void) {
-    VkAttachmentDescription colorAttachment = {
-        .format = swapchainImageFormat,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-    };
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(candidate->device, &features);
 
-    VkAttachmentReference colorAttachmentRef = {
-        .attachment = 0,
-        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-    };
+    if (features.samplerAnisotropy) {
+        score += 100;
+    }
 
-    VkSubpassDescription subpass = {
-        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-        .colorAttachmentCount = 1,
-        .pColorAttachments = &colorAttachmentRef,
-    };
+    if (features.textureCompressionBC || features.textureCompressionETC2 || features.textureCompressionASTC_LDR) {
+        score += 100;
+    }
 
-    VkSubpassDependency dependency = {
-        .srcSubpass = VK_SUBPASS_EXTERNAL,
-        .dstSubpass = 0,
-        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .srcAccessMask = 0,
-        .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-    };
+    if (features.pipelineStatisticsQuery) {
+        score += 100;
+    }
 
-    VkRenderPassCreateInfo renderPassInfo = {
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-        .attachmentCount = 1,
-        .pAttachments = &colorAttachment,
-        .subpassCount = 1,
-        .pSubpasses = &subpass,
-        .dependencyCount = 1,
-        .pDependencies = &dependency,
+    if (candidate->properties.limits.timestampComputeAndGraphics) {
+        score += 100;
+    }
+
+    // A family that draws and presents avoids concurrent sharing of swapchain images.
+    if (indices.graphicsFamily == indices.presentFamily) {
+        score += 1000;
+    }
+
+    return score;
+}
+
+// An override is a device index, a device UUID, or a case-insensitive substring of the device name.
+bool DeviceMatchesOverride(const device_candidate_t *candidate, uint32_t index, const char *override) {
+    char *end;
+    unsigned long requestedIndex = strtoul(override, &end, 10);
+    if (*override != '\0' && *end == '\0') {
+        return requestedIndex == index;
+    }
+
+    if (candidate->hasUUID && DeviceUUIDMatches(candidate->uuid, override)) {
+        return true;
+    }
+
+    return ContainsIgnoringCase(candidate->properties.deviceName, override);
+}
+
+// Describes and scores every device, logging each one when verbose. Free the result when done.
+device_candidate_t* EnumerateDeviceCandidates(renderer_t *renderer, bool verbose, uint32_t *deviceCountOut) {
+    uint32_t deviceCount = 0;
+    vkEnumeratePhysicalDevices(renderer->instance, &deviceCount, NULL);
+
+    if (deviceCount == 0) {
+        FatalError("Failed to find Vulkan-capable GPU");
+    }
+
+    VkPhysicalDevice *devices = calloc(deviceCount, sizeof(VkPhysicalDevice));
+    vkEnumeratePhysicalDevices(renderer->instance, &deviceCount, devices);
+
+    device_candidate_t *candidates = calloc(deviceCount, sizeof(device_candidate_t));
+
+    if (verbose) {
+        printf("Found %u Vulkan device(s):\n", deviceCount);
+    }
+
+    for (uint32_t i = 0; i < deviceCount; i++) {
+        DescribePhysicalDevice(devices[i], &candidates[i]);
+        candidates[i].score = ScorePhysicalDevice(renderer, &candidates[i]);
+
+        if (!verbose) {
+            continue;
+        }
+
+        printf("  [%u] %s (%s, %llu MiB, UUID %s): ",
+               i,
+               candidates[i].properties.deviceName,
+               DeviceTypeName(candidates[i].properties.deviceType),
+               (unsigned long long)(candidates[i].localHeapSize >> 20),
+               candidates[i].uuid);
+
+        if (candidates[i].score < 0) {
+            printf("unsuitable, %s\n", candidates[i].rejectReason);
+        } else {
+            printf("score %lld\n", (long long)candidates[i].score);
+        }
+    }
+
+    free(devices);
+
+    *deviceCountOut = deviceCount;
+    return candidates;
+}
+
+// Applies the device override if there is one, otherwise takes the highest score.
+uint32_t SelectDeviceCandidate(const device_candidate_t *candidates, uint32_t deviceCount) {
+    if (options.deviceOverride) {
+        for (uint32_t i = 0; i < deviceCount; i++) {
+            if (!DeviceMatchesOverride(&candidates[i], i, options.deviceOverride)) {
+                continue;
+            }
+
+            if (candidates[i].score < 0) {
+                FatalError("Device \"%s\" requested by override is unsuitable: %s.", candidates[i].properties.deviceName, candidates[i].rejectReason);
+            }
+
+            printf("Selected device [%u] %s (override \"%s\")\n", i, candidates[i].properties.deviceName, options.deviceOverride);
+            return i;
+        }
+
+        FatalError("No Vulkan device matches override \"%s\".", options.deviceOverride);
+    }
+
+    int64_t bestIndex = -1;
+    for (uint32_t i = 0; i < deviceCount; i++) {
+        if (candidates[i].score >= 0 && (bestIndex < 0 || candidates[i].score > candidates[bestIndex].score)) {
+            bestIndex = i;
+        }
+    }
+
+    if (bestIndex < 0) {
+        FatalError("Failed to find a suitable Vulkan device.");
+    }
+
+    printf("Selected device [%lld] %s (highest score)\n", (long long)bestIndex, candidates[bestIndex].properties.deviceName);
+    return (uint32_t)bestIndex;
+}
+
+// Falls back to the highest count below the requested one that both color and depth attachments support.
+VkSampleCountFlagBits ChooseSampleCount(renderer_t *renderer, uint32_t requested) {
+    VkPhysicalDeviceLimits *limits = &renderer->deviceProperties.limits;
+    VkSampleCountFlags supported = limits->framebufferColorSampleCounts & limits->framebufferDepthSampleCounts;
+
+    uint32_t samples = requested;
+    while (samples > 1 && !(supported & samples)) {
+        samples /= 2;
+    }
+
+    if (samples != requested) {
+        printf("%s does not support %ux MSAA, using %ux.\n", renderer->deviceProperties.deviceName, requested, samples);
+    }
+
+    return (VkSampleCountFlagBits)samples;
+}
+
+// Formats without stencil, best precision first. D16_UNORM is always supported as a depth attachment.
+VkFormat ChooseDepthFormat(renderer_t *renderer) {
+    VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM };
+
+    for (uint32_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(renderer->physicalDevice, candidates[i], &properties);
+        if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+            return candidates[i];
+        }
+    }
+
+    FatalError("No supported depth format.");
+    return VK_FORMAT_UNDEFINED;
+}
+
+void UsePhysicalDevice(renderer_t *renderer, const device_candidate_t *candidate) {
+    renderer->physicalDevice = candidate->device;
+    renderer->deviceProperties = candidate->properties;
+    vkGetPhysicalDeviceMemoryProperties(renderer->physicalDevice, &renderer->memoryProperties);
+    renderer->sampleCount = ChooseSampleCount(renderer, options.sampleCount);
+    renderer->depthFormat = ChooseDepthFormat(renderer);
+}
+
+void PickPhysicalVulkanDevice(renderer_t *renderer) {
+    uint32_t deviceCount = 0;
+    device_candidate_t *candidates = EnumerateDeviceCandidates(renderer, true, &deviceCount);
+
+    UsePhysicalDevice(renderer, &candidates[SelectDeviceCandidate(candidates, deviceCount)]);
+
+    free(candidates);
+}
+
+// present_wait also needs its feature bits, which can only be queried through vkGetPhysicalDeviceFeatures2 on Vulkan 1.1 devices.
+bool SupportsPresentWait(renderer_t *renderer) {
+    VkPhysicalDevice device = renderer->physicalDevice;
+    if (renderer->deviceProperties.apiVersion < VK_API_VERSION_1_1 || !HasDeviceExtension(device, VK_KHR_PRESENT_ID_EXTENSION_NAME) || !HasDeviceExtension(device, VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+        return false;
+    }
+
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+    };
+
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+        .pNext = &presentIdFeatures,
+    };
+
+    VkPhysicalDeviceFeatures2 features2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &presentWaitFeatures,
+    };
+
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+
+    return presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+}
+
+// VK_KHR_dynamic_rendering depends on VK_KHR_create_renderpass2 and VK_KHR_depth_stencil_resolve, whose own
+// dependencies are core in Vulkan 1.1.
+const char *dynamicRenderingExtensions[] = {
+    VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+    VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+    VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+};
+
+const uint32_t dynamicRenderingExtensionCount = 3;
+
+bool SupportsDynamicRendering(renderer_t *renderer) {
+    VkPhysicalDevice device = renderer->physicalDevice;
+    if (renderer->deviceProperties.apiVersion < VK_API_VERSION_1_1) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < dynamicRenderingExtensionCount; i++) {
+        if (!HasDeviceExtension(device, dynamicRenderingExtensions[i])) {
+            return false;
+        }
+    }
+
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+    };
+
+    VkPhysicalDeviceFeatures2 features2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &dynamicRenderingFeatures,
+    };
+
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+
+    return dynamicRenderingFeatures.dynamicRendering;
+}
+
+// Non-uniform indexing into a partially bound, update-after-bind sampled image array, as shaders/bindless.frag needs.
+bool SupportsDescriptorIndexing(renderer_t *renderer) {
+    VkPhysicalDevice device = renderer->physicalDevice;
+    if (renderer->deviceProperties.apiVersion < VK_API_VERSION_1_1 || !HasDeviceExtension(device, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+        return false;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT,
+    };
+
+    VkPhysicalDeviceFeatures2 features2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &indexingFeatures,
+    };
+
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+
+    return indexingFeatures.shaderSampledImageArrayNonUniformIndexing && indexingFeatures.runtimeDescriptorArray &&
+           indexingFeatures.descriptorBindingPartiallyBound && indexingFeatures.descriptorBindingSampledImageUpdateAfterBind;
+}
+
+void CreateLogicalDevice(renderer_t *renderer) {
+    queue_family_indices_t queueFamilyIndices = FindQueueFamilies(renderer, renderer->physicalDevice);
+    renderer->queueFamilyIndices = queueFamilyIndices;
+
+    if (!queueFamilyIndices.didSetGraphicsFamily) {
+        FatalError("Failed to find graphics queue family.");
+    }
+
+    if (!queueFamilyIndices.didSetPresentFamily) {
+        FatalError("Failed to find present queue family.");
+    }
+
+    float queuePriority = 1.0f;
+
+    // One queue from each distinct family.
+    uint32_t families[] = { queueFamilyIndices.graphicsFamily, queueFamilyIndices.presentFamily, queueFamilyIndices.transferFamily };
+    VkDeviceQueueCreateInfo queueCreateInfos[3];
+    uint32_t queueCreateInfoCount = 0;
+
+    for (uint32_t i = 0; i < 3; i++) {
+        bool created = false;
+        for (uint32_t j = 0; j < queueCreateInfoCount; j++) {
+            created |= queueCreateInfos[j].queueFamilyIndex == families[i];
+        }
+
+        if (!created) {
+            queueCreateInfos[queueCreateInfoCount++] = (VkDeviceQueueCreateInfo){
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = families[i],
+                .queueCount = 1,
+                .pQueuePriorities = &queuePriority,
+            };
+        }
+    }
+
+    // Compressed texture families are enabled wherever they are supported, as files may arrive in any of them.
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(renderer->physicalDevice, &supportedFeatures);
+
+    VkPhysicalDeviceFeatures features = {
+        .textureCompressionBC = supportedFeatures.textureCompressionBC,
+        .textureCompressionETC2 = supportedFeatures.textureCompressionETC2,
+        .textureCompressionASTC_LDR = supportedFeatures.textureCompressionASTC_LDR,
+        .pipelineStatisticsQuery = options.pipelineStatistics,
+    };
+
+    if (options.pipelineStatistics && !supportedFeatures.pipelineStatisticsQuery) {
+        FatalError("%s does not support the pipeline statistics queries --pipeline-stats needs.", renderer->deviceProperties.deviceName);
+    }
+
+    renderer->compression = (texture_compression_t){
+        .bc = supportedFeatures.textureCompressionBC,
+        .etc2 = supportedFeatures.textureCompressionETC2,
+        .astc = supportedFeatures.textureCompressionASTC_LDR,
+    };
+
+    const char *extensions[16];
+    uint32_t extensionCount = 0;
+    // Feature structs of optional extensions are linked in front of this.
+    void *featureChain = NULL;
+
+    // Headless renderers never present, so they need no swapchain.
+    if (renderer->windowCount > 0) {
+        for (uint32_t i = 0; i < requiredExtensionCount; i++) {
+            extensions[extensionCount++] = requiredExtensions[i];
+        }
+    }
+
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+        .presentId = VK_TRUE,
+    };
+
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+        .pNext = &presentIdFeatures,
+        .presentWait = VK_TRUE,
+    };
+
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+        .dynamicRendering = VK_TRUE,
+    };
+
+    renderer->dynamicRendering = !options.legacyRenderPass && SupportsDynamicRendering(renderer);
+    if (renderer->dynamicRendering) {
+        for (uint32_t i = 0; i < dynamicRenderingExtensionCount; i++) {
+            extensions[extensionCount++] = dynamicRenderingExtensions[i];
+        }
+        dynamicRenderingFeatures.pNext = featureChain;
+        featureChain = &dynamicRenderingFeatures;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT,
+        .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+        .runtimeDescriptorArray = VK_TRUE,
+        .descriptorBindingPartiallyBound = VK_TRUE,
+        .descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+    };
+
+    if (renderer->bindless) {
+        if (!SupportsDescriptorIndexing(renderer)) {
+            FatalError("%s does not support the descriptor indexing --bindless needs.", renderer->deviceProperties.deviceName);
+        }
+
+        // VK_KHR_maintenance3, which the extension depends on, is core in Vulkan 1.1.
+        extensions[extensionCount++] = VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME;
+        indexingFeatures.pNext = featureChain;
+        featureChain = &indexingFeatures;
+    }
+
+    if (options.measureLatency && renderer->windowCount > 0) {
+        renderer->displayTiming = HasDeviceExtension(renderer->physicalDevice, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+        renderer->presentWait = SupportsPresentWait(renderer);
+
+        if (renderer->displayTiming) {
+            extensions[extensionCount++] = VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME;
+        }
+
+        if (renderer->presentWait) {
+            extensions[extensionCount++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+            extensions[extensionCount++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+            presentIdFeatures.pNext = featureChain;
+            featureChain = &presentWaitFeatures;
+        }
+    }
+
+    VkDeviceCreateInfo deviceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = featureChain,
+        .pQueueCreateInfos = queueCreateInfos,
+        .queueCreateInfoCount = queueCreateInfoCount,
+        .pEnabledFeatures = &features,
+        .enabledExtensionCount = extensionCount,
+        .ppEnabledExtensionNames = extensions,
+        .enabledLayerCount = 0,
+    };
+
+    if (vkCreateDevice(renderer->physicalDevice, &deviceCreateInfo, NULL, &renderer->logicalDevice) != VK_SUCCESS) {
+        FatalError("Failed to create logical device on %s.", renderer->deviceProperties.deviceName);
+    }
+
+    printf("Rendering with %s on %s.\n", renderer->dynamicRendering ? "dynamic rendering" : "render pass objects", renderer->deviceProperties.deviceName);
+
+    if (renderer->dynamicRendering) {
+        renderer->vkCmdBeginRenderingKHR = (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(renderer->logicalDevice, "vkCmdBeginRenderingKHR");
+        renderer->vkCmdEndRenderingKHR = (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(renderer->logicalDevice, "vkCmdEndRenderingKHR");
+    }
+
+    if (renderer->displayTiming) {
+        renderer->vkGetPastPresentationTimingGOOGLE = (PFN_vkGetPastPresentationTimingGOOGLE)vkGetDeviceProcAddr(renderer->logicalDevice, "vkGetPastPresentationTimingGOOGLE");
+    }
+
+    if (renderer->presentWait) {
+        renderer->vkWaitForPresentKHR = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(renderer->logicalDevice, "vkWaitForPresentKHR");
+    }
+
+    if (options.measureLatency && renderer->windowCount > 0) {
+        const char *source = renderer->displayTiming ? "VK_GOOGLE_display_timing" : renderer->presentWait ? "VK_KHR_present_wait" : "none, input-to-photon latency unavailable";
+        printf("Present timing source: %s.\n", source);
+    }
+
+    vkGetDeviceQueue(renderer->logicalDevice, queueFamilyIndices.graphicsFamily, 0, &renderer->graphicsQueue);
+    vkGetDeviceQueue(renderer->logicalDevice, queueFamilyIndices.presentFamily, 0, &renderer->presentQueue);
+    vkGetDeviceQueue(renderer->logicalDevice, queueFamilyIndices.transferFamily, 0, &renderer->transferQueue);
+}
+
+void CreateVulkanSurface(renderer_t *renderer, window_target_t *target) {
+    if (!SDL_Vulkan_CreateSurface(target->window, renderer->instance, &target->surface)) {
+        FatalError("Failed to create Vulkan surface: %s", SDL_GetError());
+    }
+}
+
+// The first window picks the format; later windows must offer the same one to share the render pass.
+VkSurfaceFormatKHR ChooseSwapSurfaceFormat(renderer_t *renderer, swapchain_support_details_t details) {
+    if (renderer->colorFormat != VK_FORMAT_UNDEFINED) {
+        for (uint32_t i = 0; i < details.formatCount; i++) {
+            if (details.formats[i].format == renderer->colorFormat) {
+                return details.formats[i];
+            }
+        }
+
+        FatalError("Window surface does not support the shared swapchain format %d.", renderer->colorFormat);
+    }
+
+    for (uint32_t i = 0; i < details.formatCount; i++) {
+        if (details.formats[i].format == VK_FORMAT_B8G8R8A8_UNORM && details.formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+            return details.formats[i];
+        }
+    }
+
+    return details.formats[0];
+}
+
+const char* PresentModeName(VkPresentModeKHR mode) {
+    switch (mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+        default: return "other";
+    }
+}
+
+// Takes the first mode of the policy's preference list that the surface supports. FIFO is always available.
+VkPresentModeKHR ChoosePresentMode(present_policy_t policy, swapchain_support_details_t details) {
+    static const VkPresentModeKHR lowLatency[] = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+    static const VkPresentModeKHR maxThroughput[] = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+    static const VkPresentModeKHR vsync[] = { VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR };
+
+    const VkPresentModeKHR *preferred = lowLatency;
+    if (policy == PRESENT_POLICY_MAX_THROUGHPUT) {
+        preferred = maxThroughput;
+    } else if (policy == PRESENT_POLICY_VSYNC) {
+        preferred = vsync;
+    }
+
+    for (uint32_t i = 0; i < 2; i++) {
+        for (uint32_t j = 0; j < details.presentModeCount; j++) {
+            if (details.presentModes[j] == preferred[i]) {
+                return preferred[i];
+            }
+        }
+    }
+
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// MAILBOX needs a third image so the CPU never waits: one on screen, one queued, one being drawn.
+// IMMEDIATE and FIFO only need double buffering; for FIFO that also caps how far the CPU runs ahead.
+uint32_t ChooseSwapImageCount(VkPresentModeKHR presentMode, VkSurfaceCapabilitiesKHR capabilities) {
+    uint32_t imageCount = presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3 : 2;
+
+    imageCount = MAX(imageCount, capabilities.minImageCount);
+    if (capabilities.maxImageCount > 0) {
+        imageCount = MIN(imageCount, capabilities.maxImageCount);
+    }
+
+    return imageCount;
+}
+
+VkExtent2D ChooseSwapExtent(swapchain_support_details_t details) {
+    if (details.capabilities.currentExtent.width != UINT32_MAX) {
+        return details.capabilities.currentExtent;
+    }
+
+    VkExtent2D actualExtent = {
+        .width = WIDTH,
+        .height = HEIGHT,
+    };
+
+    actualExtent.width = MAX(details.capabilities.minImageExtent.width, MIN(details.capabilities.maxImageExtent.width, actualExtent.width));
+    actualExtent.height = MAX(details.capabilities.minImageExtent.height, MIN(details.capabilities.maxImageExtent.height, actualExtent.height));
+
+    return actualExtent;
+}
+
+void CreateSwapChain(renderer_t *renderer, window_target_t *target, swapchain_support_details_t details) {
+    VkSurfaceFormatKHR surfaceFormat = ChooseSwapSurfaceFormat(renderer, details);
+    VkPresentModeKHR presentMode = ChoosePresentMode(options.presentPolicy, details);
+    VkExtent2D extent = ChooseSwapExtent(details);
+    uint32_t imageCount = ChooseSwapImageCount(presentMode, details.capabilities);
+
+    // The compute rasterizer blits into swapchain images instead of rendering to them.
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    if (renderer->computeRaster) {
+        if (!(details.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+            FatalError("Swapchain images cannot be blitted to, which the compute rasterizer needs.");
+        }
+        usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+
+    VkSwapchainCreateInfoKHR createInfo = {
+        .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+        .surface = target->surface,
+        .minImageCount = imageCount,
+        .imageFormat = surfaceFormat.format,
+        .imageColorSpace = surfaceFormat.colorSpace,
+        .imageExtent = extent,
+        .imageArrayLayers = 1,
+        .imageUsage = usage,
+        .preTransform = details.capabilities.currentTransform,
+        .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+        .presentMode = presentMode,
+        .clipped = VK_TRUE,
+        .oldSwapchain = VK_NULL_HANDLE,
+    };
+
+    queue_family_indices_t queueFamilyIndices = renderer->queueFamilyIndices;
+    uint32_t indices[] = { queueFamilyIndices.graphicsFamily, queueFamilyIndices.presentFamily };
+
+    if (queueFamilyIndices.graphicsFamily != queueFamilyIndices.presentFamily) {
+        createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        createInfo.queueFamilyIndexCount = 2;
+        createInfo.pQueueFamilyIndices = indices;
+    } else {
+        createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        createInfo.queueFamilyIndexCount = 0;
+        createInfo.pQueueFamilyIndices = NULL;
+    }
+
+    if (vkCreateSwapchainKHR(renderer->logicalDevice, &createInfo, NULL, &target->swapchain) != VK_SUCCESS) {
+        FatalError("Failed to create swapchain.");
+    }
+
+    vkGetSwapchainImagesKHR(renderer->logicalDevice, target->swapchain, &target->swapchainImageCount, NULL);
+    target->swapchainImages = calloc(target->swapchainImageCount, sizeof(VkImage));
+    vkGetSwapchainImagesKHR(renderer->logicalDevice, target->swapchain, &target->swapchainImageCount, target->swapchainImages);
+
+    target->imageFences = calloc(target->swapchainImageCount, sizeof(VkFence));
+
+    renderer->colorFormat = surfaceFormat.format;
+    target->presentMode = presentMode;
+    target->extent = extent;
+
+    printf("%s: %ux%u, %s present mode, %u swapchain images.\n", SDL_GetWindowTitle(target->window), extent.width, extent.height, PresentModeName(presentMode), target->swapchainImageCount);
+}
+
+VkImageView CreateImageView(renderer_t *renderer, VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t mipLevels) {
+    VkImageViewCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = format,
+        .components = {
+            .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+            .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+            .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+            .a = VK_COMPONENT_SWIZZLE_IDENTITY,
+        },
+        .subresourceRange = {
+            .aspectMask = aspect,
+            .baseMipLevel = 0,
+            .levelCount = mipLevels,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+    };
+
+    VkImageView imageView;
+    if (vkCreateImageView(renderer->logicalDevice, &createInfo, NULL, &imageView) != VK_SUCCESS) {
+        FatalError("Failed to create image views.");
+    }
+
+    return imageView;
+}
+
+void CreateImageViews(renderer_t *renderer, window_target_t *target) {
+    target->swapchainImageViews = calloc(target->swapchainImageCount, sizeof(VkImageView));
+    for (size_t i = 0; i < target->swapchainImageCount; i++) {
+        target->swapchainImageViews[i] = CreateImageView(renderer, target->swapchainImages[i], renderer->colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    }
+}
+
+VkShaderModule CreateShaderModule(renderer_t *renderer, const char *code, long size) {
+    VkShaderModuleCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = size,
+        .pCode = (const uint32_t *)code,
+    };
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(renderer->logicalDevice, &createInfo, NULL, &shaderModule) != VK_SUCCESS) {
+        FatalError("Failed to create shader module.");
+    }
+
+    return shaderModule;
+}
+
+// Swapchain images are presented; headless images are copied back to the host.
+VkImageLayout FinalColorLayout(renderer_t *renderer) {
+    return renderer->windowCount > 0 ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+}
+
+void CreateRenderPass(renderer_t *renderer) {
+    if (renderer->dynamicRendering) {
+        return;
+    }
+
+    VkImageLayout finalLayout = FinalColorLayout(renderer);
+    bool multisampled = renderer->sampleCount != VK_SAMPLE_COUNT_1_BIT;
+
+    // Attachment 0 is the image that is presented or read back. With MSAA it only receives the resolve,
+    // and attachment 1 holds the samples, which never leave tile memory. Depth comes last and is never stored either.
+    uint32_t depthAttachment = multisampled ? 2 : 1;
+
+    VkAttachmentDescription attachments[3] = {
+        {
+            .format = renderer->colorFormat,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .loadOp = multisampled ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .finalLayout = finalLayout,
+        },
+        {
+            .format = renderer->colorFormat,
+            .samples = renderer->sampleCount,
+            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        },
+    };
+
+    attachments[depthAttachment] = (VkAttachmentDescription){
+        .format = renderer->depthFormat,
+        .samples = renderer->sampleCount,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+    };
+
+    VkAttachmentReference depthAttachmentRef = {
+        .attachment = depthAttachment,
+        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+    };
+
+    VkAttachmentReference colorAttachmentRef = {
+        .attachment = multisampled ? 1 : 0,
+        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    };
+
+    VkAttachmentReference resolveAttachmentRef = {
+        .attachment = 0,
+        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    };
+
+    VkSubpassDescription subpass = {
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &colorAttachmentRef,
+        .pResolveAttachments = multisampled ? &resolveAttachmentRef : NULL,
+        .pDepthStencilAttachment = &depthAttachmentRef,
+    };
+
+    VkSubpassDependency dependencies[] = {
+        // Also orders the previous frame's writes to the shared multisampled and depth images before this frame's.
+        {
+            .srcSubpass = VK_SUBPASS_EXTERNAL,
+            .dstSubpass = 0,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        },
+        // Make color writes visible to the copy that reads the image back.
+        {
+            .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+        },
+    };
+
+    VkRenderPassCreateInfo renderPassInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .attachmentCount = depthAttachment + 1,
+        .pAttachments = attachments,
+        .subpassCount = 1,
+        .pSubpasses = &subpass,
+        .dependencyCount = finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ? 2 : 1,
+        .pDependencies = dependencies,
+    };
+
+    if (vkCreateRenderPass(renderer->logicalDevice, &renderPassInfo, NULL, &renderer->renderPass) != VK_SUCCESS) {
+        FatalError("Failed to create render pass.");
+    }
+}
+
+void CreateGraphicsPipeline(renderer_t *renderer) {
+    bool instanced = options.scene == SCENE_INSTANCED;
+    bool mesh = options.scene == SCENE_MESH;
+    char *vertexShaderName = renderer->bindless ? "bindless.vert.spv" : instanced ? "instanced.vert.spv" : mesh ? "mesh.vert.spv" : "vertex.spv";
+
+    long vertexShaderCodeSize, fragmentShaderCodeSize;
+    char *vertexShaderCode = ReadBytesFromResource(vertexShaderName, &vertexShaderCodeSize);
+    char *fragmentShaderCode = ReadBytesFromResource(renderer->bindless ? "bindless.frag.spv" : "fragment.spv", &fragmentShaderCodeSize);
+
+    VkShaderModule vertexShaderModule = CreateShaderModule(renderer, vertexShaderCode, vertexShaderCodeSize);
+    VkShaderModule fragmentShaderModule = CreateShaderModule(renderer, fragmentShaderCode, fragmentShaderCodeSize);
+
+    free(vertexShaderCode);
+    free(fragmentShaderCode);
+
+    VkPipelineShaderStageCreateInfo vertexShaderStageInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage = VK_SHADER_STAGE_VERTEX_BIT,
+        .module = vertexShaderModule,
+        .pName = "main",
+    };
+
+    VkPipelineShaderStageCreateInfo fragmentShaderStageInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+        .module = fragmentShaderModule,
+        .pName = "main",
+    };
+
+    VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageInfo, fragmentShaderStageInfo };
+
+    // The triangle's vertices are built into the shader; the instanced scene adds per-instance attributes.
+    VkVertexInputBindingDescription instanceBinding = {
+        .binding = 0,
+        .stride = sizeof(instance_data_t),
+        .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+    };
+
+    VkVertexInputAttributeDescription instanceAttributes[] = {
+        {
+            .location = 0,
+            .binding = 0,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = offsetof(instance_data_t, offsetScale),
+        },
+        {
+            .location = 1,
+            .binding = 0,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = offsetof(instance_data_t, color),
+        },
+        {
+            .location = 2,
+            .binding = 0,
+            .format = VK_FORMAT_R32_UINT,
+            .offset = offsetof(instance_data_t, material),
+        },
+    };
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = instanced ? 1 : 0,
+        .pVertexBindingDescriptions = &instanceBinding,
+        .vertexAttributeDescriptionCount = renderer->bindless ? 3 : instanced ? 2 : 0,
+        .pVertexAttributeDescriptions = instanceAttributes,
+    };
+
+    // The mesh scene reads its vertices from binding 0 and the same instance attributes from binding 1.
+    VkVertexInputBindingDescription meshBindings[] = {
+        { .binding = 0, .stride = sizeof(packed_vertex_t), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX },
+        { .binding = 1, .stride = sizeof(instance_data_t), .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE },
+    };
+
+    VkVertexInputAttributeDescription meshAttributes[] = {
+        { .location = 0, .binding = 1, .format = VK_FORMAT_R32G32B32A32_SFLOAT, .offset = offsetof(instance_data_t, offsetScale) },
+        { .location = 1, .binding = 1, .format = VK_FORMAT_R32G32B32A32_SFLOAT, .offset = offsetof(instance_data_t, color) },
+        { .location = 3, .binding = 0, .format = VK_FORMAT_R16G16B16A16_SNORM, .offset = offsetof(packed_vertex_t, position) },
+        { .location = 4, .binding = 0, .format = VK_FORMAT_R8G8_SNORM, .offset = offsetof(packed_vertex_t, normal) },
+    };
+
+    if (mesh) {
+        vertexInputInfo.vertexBindingDescriptionCount = 2;
+        vertexInputInfo.pVertexBindingDescriptions = meshBindings;
+        vertexInputInfo.vertexAttributeDescriptionCount = 4;
+        vertexInputInfo.pVertexAttributeDescriptions = meshAttributes;
+    }
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE,
+    };
+
+    // Viewport and scissor are dynamic so one pipeline serves windows of any size.
+    VkPipelineViewportStateCreateInfo viewportState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .pViewports = NULL,
+        .scissorCount = 1,
+        .pScissors = NULL,
+    };
+
+    VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = 2,
+        .pDynamicStates = dynamicStates,
+    };
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .lineWidth = 1,
+        .cullMode = VK_CULL_MODE_BACK_BIT,
+        // mesh.vert keeps the counter-clockwise winding of OBJ files.
+        .frontFace = mesh ? VK_FRONT_FACE_COUNTER_CLOCKWISE : VK_FRONT_FACE_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+        .depthBiasConstantFactor = 0,
+        .depthBiasClamp = 0,
+        .depthBiasSlopeFactor = 0,
+    };
+
+    VkPipelineMultisampleStateCreateInfo multisampling = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .sampleShadingEnable = VK_FALSE,
+        .rasterizationSamples = renderer->sampleCount,
+        .minSampleShading = 1,
+        .pSampleMask = NULL,
+        .alphaToCoverageEnable = VK_FALSE,
+        .alphaToOneEnable = VK_FALSE,
+    };
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp = VK_COMPARE_OP_LESS,
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE,
+    };
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+        .blendEnable = VK_FALSE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+    };
+
+    VkPipelineColorBlendStateCreateInfo colorBlending = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .logicOp = VK_LOGIC_OP_COPY,
+        .attachmentCount = 1,
+        .pAttachments = &colorBlendAttachment,
+        .blendConstants = { 0, 0, 0, 0 },
+    };
+
+    // Every pipeline takes the draw constants; vertex.spv predates them and ignores them.
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .offset = 0,
+        .size = sizeof(draw_constants_t),
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = renderer->bindless ? 1 : 0,
+        .pSetLayouts = &renderer->bindlessTable.layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange,
+    };
+
+    if (vkCreatePipelineLayout(renderer->logicalDevice, &pipelineLayoutInfo, NULL, &renderer->pipelineLayout) != VK_SUCCESS) {
+        FatalError("Failed to create pipeline layout.");
+    }
+
+    // Without a render pass the attachment formats are given to the pipeline directly.
+    VkPipelineRenderingCreateInfoKHR renderingInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &renderer->colorFormat,
+        .depthAttachmentFormat = renderer->depthFormat,
+    };
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = renderer->dynamicRendering ? &renderingInfo : NULL,
+        .stageCount = 2,
+        .pStages = shaderStages,
+        .pVertexInputState = &vertexInputInfo,
+        .pInputAssemblyState = &inputAssembly,
+        .pViewportState = &viewportState,
+        .pMultisampleState = &multisampling,
+        .pDepthStencilState = &depthStencil,
+        .pColorBlendState = &colorBlending,
+        .pRasterizationState = &rasterizer,
+        .pDynamicState = &dynamicState,
+        .layout = renderer->pipelineLayout,
+        .renderPass = renderer->renderPass,
+        .subpass = 0,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+    };
+
+    if (vkCreateGraphicsPipelines(renderer->logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &renderer->graphicsPipeline) != VK_SUCCESS) {
+        FatalError("Failed to create graphics pipeline.");
+    }
+
+    // The pre-pass runs the same vertex shader without a fragment shader or color writes.
+    pipelineInfo.stageCount = 1;
+    colorBlendAttachment.colorWriteMask = 0;
+
+    if (vkCreateGraphicsPipelines(renderer->logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &renderer->depthPrepassPipeline) != VK_SUCCESS) {
+        FatalError("Failed to create depth pre-pass pipeline.");
+    }
+
+    // The color pass then shades only the fragment that won the depth test.
+    pipelineInfo.stageCount = 2;
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    depthStencil.depthWriteEnable = VK_FALSE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+
+    if (vkCreateGraphicsPipelines(renderer->logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &renderer->depthEqualPipeline) != VK_SUCCESS) {
+        FatalError("Failed to create depth equal pipeline.");
+    }
+
+    vkDestroyShaderModule(renderer->logicalDevice, fragmentShaderModule, NULL);
+    vkDestroyShaderModule(renderer->logicalDevice, vertexShaderModule, NULL);
+}
+
+// Attachments are in the order CreateRenderPass() declares them.
+VkFramebuffer CreateFramebuffer(renderer_t *renderer, const render_target_t *target) {
+    VkImageView attachments[3];
+    uint32_t attachmentCount = 0;
+
+    attachments[attachmentCount++] = target->imageView;
+    if (target->msaaColor.view != VK_NULL_HANDLE) {
+        attachments[attachmentCount++] = target->msaaColor.view;
+    }
+    attachments[attachmentCount++] = target->depth.view;
+
+    VkFramebufferCreateInfo framebufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        .renderPass = renderer->renderPass,
+        .attachmentCount = attachmentCount,
+        .pAttachments = attachments,
+        .width = target->extent.width,
+        .height = target->extent.height,
+        .layers = 1,
+    };
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(renderer->logicalDevice, &framebufferInfo, NULL, &framebuffer) != VK_SUCCESS) {
+        FatalError("Failed to create framebuffer.");
+    }
+
+    return framebuffer;
+}
+
+void CreateFramebuffers(renderer_t *renderer, window_target_t *target) {
+    if (renderer->dynamicRendering) {
+        return;
+    }
+
+    target->swapchainFramebuffers = calloc(target->swapchainImageCount, sizeof(VkFramebuffer));
+
+    for (size_t i = 0; i < target->swapchainImageCount; i++) {
+        render_target_t renderTarget = {
+            .imageView = target->swapchainImageViews[i],
+            .msaaColor = target->msaaColor,
+            .depth = target->depth,
+            .extent = target->extent,
+        };
+
+        target->swapchainFramebuffers[i] = CreateFramebuffer(renderer, &renderTarget);
+    }
+}
+
+void CreateCommandPool(renderer_t *renderer) {
+    VkCommandPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .queueFamilyIndex = renderer->queueFamilyIndices.graphicsFamily,
+        // Animation records every frame, and a resize can change the mesh LODs every window draws.
+        .flags = renderer->animate || options.scene == SCENE_MESH || options.textureDirectory ? VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT : 0,
+    };
+
+    if (vkCreateCommandPool(renderer->logicalDevice, &poolInfo, NULL, &renderer->commandPool) != VK_SUCCESS) {
+        FatalError("Failed to create command pool.");
+    }
+}
+
+void TransitionImageLevels(VkCommandBuffer commandBuffer, VkImage image, VkImageAspectFlags aspect, uint32_t baseLevel, uint32_t levelCount,
+                           VkImageLayout oldLayout, VkImageLayout newLayout,
+                           VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+        .oldLayout = oldLayout,
+        .newLayout = newLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = {
+            .aspectMask = aspect,
+            .baseMipLevel = baseLevel,
+            .levelCount = levelCount,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+    };
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+void TransitionImage(VkCommandBuffer commandBuffer, VkImage image, VkImageAspectFlags aspect, VkImageLayout oldLayout, VkImageLayout newLayout,
+                     VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    TransitionImageLevels(commandBuffer, image, aspect, 0, 1, oldLayout, newLayout, srcStage, srcAccess, dstStage, dstAccess);
+}
+
+void TransitionColorImage(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout,
+                          VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    TransitionImage(commandBuffer, image, VK_IMAGE_ASPECT_COLOR_BIT, oldLayout, newLayout, srcStage, srcAccess, dstStage, dstAccess);
+}
+
+// The barriers replace the layout transitions and dependencies that CreateRenderPass() declares for the legacy path.
+void BeginDynamicRendering(renderer_t *renderer, VkCommandBuffer commandBuffer, const render_target_t *target, VkClearValue clearColor, VkClearValue clearDepth) {
+    TransitionColorImage(commandBuffer, target->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+    VkRenderingAttachmentInfoKHR colorAttachment = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+        .imageView = target->imageView,
+        .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .resolveMode = VK_RESOLVE_MODE_NONE,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue = clearColor,
+    };
+
+    // Draw into the multisampled image, discard its samples and resolve into the target at the end of rendering.
+    if (target->msaaColor.image != VK_NULL_HANDLE) {
+        TransitionColorImage(commandBuffer, target->msaaColor.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+        colorAttachment.imageView = target->msaaColor.view;
+        colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+        colorAttachment.resolveImageView = target->imageView;
+        colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    }
+
+    TransitionImage(commandBuffer, target->depth.image, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+
+    VkRenderingAttachmentInfoKHR depthAttachment = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+        .imageView = target->depth.view,
+        .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        .resolveMode = VK_RESOLVE_MODE_NONE,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .clearValue = clearDepth,
+    };
+
+    VkRenderingInfoKHR renderingInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+        .renderArea = {
+            .offset = { .x = 0, .y = 0 },
+            .extent = target->extent,
+        },
+        .layerCount = 1,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &colorAttachment,
+        .pDepthAttachment = &depthAttachment,
+    };
+
+    renderer->vkCmdBeginRenderingKHR(commandBuffer, &renderingInfo);
+}
+
+void EndDynamicRendering(renderer_t *renderer, VkCommandBuffer commandBuffer, const render_target_t *target) {
+    renderer->vkCmdEndRenderingKHR(commandBuffer);
+
+    if (FinalColorLayout(renderer) == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {
+        TransitionColorImage(commandBuffer, target->image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+    } else {
+        TransitionColorImage(commandBuffer, target->image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    }
+}
+
+// The identity transform and a white color leave the scene exactly as the shaders draw it without them.
+draw_constants_t SceneDrawConstants(renderer_t *renderer, VkExtent2D extent) {
+    draw_constants_t constants = {
+        .transform = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 },
+        .color = { 1, 1, 1, 1 },
+        .meshOffset = { renderer->meshOffset[0], renderer->meshOffset[1], renderer->meshOffset[2], 0 },
+        .meshScale = { renderer->meshScale[0], renderer->meshScale[1], renderer->meshScale[2], 0 },
+        .time = (float)renderer->animationTime,
+    };
+
+    if (renderer->animate) {
+        // Rotates about the center of the target, scaling x so that the rotation keeps its shape at any aspect ratio.
+        float aspect = (float)extent.width / (float)extent.height;
+        float angle = (float)renderer->animationTime * 0.5f;
+        float c = cosf(angle);
+        float s = sinf(angle);
+        constants.transform[0] = c;
+        constants.transform[1] = s * aspect;
+        constants.transform[4] = -s / aspect;
+        constants.transform[5] = c;
+    }
+
+    return constants;
+}
+
+void RecordSceneDraw(renderer_t *renderer, VkCommandBuffer commandBuffer, const draw_constants_t *constants) {
+    vkCmdPushConstants(commandBuffer, renderer->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(draw_constants_t), constants);
+
+    if (renderer->meshIndexCount > 0) {
+        VkBuffer buffers[] = { renderer->meshVertexBuffer, renderer->instanceBuffer };
+        VkDeviceSize offsets[] = { 0, 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 2, buffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, renderer->meshIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+        // One draw per LOD, over the run of instances grouped under it.
+        uint32_t firstInstance = 0;
+        for (uint32_t lod = 0; lod < renderer->meshLodCount; lod++) {
+            const mesh_lod_t *level = &renderer->meshLods[lod];
+            if (renderer->lodInstanceCounts[lod] > 0) {
+                vkCmdDrawIndexed(commandBuffer, level->indexCount, renderer->lodInstanceCounts[lod], level->firstIndex, 0, firstInstance);
+            }
+            firstInstance += renderer->lodInstanceCounts[lod];
+        }
+    } else if (renderer->instanceBuffer != VK_NULL_HANDLE) {
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &renderer->instanceBuffer, &offset);
+        vkCmdDraw(commandBuffer, 3, renderer->instanceCount, 0, 0);
+    } else {
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    }
+}
+
+// Bins the scene's triangles into screen tiles, shades each tile into the storage image and blits that into the target.
+// The bins and storage image are reused every frame, so each use first waits for the previous one.
+void RecordComputeRaster(renderer_t *renderer, VkCommandBuffer commandBuffer, const render_target_t *target) {
+    const compute_target_t *compute = target->compute;
+    VkDeviceSize countsSize = (VkDeviceSize)compute->tilesX * compute->tilesY * sizeof(uint32_t);
+
+    raster_constants_t constants = {
+        .extent = { target->extent.width, target->extent.height },
+        .triangleCount = renderer->triangleCount,
+        .tilesX = compute->tilesX,
+        .tilesY = compute->tilesY,
+    };
+
+    VkBufferMemoryBarrier binBarrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = compute->binBuffer,
+        .offset = 0,
+        .size = countsSize,
+    };
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 1, &binBarrier, 0, NULL);
+    vkCmdFillBuffer(commandBuffer, compute->binBuffer, 0, countsSize, 0);
+
+    binBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    binBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1, &binBarrier, 0, NULL);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderer->rasterPipelineLayout, 0, 1, &compute->descriptorSet, 0, NULL);
+    vkCmdPushConstants(commandBuffer, renderer->rasterPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(raster_constants_t), &constants);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderer->rasterBinPipeline);
+    vkCmdDispatch(commandBuffer, (renderer->triangleCount + 63) / 64, 1, 1);
+
+    binBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    binBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    binBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1, &binBarrier, 0, NULL);
+
+    TransitionColorImage(commandBuffer, compute->color.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderer->rasterShadePipeline);
+    vkCmdDispatch(commandBuffer, compute->tilesX, compute->tilesY, 1);
+
+    TransitionColorImage(commandBuffer, compute->color.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    TransitionColorImage(commandBuffer, target->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    VkImageSubresourceLayers subresource = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .mipLevel = 0,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+
+    VkOffset3D corner = { .x = (int32_t)target->extent.width, .y = (int32_t)target->extent.height, .z = 1 };
+    VkImageBlit region = {
+        .srcSubresource = subresource,
+        .srcOffsets = { { 0, 0, 0 }, corner },
+        .dstSubresource = subresource,
+        .dstOffsets = { { 0, 0, 0 }, corner },
+    };
+
+    // A blit rather than a copy, as it converts to the target's format, e.g. BGRA or sRGB swapchain images.
+    vkCmdBlitImage(commandBuffer, compute->color.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_NEAREST);
+
+    if (FinalColorLayout(renderer) == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {
+        TransitionColorImage(commandBuffer, target->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+    } else {
+        TransitionColorImage(commandBuffer, target->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    }
+}
+
+void RecordRenderPass(renderer_t *renderer, VkCommandBuffer commandBuffer, const render_target_t *target, bool depthPrepass) {
+    // The compute rasterizer has no pre-pass variant; both recorded variants are the same.
+    if (renderer->computeRaster) {
+        RecordComputeRaster(renderer, commandBuffer, target);
+        return;
+    }
+
+    VkClearValue clearColor = { 0.3f, 0.3f, 0.3f, 1.0f }; // Light grey background.
+    VkClearValue clearDepth = { .depthStencil = { .depth = 1.0f, .stencil = 0 } };
+
+    // Indexed by attachment, in the order CreateRenderPass() declares them.
+    VkClearValue clearValues[] = { clearColor, clearColor, clearDepth };
+    uint32_t clearValueCount = target->msaaColor.image != VK_NULL_HANDLE ? 3 : 2;
+    clearValues[clearValueCount - 1] = clearDepth;
+    VkExtent2D extent = target->extent;
+
+    VkViewport viewport = {
+        .x = 0,
+        .y = 0,
+        .width = (float)extent.width,
+        .height = (float)extent.height,
+        .minDepth = 0,
+        .maxDepth = 1,
+    };
+
+    VkRect2D scissor = {
+        .offset = { .x = 0, .y = 0 },
+        .extent = extent,
+    };
+
+    if (renderer->dynamicRendering) {
+        BeginDynamicRendering(renderer, commandBuffer, target, clearColor, clearDepth);
+    } else {
+        VkRenderPassBeginInfo renderPassInfo = {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+            .renderPass = renderer->renderPass,
+            .framebuffer = target->framebuffer,
+            .renderArea = {
+                .offset = { .x = 0, .y = 0 },
+                .extent = extent,
+            },
+            .clearValueCount = clearValueCount,
+            .pClearValues = clearValues,
+        };
+
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    }
+
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    // Bound once for every draw; the depth pre-pass pipelines share the layout.
+    if (renderer->bindless) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderer->pipelineLayout, 0, 1, &renderer->bindlessTable.sets[target->bindlessSet], 0, NULL);
+    }
+
+    draw_constants_t constants = SceneDrawConstants(renderer, extent);
+
+    if (depthPrepass) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderer->depthPrepassPipeline);
+        RecordSceneDraw(renderer, commandBuffer, &constants);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderer->depthEqualPipeline);
+        RecordSceneDraw(renderer, commandBuffer, &constants);
+    } else {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderer->graphicsPipeline);
+        RecordSceneDraw(renderer, commandBuffer, &constants);
+    }
+
+    if (renderer->dynamicRendering) {
+        EndDynamicRendering(renderer, commandBuffer, target);
+    } else {
+        vkCmdEndRenderPass(commandBuffer);
+    }
+}
+
+VkCommandBuffer* AllocateCommandBuffers(renderer_t *renderer, uint32_t count) {
+    VkCommandBuffer *commandBuffers = calloc(count, sizeof(VkCommandBuffer));
+
+    VkCommandBufferAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = renderer->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = count,
+    };
+
+    if (vkAllocateCommandBuffers(renderer->logicalDevice, &allocateInfo, commandBuffers) != VK_SUCCESS) {
+        FatalError("Failed to allocate command buffers.");
+    }
+
+    return commandBuffers;
+}
+
+void RecordWindowCommandBuffer(renderer_t *renderer, window_target_t *target, uint32_t imageIndex, bool depthPrepass) {
+    render_target_t renderTarget = {
+        .image = target->swapchainImages[imageIndex],
+        .imageView = target->swapchainImageViews[imageIndex],
+        .msaaColor = target->msaaColor,
+        .depth = target->depth,
+        .framebuffer = target->swapchainFramebuffers ? target->swapchainFramebuffers[imageIndex] : VK_NULL_HANDLE,
+        .extent = target->extent,
+        .compute = &target->compute,
+        .bindlessSet = renderer->currentFrame,
+    };
+
+    VkCommandBuffer commandBuffer = depthPrepass ? target->prepassCommandBuffers[imageIndex] : target->commandBuffers[imageIndex];
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = renderer->animate ? VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT : 0,
+        .pInheritanceInfo = NULL,
+    };
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        FatalError("Failed to begin recording command buffer.");
+    }
+
+    RecordRenderPass(renderer, commandBuffer, &renderTarget, depthPrepass);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        FatalError("Failed to record command buffer.");
+    }
+}
+
+// Records every swapchain image both without and with the depth pre-pass, so the mode can change per frame.
+void CreateCommandBuffers(renderer_t *renderer, window_target_t *target) {
+    target->commandBuffers = AllocateCommandBuffers(renderer, target->swapchainImageCount);
+    target->prepassCommandBuffers = AllocateCommandBuffers(renderer, target->swapchainImageCount);
+
+    for (uint32_t i = 0; i < target->swapchainImageCount; i++) {
+        for (uint32_t prepass = 0; prepass < 2; prepass++) {
+            RecordWindowCommandBuffer(renderer, target, i, prepass);
+        }
+    }
+}
+
+VkSemaphore CreateSemaphore(renderer_t *renderer) {
+    VkSemaphoreCreateInfo semaphoreInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    };
+
+    VkSemaphore semaphore;
+    if (vkCreateSemaphore(renderer->logicalDevice, &semaphoreInfo, NULL, &semaphore) != VK_SUCCESS) {
+        FatalError("Failed to create semaphore.");
+    }
+
+    return semaphore;
+}
+
+VkFence CreateFence(renderer_t *renderer, VkFenceCreateFlags flags) {
+    VkFenceCreateInfo fenceInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .flags = flags,
+    };
+
+    VkFence fence;
+    if (vkCreateFence(renderer->logicalDevice, &fenceInfo, NULL, &fence) != VK_SUCCESS) {
+        FatalError("Failed to create fence.");
+    }
+
+    return fence;
+}
+
+void CreateSyncObjects(renderer_t *renderer) {
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        for (uint32_t j = 0; j < renderer->windowCount; j++) {
+            renderer->windows[j].imageAvailableSemaphores[i] = CreateSemaphore(renderer);
+        }
+
+        renderer->renderFinishedSemaphores[i] = CreateSemaphore(renderer);
+        // Signaled so the first wait on each frame slot returns immediately.
+        renderer->inFlightFences[i] = CreateFence(renderer, VK_FENCE_CREATE_SIGNALED_BIT);
+    }
+}
+
+// Records one command buffer per frame slot that resets the slot's queries and writes the start timestamp,
+// and one that writes the end timestamp. DrawFrame wraps each submission in the pair.
+void CreateTimestampQueries(renderer_t *renderer) {
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(renderer->physicalDevice, &queueFamilyCount, NULL);
+
+    VkQueueFamilyProperties *queueFamilies = calloc(queueFamilyCount, sizeof(VkQueueFamilyProperties));
+    vkGetPhysicalDeviceQueueFamilyProperties(renderer->physicalDevice, &queueFamilyCount, queueFamilies);
+
+    uint32_t validBits = queueFamilies[renderer->queueFamilyIndices.graphicsFamily].timestampValidBits;
+    free(queueFamilies);
+
+    if (validBits == 0) {
+        printf("Graphics queue has no timestamps; frame pacing will only predict CPU time.\n");
+        return;
+    }
+
+    VkQueryPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2 * MAX_FRAMES_IN_FLIGHT,
+    };
+
+    if (vkCreateQueryPool(renderer->logicalDevice, &poolInfo, NULL, &renderer->timestampPool) != VK_SUCCESS) {
+        FatalError("Failed to create timestamp query pool.");
+    }
+
+    VkCommandBufferAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = renderer->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = MAX_FRAMES_IN_FLIGHT,
+    };
+
+    if (vkAllocateCommandBuffers(renderer->logicalDevice, &allocateInfo, renderer->timestampBeginCommands) != VK_SUCCESS ||
+        vkAllocateCommandBuffers(renderer->logicalDevice, &allocateInfo, renderer->timestampEndCommands) != VK_SUCCESS) {
+        FatalError("Failed to allocate timestamp command buffers.");
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+    };
+
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        VkCommandBuffer begin = renderer->timestampBeginCommands[i];
+        VkCommandBuffer end = renderer->timestampEndCommands[i];
+
+        if (vkBeginCommandBuffer(begin, &beginInfo) != VK_SUCCESS || vkBeginCommandBuffer(end, &beginInfo) != VK_SUCCESS) {
+            FatalError("Failed to begin recording timestamp command buffer.");
+        }
+
+        vkCmdResetQueryPool(begin, renderer->timestampPool, 2 * i, 2);
+        vkCmdWriteTimestamp(begin, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, renderer->timestampPool, 2 * i);
+        vkCmdWriteTimestamp(end, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, renderer->timestampPool, 2 * i + 1);
+
+        if (vkEndCommandBuffer(begin) != VK_SUCCESS || vkEndCommandBuffer(end) != VK_SUCCESS) {
+            FatalError("Failed to record timestamp command buffer.");
+        }
+    }
+}
+
+// Called once the slot's fence has signaled, so the results are available without waiting.
+void ReadFrameGPUTime(renderer_t *renderer, uint32_t frame) {
+    uint64_t timestamps[2];
+    VkResult result = vkGetQueryPoolResults(renderer->logicalDevice, renderer->timestampPool, 2 * frame, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result == VK_SUCCESS && timestamps[1] >= timestamps[0]) {
+        renderer->lastGPUTime = (uint64_t)((double)(timestamps[1] - timestamps[0]) * renderer->deviceProperties.limits.timestampPeriod);
+    }
+
+    renderer->timestampsPending[frame] = false;
+}
+
+// Returns UINT32_MAX if no memory type has all of the required properties.
+uint32_t FindMemoryType(renderer_t *renderer, uint32_t typeBits, VkMemoryPropertyFlags properties) {
+    for (uint32_t i = 0; i < renderer->memoryProperties.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) && (renderer->memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+VkDeviceMemory AllocateMemory(renderer_t *renderer, VkMemoryRequirements requirements, VkMemoryPropertyFlags properties) {
+    uint32_t memoryType = FindMemoryType(renderer, requirements.memoryTypeBits, properties);
+    if (memoryType == UINT32_MAX) {
+        FatalError("Failed to find a suitable memory type.");
+    }
+
+    VkMemoryAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = requirements.size,
+        .memoryTypeIndex = memoryType,
+    };
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(renderer->logicalDevice, &allocateInfo, NULL, &memory) != VK_SUCCESS) {
+        FatalError("Failed to allocate device memory.");
+    }
+
+    return memory;
+}
+
+VkBuffer CreateBuffer(renderer_t *renderer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkDeviceMemory *memoryOut) {
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+
+    VkBuffer buffer;
+    if (vkCreateBuffer(renderer->logicalDevice, &bufferInfo, NULL, &buffer) != VK_SUCCESS) {
+        FatalError("Failed to create buffer.");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(renderer->logicalDevice, buffer, &requirements);
+    *memoryOut = AllocateMemory(renderer, requirements, properties);
+    vkBindBufferMemory(renderer->logicalDevice, buffer, *memoryOut, 0);
+
+    return buffer;
+}
+
+// For one-off work such as uploads at startup. EndOneTimeCommands() waits for the queue to finish it.
+VkCommandBuffer BeginOneTimeCommands(renderer_t *renderer) {
+    VkCommandBuffer *commandBuffers = AllocateCommandBuffers(renderer, 1);
+    VkCommandBuffer commandBuffer = commandBuffers[0];
+    free(commandBuffers);
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        FatalError("Failed to begin recording command buffer.");
+    }
+
+    return commandBuffer;
+}
+
+void EndOneTimeCommands(renderer_t *renderer, VkCommandBuffer commandBuffer) {
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        FatalError("Failed to record command buffer.");
+    }
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer,
+    };
+
+    if (vkQueueSubmit(renderer->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        FatalError("Failed to submit command buffer.");
+    }
+
+    vkQueueWaitIdle(renderer->graphicsQueue);
+    vkFreeCommandBuffers(renderer->logicalDevice, renderer->commandPool, 1, &commandBuffer);
+}
+
+// Mip chains are blitted when the format can be linearly filtered and blitted, and downsampled in compute otherwise.
+bool CanBlitMipmaps(renderer_t *renderer, VkFormat format) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(renderer->physicalDevice, format, &formatProperties);
+
+    VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+    return !options.computeMipmaps && (formatProperties.optimalTilingFeatures & required) == required;
+}
+
+texture_t CreateTexture(renderer_t *renderer, VkExtent2D extent, VkFormat format, uint32_t mipLevels) {
+    texture_t texture = {
+        .extent = extent,
+        .format = format,
+        .mipLevels = mipLevels,
+        .bindlessIndex = UINT32_MAX,
+    };
+
+    // Textures written on a separate transfer queue family are shared with the graphics family instead of transferred.
+    uint32_t families[] = { renderer->queueFamilyIndices.graphicsFamily, renderer->queueFamilyIndices.transferFamily };
+    bool shared = families[0] != families[1];
+
+    // Usage for generating the mip chain on the GPU, if the format allows it. Compressed chains always come from files.
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(renderer->physicalDevice, format, &formatProperties);
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (mipLevels > 1 && CanBlitMipmaps(renderer, format)) {
+        usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    } else if (mipLevels > 1 && (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+        usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = { .width = extent.width, .height = extent.height, .depth = 1 },
+        .mipLevels = mipLevels,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = usage,
+        .sharingMode = shared ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = shared ? 2 : 0,
+        .pQueueFamilyIndices = families,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+
+    if (vkCreateImage(renderer->logicalDevice, &imageInfo, NULL, &texture.image) != VK_SUCCESS) {
+        FatalError("Failed to create texture image.");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(renderer->logicalDevice, texture.image, &requirements);
+    texture.memory = AllocateMemory(renderer, requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    vkBindImageMemory(renderer->logicalDevice, texture.image, texture.memory, 0);
+
+    texture.view = CreateImageView(renderer, texture.image, format, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+
+    return texture;
+}
+
+// Records the copy of tightly packed RGBA8 pixels into mip level 0, leaving every level in TRANSFER_DST_OPTIMAL.
+// The returned staging buffer must be destroyed once the commands have completed.
+VkBuffer RecordTextureUpload(renderer_t *renderer, VkCommandBuffer commandBuffer, texture_t *texture, const uint8_t *pixels, VkDeviceMemory *stagingMemoryOut) {
+    VkDeviceSize size = (VkDeviceSize)texture->extent.width * texture->extent.height * 4;
+
+    VkDeviceMemory stagingMemory;
+    VkBuffer stagingBuffer = CreateBuffer(renderer, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingMemory);
+
+    void *data;
+    if (vkMapMemory(renderer->logicalDevice, stagingMemory, 0, size, 0, &data) != VK_SUCCESS) {
+        FatalError("Failed to map staging buffer.");
+    }
+    memcpy(data, pixels, size);
+    vkUnmapMemory(renderer->logicalDevice, stagingMemory);
+
+    VkBufferImageCopy region = {
+        .bufferOffset = 0,
+        .imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1 },
+        .imageExtent = { .width = texture->extent.width, .height = texture->extent.height, .depth = 1 },
+    };
+
+    TransitionImageLevels(commandBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->mipLevels,
+                          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    *stagingMemoryOut = stagingMemory;
+    return stagingBuffer;
+}
+
+// Copies tightly packed RGBA8 pixels into the texture's only mip level and leaves it ready for sampling.
+void UploadTexture(renderer_t *renderer, texture_t *texture, const uint8_t *pixels) {
+    VkCommandBuffer commandBuffer = BeginOneTimeCommands(renderer);
+    VkDeviceMemory stagingMemory;
+    VkBuffer stagingBuffer = RecordTextureUpload(renderer, commandBuffer, texture, pixels, &stagingMemory);
+    TransitionColorImage(commandBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    EndOneTimeCommands(renderer, commandBuffer);
+
+    vkDestroyBuffer(renderer->logicalDevice, stagingBuffer, NULL);
+    vkFreeMemory(renderer->logicalDevice, stagingMemory, NULL);
+}
+
+void DestroyTexture(renderer_t *renderer, texture_t *texture) {
+    vkDestroyImageView(renderer->logicalDevice, texture->view, NULL);
+    vkDestroyImage(renderer->logicalDevice, texture->image, NULL);
+    vkFreeMemory(renderer->logicalDevice, texture->memory, NULL);
+    memset(texture, 0, sizeof(texture_t));
+}
+
+void CreateTextureSampler(renderer_t *renderer) {
+    VkSamplerCreateInfo samplerInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_LINEAR,
+        .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .anisotropyEnable = VK_FALSE,
+        .compareEnable = VK_FALSE,
+        .minLod = 0,
+        .maxLod = VK_LOD_CLAMP_NONE,
+        .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
+        .unnormalizedCoordinates = VK_FALSE,
+    };
+
+    if (vkCreateSampler(renderer->logicalDevice, &samplerInfo, NULL, &renderer->textureSampler) != VK_SUCCESS) {
+        FatalError("Failed to create texture sampler.");
+    }
+}
+
+// The layout carries binding flags, which the descriptor layout cache does not key on, so the table owns it.
+// setCount is the number of frames that can be in flight at once.
+void CreateBindlessTable(renderer_t *renderer, uint32_t setCount) {
+    bindless_table_t *table = &renderer->bindlessTable;
+    if (setCount > BINDLESS_MAX_SETS) {
+        FatalError("Too many bindless descriptor sets (%u).", setCount);
+    }
+    table->setCount = setCount;
+
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT,
+    };
+
+    VkPhysicalDeviceProperties2 properties2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &indexingProperties,
+    };
+
+    vkGetPhysicalDeviceProperties2(renderer->physicalDevice, &properties2);
+
+    table->capacity = MIN(BINDLESS_MAX_TEXTURES, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages);
+    table->capacity = MIN(table->capacity, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages);
+
+    VkDescriptorSetLayoutBinding binding = {
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorCount = table->capacity,
+        .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+    };
+
+    // Slots that were never written are fine as long as no shader reads them.
+    VkDescriptorBindingFlagsEXT bindingFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,
+        .bindingCount = 1,
+        .pBindingFlags = &bindingFlags,
+    };
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = &bindingFlagsInfo,
+        .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT,
+        .bindingCount = 1,
+        .pBindings = &binding,
+    };
+
+    if (vkCreateDescriptorSetLayout(renderer->logicalDevice, &layoutInfo, NULL, &table->layout) != VK_SUCCESS) {
+        FatalError("Failed to create bindless descriptor set layout.");
+    }
+
+    VkDescriptorPoolSize poolSize = {
+        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorCount = table->capacity * setCount,
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT,
+        .maxSets = setCount,
+        .poolSizeCount = 1,
+        .pPoolSizes = &poolSize,
+    };
+
+    if (vkCreateDescriptorPool(renderer->logicalDevice, &poolInfo, NULL, &table->pool) != VK_SUCCESS) {
+        FatalError("Failed to create bindless descriptor pool.");
+    }
+
+    VkDescriptorSetLayout setLayouts[BINDLESS_MAX_SETS];
+    for (uint32_t i = 0; i < setCount; i++) {
+        setLayouts[i] = table->layout;
+    }
+
+    VkDescriptorSetAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = table->pool,
+        .descriptorSetCount = setCount,
+        .pSetLayouts = setLayouts,
+    };
+
+    if (vkAllocateDescriptorSets(renderer->logicalDevice, &allocateInfo, table->sets) != VK_SUCCESS) {
+        FatalError("Failed to allocate bindless descriptor sets.");
+    }
+
+    table->views = calloc(table->capacity, sizeof(VkImageView));
+    table->staleSets = calloc(table->capacity, sizeof(uint8_t));
+    table->staleSlots = calloc(table->capacity, sizeof(uint32_t));
+
+    CreateTextureSampler(renderer);
+
+    printf("Bindless texture array with %u slots, %u copies.\n", table->capacity, setCount);
+}
+
+VkWriteDescriptorSet BindlessWrite(VkDescriptorSet set, uint32_t index, const VkDescriptorImageInfo *imageInfo) {
+    return (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = set,
+        .dstBinding = 0,
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = imageInfo,
+    };
+}
+
+// Points a slot of every copy of the bindless array at the texture's view. Only for setup, before any frame is submitted.
+void WriteBindlessTexture(renderer_t *renderer, uint32_t index, VkImageView view) {
+    bindless_table_t *table = &renderer->bindlessTable;
+    table->views[index] = view;
+
+    VkDescriptorImageInfo imageInfo = {
+        .sampler = renderer->textureSampler,
+        .imageView = view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+
+    VkWriteDescriptorSet writes[BINDLESS_MAX_SETS];
+    for (uint32_t i = 0; i < table->setCount; i++) {
+        writes[i] = BindlessWrite(table->sets[i], index, &imageInfo);
+    }
+
+    vkUpdateDescriptorSets(renderer->logicalDevice, table->setCount, writes, 0, NULL);
+}
+
+// Points a slot at a new view while frames are in flight. Each copy of the set picks it up in FlushBindlessSet.
+void ReplaceBindlessTexture(renderer_t *renderer, uint32_t index, VkImageView view) {
+    bindless_table_t *table = &renderer->bindlessTable;
+    table->views[index] = view;
+
+    if (table->staleSets[index] == 0) {
+        table->staleSlots[table->staleCount++] = index;
+    }
+    table->staleSets[index] = (uint8_t)((1u << table->setCount) - 1);
+}
+
+// Rewrites the stale slots of one copy of the set. The caller has waited for the frames that used it.
+void FlushBindlessSet(renderer_t *renderer, uint32_t set) {
+    bindless_table_t *table = &renderer->bindlessTable;
+    if (table->staleCount == 0) {
+        return;
+    }
+
+    VkDescriptorImageInfo *imageInfos = calloc(table->staleCount, sizeof(VkDescriptorImageInfo));
+    VkWriteDescriptorSet *writes = calloc(table->staleCount, sizeof(VkWriteDescriptorSet));
+    uint32_t writeCount = 0;
+    uint32_t remaining = 0;
+
+    for (uint32_t i = 0; i < table->staleCount; i++) {
+        uint32_t index = table->staleSlots[i];
+        if (table->staleSets[index] & (1u << set)) {
+            imageInfos[writeCount] = (VkDescriptorImageInfo){
+                .sampler = renderer->textureSampler,
+                .imageView = table->views[index],
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            };
+            writes[writeCount] = BindlessWrite(table->sets[set], index, &imageInfos[writeCount]);
+            writeCount++;
+            table->staleSets[index] &= (uint8_t)~(1u << set);
+        }
+
+        if (table->staleSets[index] != 0) {
+            table->staleSlots[remaining++] = index;
+        }
+    }
+    table->staleCount = remaining;
+
+    vkUpdateDescriptorSets(renderer->logicalDevice, writeCount, writes, 0, NULL);
+    free(writes);
+    free(imageInfos);
+}
+
+void AddBindlessTexture(renderer_t *renderer, texture_t *texture) {
+    bindless_table_t *table = &renderer->bindlessTable;
+    if (table->count == table->capacity) {
+        FatalError("The bindless texture array is full (%u textures).", table->capacity);
+    }
+
+    texture->bindlessIndex = table->count++;
+    WriteBindlessTexture(renderer, texture->bindlessIndex, texture->view);
+}
+
+void DestroyBindlessTable(renderer_t *renderer) {
+    free(renderer->bindlessTable.views);
+    free(renderer->bindlessTable.staleSets);
+    free(renderer->bindlessTable.staleSlots);
+    vkDestroyDescriptorPool(renderer->logicalDevice, renderer->bindlessTable.pool, NULL);
+    vkDestroyDescriptorSetLayout(renderer->logicalDevice, renderer->bindlessTable.layout, NULL);
+    vkDestroySampler(renderer->logicalDevice, renderer->textureSampler, NULL);
+    memset(&renderer->bindlessTable, 0, sizeof(bindless_table_t));
+}
+
+uint64_t HashDescriptorSignature(const descriptor_signature_t *signature) {
+    // FNV-1a over the fields that identify a layout.
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint32_t i = 0; i < signature->bindingCount; i++) {
+        const VkDescriptorSetLayoutBinding *binding = &signature->bindings[i];
+        uint32_t fields[] = { binding->binding, (uint32_t)binding->descriptorType, binding->descriptorCount, binding->stageFlags };
+        for (uint32_t f = 0; f < 4; f++) {
+            hash = (hash ^ fields[f]) * 0x100000001b3ull;
+        }
+    }
+
+    return hash;
+}
+
+bool DescriptorSignaturesEqual(const descriptor_signature_t *a, const descriptor_signature_t *b) {
+    if (a->bindingCount != b->bindingCount) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < a->bindingCount; i++) {
+        const VkDescriptorSetLayoutBinding *x = &a->bindings[i];
+        const VkDescriptorSetLayoutBinding *y = &b->bindings[i];
+        if (x->binding != y->binding || x->descriptorType != y->descriptorType || x->descriptorCount != y->descriptorCount || x->stageFlags != y->stageFlags) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Adds a binding, keeping the signature sorted so the same bindings in any order give the same layout.
+void AddSignatureBinding(descriptor_signature_t *signature, VkDescriptorSetLayoutBinding binding) {
+    if (signature->bindingCount == MAX_DESCRIPTOR_BINDINGS) {
+        FatalError("A descriptor set has more than %d bindings.", MAX_DESCRIPTOR_BINDINGS);
+    }
+
+    uint32_t i = signature->bindingCount++;
+    while (i > 0 && signature->bindings[i - 1].binding > binding.binding) {
+        signature->bindings[i] = signature->bindings[i - 1];
+        i--;
+    }
+
+    binding.pImmutableSamplers = NULL;
+    signature->bindings[i] = binding;
+}
+
+// Returns the cached layout for the bindings, creating it on first use. The cache owns every layout it returns.
+VkDescriptorSetLayout GetDescriptorSetLayout(renderer_t *renderer, const VkDescriptorSetLayoutBinding *bindings, uint32_t bindingCount) {
+    descriptor_signature_t signature = {};
+    for (uint32_t i = 0; i < bindingCount; i++) {
+        AddSignatureBinding(&signature, bindings[i]);
+    }
+
+    descriptor_layout_cache_t *cache = &renderer->descriptorLayouts;
+    uint64_t hash = HashDescriptorSignature(&signature);
+
+    for (uint32_t i = 0; i < cache->count; i++) {
+        if (cache->entries[i].hash == hash && DescriptorSignaturesEqual(&cache->entries[i].signature, &signature)) {
+            return cache->entries[i].layout;
+        }
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = signature.bindingCount,
+        .pBindings = signature.bindings,
+    };
+
+    VkDescriptorSetLayout layout;
+    if (vkCreateDescriptorSetLayout(renderer->logicalDevice, &layoutInfo, NULL, &layout) != VK_SUCCESS) {
+        FatalError("Failed to create descriptor set layout.");
+    }
+
+    if (cache->count == cache->capacity) {
+        cache->capacity = MAX(cache->capacity * 2, 8);
+        cache->entries = realloc(cache->entries, cache->capacity * sizeof(descriptor_layout_entry_t));
+    }
+
+    cache->entries[cache->count++] = (descriptor_layout_entry_t){
+        .hash = hash,
+        .signature = signature,
+        .layout = layout,
+    };
+
+    return layout;
+}
+
+void DestroyDescriptorLayoutCache(renderer_t *renderer) {
+    descriptor_layout_cache_t *cache = &renderer->descriptorLayouts;
+    for (uint32_t i = 0; i < cache->count; i++) {
+        vkDestroyDescriptorSetLayout(renderer->logicalDevice, cache->entries[i].layout, NULL);
+    }
+
+    free(cache->entries);
+    memset(cache, 0, sizeof(descriptor_layout_cache_t));
+}
+
+// Each pool is twice the size of the one before, so a busy allocator settles on a few pools.
+VkDescriptorPool CreateDescriptorPool(renderer_t *renderer, uint32_t poolIndex) {
+    uint32_t setCount = 16u << MIN(poolIndex, 6);
+
+    // Descriptors per set of each type, roughly as they occur in practice.
+    VkDescriptorPoolSize poolSizes[] = {
+        { .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = setCount },
+        { .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = setCount * 2 },
+        { .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = setCount },
+        { .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = setCount * 2 },
+        { .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .descriptorCount = setCount },
+        { .type = VK_DESCRIPTOR_TYPE_SAMPLER, .descriptorCount = setCount },
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = 0,
+        .maxSets = setCount,
+        .poolSizeCount = sizeof(poolSizes) / sizeof(poolSizes[0]),
+        .pPoolSizes = poolSizes,
+    };
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(renderer->logicalDevice, &poolInfo, NULL, &pool) != VK_SUCCESS) {
+        FatalError("Failed to create descriptor pool.");
+    }
+
+    return pool;
+}
+
+VkDescriptorSet AllocateDescriptorSet(renderer_t *renderer, descriptor_allocator_t *allocator, VkDescriptorSetLayout layout) {
+    for (;;) {
+        bool freshPool = allocator->currentPool == allocator->poolCount;
+        if (freshPool) {
+            allocator->pools = realloc(allocator->pools, (allocator->poolCount + 1) * sizeof(VkDescriptorPool));
+            allocator->pools[allocator->poolCount] = CreateDescriptorPool(renderer, allocator->poolCount);
+            allocator->poolCount++;
+        }
+
+        VkDescriptorSetAllocateInfo allocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = allocator->pools[allocator->currentPool],
+            .descriptorSetCount = 1,
+            .pSetLayouts = &layout,
+        };
+
+        VkDescriptorSet set;
+        VkResult result = vkAllocateDescriptorSets(renderer->logicalDevice, &allocateInfo, &set);
+        if (result == VK_SUCCESS) {
+            return set;
+        }
+
+        // A full pool moves on to the next one; a set that does not fit in an empty pool never will.
+        if ((result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) || freshPool) {
+            FatalError("Failed to allocate descriptor set.");
+        }
+
+        allocator->currentPool++;
+    }
+}
+
+// Releases every set allocated since the last reset. The sets must no longer be in use by the GPU.
+void ResetDescriptorAllocator(renderer_t *renderer, descriptor_allocator_t *allocator) {
+    for (uint32_t i = 0; i < allocator->poolCount; i++) {
+        vkResetDescriptorPool(renderer->logicalDevice, allocator->pools[i], 0);
+    }
+
+    allocator->currentPool = 0;
+}
+
+void DestroyDescriptorAllocator(renderer_t *renderer, descriptor_allocator_t *allocator) {
+    for (uint32_t i = 0; i < allocator->poolCount; i++) {
+        vkDestroyDescriptorPool(renderer->logicalDevice, allocator->pools[i], NULL);
+    }
+
+    free(allocator->pools);
+    memset(allocator, 0, sizeof(descriptor_allocator_t));
+}
+
+descriptor_set_builder_t BeginDescriptorSet(descriptor_allocator_t *allocator) {
+    return (descriptor_set_builder_t){ .allocator = allocator };
+}
+
+VkWriteDescriptorSet* AddDescriptorBinding(descriptor_set_builder_t *builder, uint32_t binding, VkDescriptorType type, VkShaderStageFlags stages) {
+    uint32_t index = builder->signature.bindingCount;
+
+    AddSignatureBinding(&builder->signature, (VkDescriptorSetLayoutBinding){
+        .binding = binding,
+        .descriptorType = type,
+        .descriptorCount = 1,
+        .stageFlags = stages,
+    });
+
+    builder->writes[index] = (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstBinding = binding,
+        .descriptorCount = 1,
+        .descriptorType = type,
+    };
+
+    return &builder->writes[index];
+}
+
+void AddDescriptorBuffer(descriptor_set_builder_t *builder, uint32_t binding, VkDescriptorType type, VkShaderStageFlags stages,
+                         VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    uint32_t index = builder->signature.bindingCount;
+    builder->bufferInfos[index] = (VkDescriptorBufferInfo){ .buffer = buffer, .offset = offset, .range = range };
+    AddDescriptorBinding(builder, binding, type, stages)->pBufferInfo = &builder->bufferInfos[index];
+}
+
+void AddDescriptorImage(descriptor_set_builder_t *builder, uint32_t binding, VkDescriptorType type, VkShaderStageFlags stages,
+                        VkImageView view, VkSampler sampler, VkImageLayout layout) {
+    uint32_t index = builder->signature.bindingCount;
+    builder->imageInfos[index] = (VkDescriptorImageInfo){ .sampler = sampler, .imageView = view, .imageLayout = layout };
+    AddDescriptorBinding(builder, binding, type, stages)->pImageInfo = &builder->imageInfos[index];
+}
+
+// Allocates the set from the builder's allocator and writes every descriptor in one update.
+// The layout, which is the one GetDescriptorSetLayout() returns for the same bindings, is optionally returned.
+VkDescriptorSet BuildDescriptorSet(renderer_t *renderer, descriptor_set_builder_t *builder, VkDescriptorSetLayout *layoutOut) {
+    VkDescriptorSetLayout layout = GetDescriptorSetLayout(renderer, builder->signature.bindings, builder->signature.bindingCount);
+    VkDescriptorSet set = AllocateDescriptorSet(renderer, builder->allocator, layout);
+
+    uint32_t writeCount = builder->signature.bindingCount;
+    for (uint32_t i = 0; i < writeCount; i++) {
+        builder->writes[i].dstSet = set;
+    }
+
+    vkUpdateDescriptorSets(renderer->logicalDevice, writeCount, builder->writes, 0, NULL);
+
+    if (layoutOut) {
+        *layoutOut = layout;
+    }
+
+    return set;
+}
+
+// Small deterministic generator, so every renderer and run builds the same scene.
+uint32_t NextRandom(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+float RandomFloat(uint32_t *state, float min, float max) {
+    return min + (max - min) * (float)(NextRandom(state) >> 8) / (float)(1u << 24);
+}
+
+int CompareInstanceDepth(const void *a, const void *b) {
+    float x = ((const instance_data_t*)a)->offsetScale[2];
+    float y = ((const instance_data_t*)b)->offsetScale[2];
+    return (x > y) - (x < y);
+}
+
+// Nearest first, so that with a LESS depth test early-Z rejects the fragments of everything behind.
+void SortInstancesFrontToBack(instance_data_t *instances, uint32_t count) {
+    qsort(instances, count, sizeof(instance_data_t), CompareInstanceDepth);
+}
+
+// Overlapping triangles scattered over the screen at random depths.
+instance_data_t* GenerateInstancedScene(uint32_t count) {
+    instance_data_t *instances = calloc(count, sizeof(instance_data_t));
+    uint32_t state = 0x2545f491;
+
+    for (uint32_t i = 0; i < count; i++) {
+        instance_data_t *instance = &instances[i];
+        instance->offsetScale[0] = RandomFloat(&state, -1.0f, 1.0f);
+        instance->offsetScale[1] = RandomFloat(&state, -1.0f, 1.0f);
+        instance->offsetScale[2] = RandomFloat(&state, 0.0f, 1.0f);
+        instance->offsetScale[3] = RandomFloat(&state, 0.1f, 0.6f);
+        instance->color[0] = RandomFloat(&state, 0.2f, 1.0f);
+        instance->color[1] = RandomFloat(&state, 0.2f, 1.0f);
+        instance->color[2] = RandomFloat(&state, 0.2f, 1.0f);
+        instance->color[3] = 1.0f;
+    }
+
+    SortInstancesFrontToBack(instances, count);
+
+    return instances;
+}
+
+// The scene as a flat list of triangles in draw order, for rasterizers that do not run the vertex shaders.
+scene_triangle_t* BuildSceneTriangles(uint32_t *countOut) {
+    // The triangle built into vertex.spv and shaders/instanced.vert, and the colors of vertex.spv.
+    static const float positions[3][2] = { { 0.0f, -0.5f }, { 0.5f, 0.5f }, { -0.5f, 0.5f } };
+    static const float colors[3][3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+
+    if (options.scene != SCENE_INSTANCED) {
+        scene_triangle_t *triangle = calloc(1, sizeof(scene_triangle_t));
+        for (uint32_t v = 0; v < 3; v++) {
+            memcpy(triangle->positions[v], positions[v], sizeof(positions[v]));
+            triangle->positions[v][3] = 1.0f;
+            memcpy(triangle->colors[v], colors[v], sizeof(colors[v]));
+            triangle->colors[v][3] = 1.0f;
+        }
+
+        *countOut = 1;
+        return triangle;
+    }
+
+    uint32_t count = options.instanceCount;
+    instance_data_t *instances = GenerateInstancedScene(count);
+    scene_triangle_t *triangles = calloc(count, sizeof(scene_triangle_t));
+
+    for (uint32_t i = 0; i < count; i++) {
+        const float *offsetScale = instances[i].offsetScale;
+        for (uint32_t v = 0; v < 3; v++) {
+            triangles[i].positions[v][0] = positions[v][0] * offsetScale[3] + offsetScale[0];
+            triangles[i].positions[v][1] = positions[v][1] * offsetScale[3] + offsetScale[1];
+            triangles[i].positions[v][2] = offsetScale[2];
+            triangles[i].positions[v][3] = 1.0f;
+            memcpy(triangles[i].colors[v], instances[i].color, sizeof(instances[i].color));
+        }
+    }
+
+    free(instances);
+
+    *countOut = count;
+    return triangles;
+}
+
+// Returns RGBA pixels with opaque alpha, or NULL if the file does not exist or is not a valid image.
+uint8_t* ReadPPM(const char *path, VkExtent2D *extentOut) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+
+    // Texture loader threads read these too, so a bad file is reported and skipped rather than fatal.
+    uint32_t width, height, maxValue;
+    if (fscanf(f, "P6 %u %u %u", &width, &height, &maxValue) != 3 || maxValue != 255 || width == 0 || height == 0 || fgetc(f) == EOF) {
+        fprintf(stderr, "%s is not an 8-bit binary PPM image.\n", path);
+        fclose(f);
+        return NULL;
+    }
+
+    size_t pixelCount = (size_t)width * height;
+    uint8_t *pixels = malloc(pixelCount * 4);
+    for (size_t i = 0; i < pixelCount; i++) {
+        if (fread(&pixels[i * 4], 1, 3, f) != 3) {
+            fprintf(stderr, "%s is truncated.\n", path);
+            free(pixels);
+            fclose(f);
+            return NULL;
+        }
+        pixels[i * 4 + 3] = 255;
+    }
+
+    fclose(f);
+
+    extentOut->width = width;
+    extentOut->height = height;
+    return pixels;
+}
+
+VkExtent2D MipExtent(VkExtent2D extent, uint32_t level) {
+    return (VkExtent2D){ .width = MAX(extent.width >> level, 1), .height = MAX(extent.height >> level, 1) };
+}
+
+uint32_t MipLevelCount(VkExtent2D extent) {
+    uint32_t levels = 1;
+    while ((MAX(extent.width, extent.height) >> levels) > 0 && levels < MAX_MIP_LEVELS) {
+        levels++;
+    }
+
+    return levels;
+}
+
+// Box filters RGBA8 pixels down to 1x1. On odd sizes the last row or column is filtered with itself.
+mip_chain_t BuildMipChain(const uint8_t *pixels, VkExtent2D extent) {
+    mip_chain_t mips = {
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .extent = extent,
+        .levelCount = MipLevelCount(extent),
+    };
+
+    for (uint32_t level = 0; level < mips.levelCount; level++) {
+        VkExtent2D levelExtent = MipExtent(extent, level);
+        mips.offsets[level] = mips.size;
+        mips.size += (size_t)levelExtent.width * levelExtent.height * 4;
+    }
+
+    mips.data = malloc(mips.size);
+    memcpy(mips.data, pixels, (size_t)extent.width * extent.height * 4);
+
+    for (uint32_t level = 1; level < mips.levelCount; level++) {
+        VkExtent2D source = MipExtent(extent, level - 1);
+        VkExtent2D destination = MipExtent(extent, level);
+        const uint8_t *in = mips.data + mips.offsets[level - 1];
+        uint8_t *out = mips.data + mips.offsets[level];
+
+        for (uint32_t y = 0; y < destination.height; y++) {
+            uint32_t y0 = MIN(y * 2, source.height - 1);
+            uint32_t y1 = MIN(y * 2 + 1, source.height - 1);
+            for (uint32_t x = 0; x < destination.width; x++) {
+                uint32_t x0 = MIN(x * 2, source.width - 1);
+                uint32_t x1 = MIN(x * 2 + 1, source.width - 1);
+                for (uint32_t c = 0; c < 4; c++) {
+                    uint32_t sum = in[(y0 * source.width + x0) * 4 + c] + in[(y0 * source.width + x1) * 4 + c] +
+                                   in[(y1 * source.width + x0) * 4 + c] + in[(y1 * source.width + x1) * 4 + c];
+                    out[(y * destination.width + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+
+    return mips;
+}
+
+void FreeMipChain(mip_chain_t *mips) {
+    free(mips->data);
+    mips->data = NULL;
+}
+
+typedef enum texture_family {
+    TEXTURE_UNCOMPRESSED,
+    TEXTURE_BC,
+    TEXTURE_ETC2,
+    TEXTURE_ASTC,
+} texture_family_t;
+
+// Decodes one 4x4 block to RGBA8 texels in row-major order.
+typedef void (*block_decoder_t)(const uint8_t *block, uint8_t *texels);
+
+typedef struct texture_format_info {
+    VkFormat format;
+    texture_family_t family;
+    uint32_t blockBytes;
+    // RGBA8 format of the decoder's output, or VK_FORMAT_UNDEFINED if the family cannot be decoded on the CPU.
+    VkFormat decodedFormat;
+    block_decoder_t decode;
+} texture_format_info_t;
+
+void DecodeRGB565(uint16_t color, uint8_t *rgba) {
+    uint32_t r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    rgba[0] = (uint8_t)((r << 3) | (r >> 2));
+    rgba[1] = (uint8_t)((g << 2) | (g >> 4));
+    rgba[2] = (uint8_t)((b << 3) | (b >> 2));
+    rgba[3] = 255;
+}
+
+// The color half of BC1 and BC3 blocks. Only BC1 has the three color mode with transparent black.
+void DecodeBCColors(const uint8_t *block, uint8_t *texels, bool threeColorMode) {
+    uint16_t c0 = block[0] | (block[1] << 8);
+    uint16_t c1 = block[2] | (block[3] << 8);
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+
+    uint8_t palette[4][4];
+    DecodeRGB565(c0, palette[0]);
+    DecodeRGB565(c1, palette[1]);
+    for (uint32_t c = 0; c < 4; c++) {
+        if (c0 > c1 || !threeColorMode) {
+            palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c] + 1) / 3);
+            palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+        } else {
+            palette[2][c] = (uint8_t)((palette[0][c] + palette[1][c] + 1) / 2);
+            palette[3][c] = 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < 16; i++) {
+        memcpy(&texels[i * 4], palette[(indices >> (2 * i)) & 3], 4);
+    }
+}
+
+void DecodeBC1Block(const uint8_t *block, uint8_t *texels) {
+    DecodeBCColors(block, texels, true);
+}
+
+// BC1 without alpha samples the three color mode's transparent black as opaque black.
+void DecodeBC1RGBBlock(const uint8_t *block, uint8_t *texels) {
+    DecodeBCColors(block, texels, true);
+    for (uint32_t i = 0; i < 16; i++) {
+        texels[i * 4 + 3] = 255;
+    }
+}
+
+void DecodeBC3Block(const uint8_t *block, uint8_t *texels) {
+    DecodeBCColors(block + 8, texels, false);
+
+    uint32_t a0 = block[0], a1 = block[1];
+    uint8_t alphas[8] = { (uint8_t)a0, (uint8_t)a1 };
+    for (uint32_t i = 1; i < 7; i++) {
+        alphas[i + 1] = a0 > a1 ? (uint8_t)(((7 - i) * a0 + i * a1 + 3) / 7)
+                      : i < 5  ? (uint8_t)(((5 - i) * a0 + i * a1 + 2) / 5)
+                      : (i == 5 ? 0 : 255);
+    }
+
+    uint64_t indices = 0;
+    for (uint32_t i = 0; i < 6; i++) {
+        indices |= (uint64_t)block[2 + i] << (8 * i);
+    }
+
+    for (uint32_t i = 0; i < 16; i++) {
+        texels[i * 4 + 3] = alphas[(indices >> (3 * i)) & 7];
+    }
+}
+
+uint8_t ExtendBits(uint32_t value, uint32_t bits) {
+    return (uint8_t)((value << (8 - bits)) | (value >> (2 * bits - 8)));
+}
+
+uint8_t ClampByte(int32_t value) {
+    return (uint8_t)MIN(MAX(value, 0), 255);
+}
+
+// ETC1 modes, and the T, H and planar modes ETC2 encodes in the otherwise overflowing differential colors.
+// ETC2 texels are stored column-major; they are written out row-major like every other decoder's.
+void DecodeETC2ColorBlock(const uint8_t *block, uint8_t *texels) {
+    static const int32_t modifiers[8][4] = {
+        { 2, 8, -2, -8 }, { 5, 17, -5, -17 }, { 9, 29, -9, -29 }, { 13, 42, -13, -42 },
+        { 18, 60, -18, -60 }, { 24, 80, -24, -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 },
+    };
+    static const int32_t distances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+    uint32_t indices = ((uint32_t)block[4] << 24) | (block[5] << 16) | (block[6] << 8) | block[7];
+    uint8_t base[2][3];
+    bool individual = !(block[3] & 2);
+
+    if (!individual) {
+        int32_t r = (block[0] >> 3) + ((int32_t)((uint32_t)(block[0] & 7) << 29) >> 29);
+        int32_t g = (block[1] >> 3) + ((int32_t)((uint32_t)(block[1] & 7) << 29) >> 29);
+        int32_t b = (block[2] >> 3) + ((int32_t)((uint32_t)(block[2] & 7) << 29) >> 29);
+
+        if (r < 0 || r > 31 || g < 0 || g > 31) {
+            int32_t paint[4][3];
+            int32_t distance;
+
+            if (r < 0 || r > 31) {
+                // T mode.
+                base[0][0] = ExtendBits((((block[0] >> 3) & 3) << 2) | (block[0] & 3), 4);
+                base[0][1] = ExtendBits(block[1] >> 4, 4);
+                base[0][2] = ExtendBits(block[1] & 15, 4);
+                base[1][0] = ExtendBits(block[2] >> 4, 4);
+                base[1][1] = ExtendBits(block[2] & 15, 4);
+                base[1][2] = ExtendBits(block[3] >> 4, 4);
+                distance = distances[(((block[3] >> 2) & 3) << 1) | (block[3] & 1)];
+                for (uint32_t c = 0; c < 3; c++) {
+                    paint[0][c] = base[0][c];
+                    paint[1][c] = base[1][c] + distance;
+                    paint[2][c] = base[1][c];
+                    paint[3][c] = base[1][c] - distance;
+                }
+            } else {
+                // H mode.
+                base[0][0] = ExtendBits((block[0] >> 3) & 15, 4);
+                base[0][1] = ExtendBits(((block[0] & 7) << 1) | ((block[1] >> 4) & 1), 4);
+                base[0][2] = ExtendBits((block[1] & 8) | ((block[1] & 3) << 1) | (block[2] >> 7), 4);
+                base[1][0] = ExtendBits((block[2] >> 3) & 15, 4);
+                base[1][1] = ExtendBits(((block[2] & 7) << 1) | (block[3] >> 7), 4);
+                base[1][2] = ExtendBits((block[3] >> 3) & 15, 4);
+                uint32_t first = (base[0][0] << 16) | (base[0][1] << 8) | base[0][2];
+                uint32_t second = (base[1][0] << 16) | (base[1][1] << 8) | base[1][2];
+                distance = distances[(block[3] & 4) | ((block[3] & 1) << 1) | (first >= second)];
+                for (uint32_t c = 0; c < 3; c++) {
+                    paint[0][c] = base[0][c] + distance;
+                    paint[1][c] = base[0][c] - distance;
+                    paint[2][c] = base[1][c] + distance;
+                    paint[3][c] = base[1][c] - distance;
+                }
+            }
+
+            for (uint32_t x = 0; x < 4; x++) {
+                for (uint32_t y = 0; y < 4; y++) {
+                    uint32_t bit = x * 4 + y;
+                    uint32_t index = ((indices >> (bit + 15)) & 2) | ((indices >> bit) & 1);
+                    uint8_t *texel = &texels[(y * 4 + x) * 4];
+                    for (uint32_t c = 0; c < 3; c++) {
+                        texel[c] = ClampByte(paint[index][c]);
+                    }
+                    texel[3] = 255;
+                }
+            }
+            return;
+        }
+
+        if (b < 0 || b > 31) {
+            // Planar mode: a gradient from the origin color towards the horizontal and vertical colors.
+            int32_t o[3] = {
+                ExtendBits((block[0] >> 1) & 63, 6),
+                ExtendBits(((block[0] & 1) << 6) | ((block[1] >> 1) & 63), 7),
+                ExtendBits(((block[1] & 1) << 5) | (block[2] & 24) | ((block[2] & 3) << 1) | (block[3] >> 7), 6),
+            };
+            int32_t h[3] = {
+                ExtendBits(((block[3] >> 1) & 62) | (block[3] & 1), 6),
+                ExtendBits(block[4] >> 1, 7),
+                ExtendBits(((block[4] & 1) << 5) | (block[5] >> 3), 6),
+            };
+            int32_t v[3] = {
+                ExtendBits(((block[5] & 7) << 3) | (block[6] >> 5), 6),
+                ExtendBits(((block[6] & 31) << 2) | (block[7] >> 6), 7),
+                ExtendBits(block[7] & 63, 6),
+            };
+
+            for (int32_t y = 0; y < 4; y++) {
+                for (int32_t x = 0; x < 4; x++) {
+                    uint8_t *texel = &texels[(y * 4 + x) * 4];
+                    for (uint32_t c = 0; c < 3; c++) {
+                        texel[c] = ClampByte((x * (h[c] - o[c]) + y * (v[c] - o[c]) + 4 * o[c] + 2) >> 2);
+                    }
+                    texel[3] = 255;
+                }
+            }
+            return;
+        }
+
+        base[0][0] = ExtendBits(block[0] >> 3, 5);
+        base[0][1] = ExtendBits(block[1] >> 3, 5);
+        base[0][2] = ExtendBits(block[2] >> 3, 5);
+        base[1][0] = ExtendBits((uint32_t)r, 5);
+        base[1][1] = ExtendBits((uint32_t)g, 5);
+        base[1][2] = ExtendBits((uint32_t)b, 5);
+    } else {
+        for (uint32_t c = 0; c < 3; c++) {
+            base[0][c] = ExtendBits(block[c] >> 4, 4);
+            base[1][c] = ExtendBits(block[c] & 15, 4);
+        }
+    }
+
+    // Two 2x4 subblocks, side by side or, when flipped, one above the other.
+    uint32_t tables[2] = { block[3] >> 5, (block[3] >> 2) & 7 };
+    bool flip = block[3] & 1;
+
+    for (uint32_t x = 0; x < 4; x++) {
+        for (uint32_t y = 0; y < 4; y++) {
+            uint32_t subblock = flip ? y >= 2 : x >= 2;
+            uint32_t bit = x * 4 + y;
+            uint32_t index = ((indices >> (bit + 15)) & 2) | ((indices >> bit) & 1);
+            int32_t modifier = modifiers[tables[subblock]][index];
+            uint8_t *texel = &texels[(y * 4 + x) * 4];
+            for (uint32_t c = 0; c < 3; c++) {
+                texel[c] = ClampByte(base[subblock][c] + modifier);
+            }
+            texel[3] = 255;
+        }
+    }
+}
+
+void DecodeETC2RGBBlock(const uint8_t *block, uint8_t *texels) {
+    DecodeETC2ColorBlock(block, texels);
+}
+
+// An EAC alpha block followed by an ETC2 color block.
+void DecodeETC2RGBABlock(const uint8_t *block, uint8_t *texels) {
+    static const int32_t modifiers[16][8] = {
+        { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 }, { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+        { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 }, { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+        { -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 }, { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+        { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 }, { -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 },
+    };
+
+    DecodeETC2ColorBlock(block + 8, texels);
+
+    int32_t base = block[0];
+    int32_t multiplier = block[1] >> 4;
+    const int32_t *table = modifiers[block[1] & 15];
+    uint64_t indices = 0;
+    for (uint32_t i = 2; i < 8; i++) {
+        indices = (indices << 8) | block[i];
+    }
+
+    for (uint32_t x = 0; x < 4; x++) {
+        for (uint32_t y = 0; y < 4; y++) {
+            uint32_t index = (indices >> (45 - 3 * (x * 4 + y))) & 7;
+            texels[(y * 4 + x) * 4 + 3] = ClampByte(base + table[index] * multiplier);
+        }
+    }
+}
+
+static const texture_format_info_t textureFormats[] = {
+    { VK_FORMAT_R8G8B8A8_UNORM, TEXTURE_UNCOMPRESSED, 4, VK_FORMAT_R8G8B8A8_UNORM, NULL },
+    { VK_FORMAT_R8G8B8A8_SRGB, TEXTURE_UNCOMPRESSED, 4, VK_FORMAT_R8G8B8A8_SRGB, NULL },
+    { VK_FORMAT_BC1_RGB_UNORM_BLOCK, TEXTURE_BC, 8, VK_FORMAT_R8G8B8A8_UNORM, DecodeBC1RGBBlock },
+    { VK_FORMAT_BC1_RGB_SRGB_BLOCK, TEXTURE_BC, 8, VK_FORMAT_R8G8B8A8_SRGB, DecodeBC1RGBBlock },
+    { VK_FORMAT_BC1_RGBA_UNORM_BLOCK, TEXTURE_BC, 8, VK_FORMAT_R8G8B8A8_UNORM, DecodeBC1Block },
+    { VK_FORMAT_BC1_RGBA_SRGB_BLOCK, TEXTURE_BC, 8, VK_FORMAT_R8G8B8A8_SRGB, DecodeBC1Block },
+    { VK_FORMAT_BC3_UNORM_BLOCK, TEXTURE_BC, 16, VK_FORMAT_R8G8B8A8_UNORM, DecodeBC3Block },
+    { VK_FORMAT_BC3_SRGB_BLOCK, TEXTURE_BC, 16, VK_FORMAT_R8G8B8A8_SRGB, DecodeBC3Block },
+    { VK_FORMAT_BC7_UNORM_BLOCK, TEXTURE_BC, 16, VK_FORMAT_UNDEFINED, NULL },
+    { VK_FORMAT_BC7_SRGB_BLOCK, TEXTURE_BC, 16, VK_FORMAT_UNDEFINED, NULL },
+    { VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, TEXTURE_ETC2, 8, VK_FORMAT_R8G8B8A8_UNORM, DecodeETC2RGBBlock },
+    { VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK, TEXTURE_ETC2, 8, VK_FORMAT_R8G8B8A8_SRGB, DecodeETC2RGBBlock },
+    { VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, TEXTURE_ETC2, 16, VK_FORMAT_R8G8B8A8_UNORM, DecodeETC2RGBABlock },
+    { VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK, TEXTURE_ETC2, 16, VK_FORMAT_R8G8B8A8_SRGB, DecodeETC2RGBABlock },
+    { VK_FORMAT_ASTC_4x4_UNORM_BLOCK, TEXTURE_ASTC, 16, VK_FORMAT_UNDEFINED, NULL },
+    { VK_FORMAT_ASTC_4x4_SRGB_BLOCK, TEXTURE_ASTC, 16, VK_FORMAT_UNDEFINED, NULL },
+};
+
+const texture_format_info_t* FindTextureFormat(VkFormat format) {
+    for (uint32_t i = 0; i < sizeof(textureFormats) / sizeof(textureFormats[0]); i++) {
+        if (textureFormats[i].format == format) {
+            return &textureFormats[i];
+        }
+    }
+
+    return NULL;
+}
+
+bool SamplesTextureFamily(const texture_compression_t *compression, texture_family_t family) {
+    switch (family) {
+        case TEXTURE_BC:
+            return compression->bc;
+        case TEXTURE_ETC2:
+            return compression->etc2;
+        case TEXTURE_ASTC:
+            return compression->astc;
+        default:
+            return true;
+    }
+}
+
+size_t TextureLevelSize(const texture_format_info_t *info, VkExtent2D extent) {
+    if (info->family == TEXTURE_UNCOMPRESSED) {
+        return (size_t)extent.width * extent.height * info->blockBytes;
+    }
+
+    return (size_t)((extent.width + 3) / 4) * ((extent.height + 3) / 4) * info->blockBytes;
+}
+
+// Decodes a level of 4x4 blocks to RGBA8, dropping the texels past the edges of partial blocks.
+void DecodeTextureLevel(const texture_format_info_t *info, const uint8_t *blocks, VkExtent2D extent, uint8_t *pixels) {
+    uint32_t blocksX = (extent.width + 3) / 4;
+    uint32_t blocksY = (extent.height + 3) / 4;
+    uint8_t texels[16 * 4];
+
+    for (uint32_t by = 0; by < blocksY; by++) {
+        for (uint32_t bx = 0; bx < blocksX; bx++) {
+            info->decode(blocks + ((size_t)by * blocksX + bx) * info->blockBytes, texels);
+
+            for (uint32_t y = 0; y < 4 && by * 4 + y < extent.height; y++) {
+                uint32_t width = MIN(4, extent.width - bx * 4);
+                memcpy(&pixels[(((size_t)by * 4 + y) * extent.width + bx * 4) * 4], &texels[y * 16], width * 4);
+            }
+        }
+    }
+}
+
+uint32_t ReadU32(const uint8_t *bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+uint64_t ReadU64(const uint8_t *bytes) {
+    return ReadU32(bytes) | ((uint64_t)ReadU32(bytes + 4) << 32);
+}
+
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_INDEX_ENTRY_SIZE 24
+
+// Loads a 2D KTX2 texture without supercompression. Formats the device cannot sample are decoded to RGBA8 when
+// there is a CPU decoder for them. Otherwise, or when the file is malformed, the problem is reported and false returned.
+bool ReadKTX2(const char *path, const texture_compression_t *compression, mip_chain_t *mipsOut, bool *decodedOut) {
+    static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *file = malloc(MAX(fileSize, 1));
+    bool complete = fread(file, 1, fileSize, f) == (size_t)fileSize;
+    fclose(f);
+
+    if (!complete || fileSize < KTX2_HEADER_SIZE || memcmp(file, identifier, sizeof(identifier)) != 0) {
+        fprintf(stderr, "%s is not a KTX2 file.\n", path);
+        free(file);
+        return false;
+    }
+
+    VkFormat format = (VkFormat)ReadU32(file + 12);
+    VkExtent2D extent = { .width = ReadU32(file + 20), .height = ReadU32(file + 24) };
+    uint32_t depth = ReadU32(file + 28), layerCount = ReadU32(file + 32), faceCount = ReadU32(file + 36);
+    uint32_t levelCount = MAX(ReadU32(file + 40), 1);
+    uint32_t supercompression = ReadU32(file + 44);
+
+    if (extent.width == 0 || extent.height == 0 || depth > 1 || layerCount > 1 || faceCount != 1 || levelCount > MAX_MIP_LEVELS ||
+        KTX2_HEADER_SIZE + (size_t)levelCount * KTX2_LEVEL_INDEX_ENTRY_SIZE > (size_t)fileSize) {
+        fprintf(stderr, "%s is not a single 2D KTX2 texture.\n", path);
+        free(file);
+        return false;
+    }
+
+    const texture_format_info_t *info = FindTextureFormat(format);
+    if (!info || supercompression != 0) {
+        fprintf(stderr, "%s uses format %d with supercompression %u, which cannot be loaded.\n", path, format, supercompression);
+        free(file);
+        return false;
+    }
+
+    bool decode = !SamplesTextureFamily(compression, info->family);
+    if (decode && !info->decode) {
+        fprintf(stderr, "%s uses format %d, which the device cannot sample and which has no CPU decoder.\n", path, format);
+        free(file);
+        return false;
+    }
+
+    mip_chain_t mips = {
+        .format = decode ? info->decodedFormat : format,
+        .extent = extent,
+        .levelCount = levelCount,
+    };
+
+    for (uint32_t level = 0; level < levelCount; level++) {
+        mips.offsets[level] = mips.size;
+        mips.size += decode ? (size_t)MipExtent(extent, level).width * MipExtent(extent, level).height * 4 : TextureLevelSize(info, MipExtent(extent, level));
+    }
+
+    mips.data = malloc(mips.size);
+
+    // The level index lists level 0 first, although the file stores the smallest level first.
+    for (uint32_t level = 0; level < levelCount; level++) {
+        const uint8_t *entry = file + KTX2_HEADER_SIZE + level * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        uint64_t offset = ReadU64(entry);
+        uint64_t length = ReadU64(entry + 8);
+        VkExtent2D levelExtent = MipExtent(extent, level);
+
+        if (length != TextureLevelSize(info, levelExtent) || offset > (uint64_t)fileSize || length > (uint64_t)fileSize - offset) {
+            fprintf(stderr, "%s has a truncated or malformed mip level %u.\n", path, level);
+            FreeMipChain(&mips);
+            free(file);
+            return false;
+        }
+
+        if (decode) {
+            DecodeTextureLevel(info, file + offset, levelExtent, mips.data + mips.offsets[level]);
+        } else {
+            memcpy(mips.data + mips.offsets[level], file + offset, length);
+        }
+    }
+
+    free(file);
+
+    // A lone RGBA8 level gets the rest of its chain filtered here, like a PPM image.
+    if (levelCount == 1 && mips.format == info->decodedFormat && MipLevelCount(extent) > 1) {
+        mip_chain_t chain = BuildMipChain(mips.data, extent);
+        chain.format = mips.format;
+        FreeMipChain(&mips);
+        mips = chain;
+    }
+
+    *mipsOut = mips;
+    *decodedOut = decode;
+    return true;
+}
+
+bool HasExtension(const char *name, const char *extension) {
+    size_t length = strlen(name), extensionLength = strlen(extension);
+    return length > extensionLength && strcmp(name + length - extensionLength, extension) == 0;
+}
+
+// Loads an image file with every mip level, or returns false when it cannot be read.
+bool LoadImageFile(const char *path, const texture_compression_t *compression, mip_chain_t *mipsOut, bool *decodedOut) {
+    *decodedOut = false;
+    if (HasExtension(path, ".ktx2")) {
+        return ReadKTX2(path, compression, mipsOut, decodedOut);
+    }
+
+    VkExtent2D extent;
+    uint8_t *pixels = ReadPPM(path, &extent);
+    if (!pixels) {
+        return false;
+    }
+
+    *mipsOut = BuildMipChain(pixels, extent);
+    free(pixels);
+    return true;
+}
+
+bool IsImageFile(const char *name) {
+    return HasExtension(name, ".ppm") || HasExtension(name, ".ktx2");
+}
+
+int CompareStrings(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Image files of the directory in name order, so materials map to the same files on every run.
+char** ListImageFiles(const char *directory, uint32_t *countOut) {
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        FatalError("Failed to open texture directory %s.", directory);
+    }
+
+    char **paths = NULL;
+    uint32_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (!IsImageFile(entry->d_name)) {
+            continue;
+        }
+
+        size_t length = strlen(directory) + strlen(entry->d_name) + 2;
+        paths = realloc(paths, (count + 1) * sizeof(char*));
+        paths[count] = malloc(length);
+        snprintf(paths[count], length, "%s/%s", directory, entry->d_name);
+        count++;
+    }
+
+    closedir(dir);
+    qsort(paths, count, sizeof(char*), CompareStrings);
+
+    *countOut = count;
+    return paths;
+}
+
+// Loader thread: takes the next queued file until none are left or the streamer stops.
+int LoadStreamedTextures(void *data) {
+    texture_streamer_t *streamer = data;
+
+    for (;;) {
+        SDL_LockMutex(streamer->mutex);
+        if (streamer->stopping || streamer->nextToLoad == streamer->textureCount) {
+            SDL_UnlockMutex(streamer->mutex);
+            return 0;
+        }
+        streamed_texture_t *streamed = &streamer->textures[streamer->nextToLoad++];
+        SDL_UnlockMutex(streamer->mutex);
+
+        mip_chain_t mips = {};
+        bool decoded;
+        bool loaded = LoadImageFile(streamed->path, &streamer->compression, &mips, &decoded);
+        if (!loaded) {
+            fprintf(stderr, "Failed to load %s; its material keeps the placeholder.\n", streamed->path);
+        }
+
+        SDL_LockMutex(streamer->mutex);
+        streamed->mips = mips;
+        streamed->residentLevel = mips.levelCount;
+        streamed->state = loaded ? STREAM_LOADED : STREAM_FAILED;
+        streamer->decodedCount += loaded && decoded;
+        SDL_UnlockMutex(streamer->mutex);
+    }
+}
+
+void StartTextureStreaming(renderer_t *renderer, const char *directory, VkDeviceSize budget) {
+    texture_streamer_t *streamer = calloc(1, sizeof(texture_streamer_t));
+    renderer->streamer = streamer;
+    streamer->budget = budget;
+    streamer->compression = renderer->compression;
+
+    char **paths = ListImageFiles(directory, &streamer->textureCount);
+    if (streamer->textureCount == 0) {
+        FatalError("%s contains no PPM or KTX2 images.", directory);
+    }
+
+    // Mid grey, so materials whose texture has not arrived yet keep their instance color.
+    const uint8_t grey[4] = { 128, 128, 128, 255 };
+    streamer->placeholder = CreateTexture(renderer, (VkExtent2D){ .width = 1, .height = 1 }, VK_FORMAT_R8G8B8A8_UNORM, 1);
+    UploadTexture(renderer, &streamer->placeholder, grey);
+
+    renderer->materialCount = streamer->textureCount;
+    renderer->materialSlots = calloc(streamer->textureCount, sizeof(uint32_t));
+    streamer->textures = calloc(streamer->textureCount, sizeof(streamed_texture_t));
+
+    // Each material owns its slot for good; streaming only repoints the slot at larger images.
+    for (uint32_t i = 0; i < streamer->textureCount; i++) {
+        streamed_texture_t *streamed = &streamer->textures[i];
+        streamed->path = paths[i];
+        AddBindlessTexture(renderer, &streamer->placeholder);
+        streamed->bindlessIndex = streamer->placeholder.bindlessIndex;
+        renderer->materialSlots[i] = streamed->bindlessIndex;
+    }
+    free(paths);
+
+    VkCommandPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .queueFamilyIndex = renderer->queueFamilyIndices.transferFamily,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+    };
+
+    if (vkCreateCommandPool(renderer->logicalDevice, &poolInfo, NULL, &streamer->commandPool) != VK_SUCCESS) {
+        FatalError("Failed to create texture streaming command pool.");
+    }
+
+    VkCommandBufferAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = streamer->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    if (vkAllocateCommandBuffers(renderer->logicalDevice, &allocateInfo, &streamer->commandBuffer) != VK_SUCCESS) {
+        FatalError("Failed to allocate texture streaming command buffer.");
+    }
+
+    streamer->fence = CreateFence(renderer, 0);
+
+    streamer->mutex = SDL_CreateMutex();
+    streamer->loaderCount = (uint32_t)MIN(MAX(SDL_GetCPUCount() - 1, 1), 4);
+    streamer->loaders = calloc(streamer->loaderCount, sizeof(SDL_Thread*));
+    for (uint32_t i = 0; i < streamer->loaderCount; i++) {
+        streamer->loaders[i] = SDL_CreateThread(LoadStreamedTextures, "texture loader", streamer);
+        if (!streamer->loaders[i]) {
+            FatalError("Failed to create texture loader thread: %s", SDL_GetError());
+        }
+    }
+
+    printf("Streaming %u texture(s) from %s with %u loader thread(s) and a %.0f MiB budget, uploading on queue family %u.\n",
+           streamer->textureCount, directory, streamer->loaderCount, (double)budget / (1024.0 * 1024.0), renderer->queueFamilyIndices.transferFamily);
+    printf("Compressed formats sampled natively: BC %s, ETC2 %s, ASTC %s.\n",
+           streamer->compression.bc ? "yes" : "no", streamer->compression.etc2 ? "yes" : "no", streamer->compression.astc ? "yes" : "no");
+}
+
+// The mip tail is the finest level no larger than STREAM_TAIL_SIZE, or the last level.
+uint32_t MipTailLevel(const mip_chain_t *mips) {
+    for (uint32_t level = 0; level < mips->levelCount; level++) {
+        VkExtent2D extent = MipExtent(mips->extent, level);
+        if (MAX(extent.width, extent.height) <= STREAM_TAIL_SIZE) {
+            return level;
+        }
+    }
+
+    return mips->levelCount - 1;
+}
+
+// Swaps in the textures of the last transfer once it has completed. Frames in flight may still sample the textures
+// they replace, so those are retired rather than destroyed.
+void InstallStreamedTextures(renderer_t *renderer) {
+    texture_streamer_t *streamer = renderer->streamer;
+
+    for (uint32_t i = 0; i < streamer->pendingCount; i++) {
+        stream_upload_t *upload = &streamer->pending[i];
+        streamed_texture_t *streamed = &streamer->textures[upload->textureIndex];
+
+        if (streamed->texture.image != VK_NULL_HANDLE) {
+            if (streamer->retiredCount == streamer->retiredCapacity) {
+                streamer->retiredCapacity = MAX(streamer->retiredCapacity * 2, STREAM_UPLOADS_PER_UPDATE * BINDLESS_MAX_SETS);
+                streamer->retired = realloc(streamer->retired, streamer->retiredCapacity * sizeof(stream_retired_t));
+            }
+            streamer->retired[streamer->retiredCount++] = (stream_retired_t){
+                .texture = streamed->texture,
+                .pendingSets = (uint8_t)((1u << renderer->bindlessTable.setCount) - 1),
+            };
+        }
+
+        streamed->texture = upload->texture;
+        streamed->texture.bindlessIndex = streamed->bindlessIndex;
+        streamed->residentLevel = upload->level;
+        ReplaceBindlessTexture(renderer, streamed->bindlessIndex, streamed->texture.view);
+
+        // Fully resident: the host copy is no longer needed.
+        if (streamed->residentLevel == 0) {
+            FreeMipChain(&streamed->mips);
+        }
+    }
+
+    streamer->pendingCount = 0;
+    vkResetFences(renderer->logicalDevice, 1, &streamer->fence);
+}
+
+// Picks the loaded textures to grow by a level, round-robin, and returns how many were picked.
+uint32_t ChooseStreamUploads(texture_streamer_t *streamer) {
+    uint32_t count = 0;
+
+    SDL_LockMutex(streamer->mutex);
+    for (uint32_t n = 0; n < streamer->textureCount && count < STREAM_UPLOADS_PER_UPDATE; n++) {
+        uint32_t index = (streamer->nextToGrow + n) % streamer->textureCount;
+        streamed_texture_t *streamed = &streamer->textures[index];
+        if (streamed->state != STREAM_LOADED || streamed->residentLevel == 0) {
+            continue;
+        }
+
+        if (streamed->residentLevel == streamed->mips.levelCount) {
+            // Tails are always resident, whatever the budget.
+            streamer->pending[count].level = MipTailLevel(&streamed->mips);
+        } else {
+            uint32_t level = streamed->residentLevel - 1;
+            VkDeviceSize bytes = streamed->mips.size - streamed->mips.offsets[level];
+            if (streamer->residentBytes - streamed->residentBytes + bytes > streamer->budget) {
+                continue;
+            }
+            streamer->pending[count].level = level;
+        }
+
+        streamer->pending[count].textureIndex = index;
+        streamer->nextToGrow = index + 1;
+        count++;
+    }
+    SDL_UnlockMutex(streamer->mutex);
+
+    return count;
+}
+
+// Brings one copy of the bindless table up to date and destroys the textures no copy points at any more.
+void FlushStreamedTextures(renderer_t *renderer, uint32_t set) {
+    texture_streamer_t *streamer = renderer->streamer;
+    FlushBindlessSet(renderer, set);
+
+    uint32_t remaining = 0;
+    for (uint32_t i = 0; i < streamer->retiredCount; i++) {
+        stream_retired_t *retired = &streamer->retired[i];
+        retired->pendingSets &= (uint8_t)~(1u << set);
+        if (retired->pendingSets == 0) {
+            DestroyTexture(renderer, &retired->texture);
+        } else {
+            streamer->retired[remaining++] = *retired;
+        }
+    }
+    streamer->retiredCount = remaining;
+}
+
+// Called once per frame by the render thread, with the bindless set of the frame slot about to be recorded, once the
+// slot's previous frame has retired. Never waits for the transfer queue: an upload still in flight is checked again
+// next frame.
+void UpdateTextureStreaming(renderer_t *renderer, uint32_t set) {
+    texture_streamer_t *streamer = renderer->streamer;
+    if (!streamer) {
+        return;
+    }
+
+    if (streamer->pendingCount > 0 && vkGetFenceStatus(renderer->logicalDevice, streamer->fence) == VK_SUCCESS) {
+        InstallStreamedTextures(renderer);
+    }
+    FlushStreamedTextures(renderer, set);
+
+    if (streamer->pendingCount > 0) {
+        return;
+    }
+
+    uint32_t uploadCount = ChooseStreamUploads(streamer);
+    if (uploadCount == 0) {
+        return;
+    }
+
+    // Each upload holds its levels from the host copy, so the old image is never touched while frames sample it.
+    VkDeviceSize stagingSize = 0;
+    for (uint32_t i = 0; i < uploadCount; i++) {
+        const mip_chain_t *mips = &streamer->textures[streamer->pending[i].textureIndex].mips;
+        stagingSize += (mips->size - mips->offsets[streamer->pending[i].level] + 15) & ~(VkDeviceSize)15;
+    }
+
+    if (stagingSize > streamer->stagingSize) {
+        if (streamer->stagingBuffer != VK_NULL_HANDLE) {
+            vkUnmapMemory(renderer->logicalDevice, streamer->stagingMemory);
+            vkDestroyBuffer(renderer->logicalDevice, streamer->stagingBuffer, NULL);
+            vkFreeMemory(renderer->logicalDevice, streamer->stagingMemory, NULL);
+        }
+
+        streamer->stagingSize = MAX(stagingSize, (VkDeviceSize)16 << 20);
+        streamer->stagingBuffer = CreateBuffer(renderer, streamer->stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &streamer->stagingMemory);
+        if (vkMapMemory(renderer->logicalDevice, streamer->stagingMemory, 0, VK_WHOLE_SIZE, 0, &streamer->stagingData) != VK_SUCCESS) {
+            FatalError("Failed to map texture staging buffer.");
+        }
+    }
+
+    VkCommandBuffer commandBuffer = streamer->commandBuffer;
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        FatalError("Failed to begin recording command buffer.");
+    }
+
+    VkDeviceSize stagingOffset = 0;
+    for (uint32_t i = 0; i < uploadCount; i++) {
+        stream_upload_t *upload = &streamer->pending[i];
+        streamed_texture_t *streamed = &streamer->textures[upload->textureIndex];
+        const mip_chain_t *mips = &streamed->mips;
+        uint32_t levelCount = mips->levelCount - upload->level;
+        size_t size = mips->size - mips->offsets[upload->level];
+
+        upload->texture = CreateTexture(renderer, MipExtent(mips->extent, upload->level), mips->format, levelCount);
+        memcpy((uint8_t*)streamer->stagingData + stagingOffset, mips->data + mips->offsets[upload->level], size);
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(renderer->logicalDevice, upload->texture.image, &requirements);
+        upload->bytes = requirements.size;
+        streamer->residentBytes += upload->bytes - streamed->residentBytes;
+        streamed->residentBytes = upload->bytes;
+
+        VkBufferImageCopy regions[MAX_MIP_LEVELS];
+        for (uint32_t l = 0; l < levelCount; l++) {
+            VkExtent2D extent = MipExtent(mips->extent, upload->level + l);
+            regions[l] = (VkBufferImageCopy){
+                .bufferOffset = stagingOffset + mips->offsets[upload->level + l] - mips->offsets[upload->level],
+                .imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = l, .baseArrayLayer = 0, .layerCount = 1 },
+                .imageExtent = { .width = extent.width, .height = extent.height, .depth = 1 },
+            };
+        }
+
+        TransitionImageLevels(commandBuffer, upload->texture.image, VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount,
+                              VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdCopyBufferToImage(commandBuffer, streamer->stagingBuffer, upload->texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levelCount, regions);
+        // The graphics queue only samples the image after the fence has been seen, so nothing waits on this stage.
+        TransitionImageLevels(commandBuffer, upload->texture.image, VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount,
+                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+
+        stagingOffset += (size + 15) & ~(VkDeviceSize)15;
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        FatalError("Failed to record command buffer.");
+    }
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer,
+    };
+
+    if (vkQueueSubmit(renderer->transferQueue, 1, &submitInfo, streamer->fence) != VK_SUCCESS) {
+        FatalError("Failed to submit texture uploads.");
+    }
+
+    streamer->pendingCount = uploadCount;
+}
+
+// Called with the device idle.
+void StopTextureStreaming(renderer_t *renderer) {
+    texture_streamer_t *streamer = renderer->streamer;
+    if (!streamer) {
+        return;
+    }
+
+    SDL_LockMutex(streamer->mutex);
+    streamer->stopping = true;
+    SDL_UnlockMutex(streamer->mutex);
+
+    for (uint32_t i = 0; i < streamer->loaderCount; i++) {
+        SDL_WaitThread(streamer->loaders[i], NULL);
+    }
+
+    uint32_t residentCount = 0;
+    for (uint32_t i = 0; i < streamer->pendingCount; i++) {
+        DestroyTexture(renderer, &streamer->pending[i].texture);
+    }
+
+    for (uint32_t i = 0; i < streamer->textureCount; i++) {
+        streamed_texture_t *streamed = &streamer->textures[i];
+        residentCount += streamed->state == STREAM_LOADED && streamed->residentLevel == 0;
+        if (streamed->texture.image != VK_NULL_HANDLE) {
+            DestroyTexture(renderer, &streamed->texture);
+        }
+        FreeMipChain(&streamed->mips);
+        free(streamed->path);
+    }
+
+    for (uint32_t i = 0; i < streamer->retiredCount; i++) {
+        DestroyTexture(renderer, &streamer->retired[i].texture);
+    }
+    free(streamer->retired);
+
+    printf("Texture streaming: %u of %u texture(s) fully resident, %u decoded on the CPU, %.1f of %.1f MiB budget used.\n",
+           residentCount, streamer->textureCount, streamer->decodedCount, (double)streamer->residentBytes / (1024.0 * 1024.0), (double)streamer->budget / (1024.0 * 1024.0));
+
+    if (streamer->stagingBuffer != VK_NULL_HANDLE) {
+        vkUnmapMemory(renderer->logicalDevice, streamer->stagingMemory);
+        vkDestroyBuffer(renderer->logicalDevice, streamer->stagingBuffer, NULL);
+        vkFreeMemory(renderer->logicalDevice, streamer->stagingMemory, NULL);
+    }
+
+    DestroyTexture(renderer, &streamer->placeholder);
+    vkDestroyFence(renderer->logicalDevice, streamer->fence, NULL);
+    vkDestroyCommandPool(renderer->logicalDevice, streamer->commandPool, NULL);
+    SDL_DestroyMutex(streamer->mutex);
+    free(streamer->loaders);
+    free(streamer->textures);
+    free(streamer);
+    renderer->streamer = NULL;
+}
+
+VkPipeline CreateComputePipeline(renderer_t *renderer, char *shaderName, VkPipelineLayout layout) {
+    long shaderCodeSize;
+    char *shaderCode = ReadBytesFromResource(shaderName, &shaderCodeSize);
+    VkShaderModule shaderModule = CreateShaderModule(renderer, shaderCode, shaderCodeSize);
+    free(shaderCode);
+
+    VkComputePipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shaderModule,
+            .pName = "main",
+        },
+        .layout = layout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+    };
+
+    VkPipeline pipeline;
+    if (vkCreateComputePipelines(renderer->logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline) != VK_SUCCESS) {
+        FatalError("Failed to create compute pipeline from %s.", shaderName);
+    }
+
+    vkDestroyShaderModule(renderer->logicalDevice, shaderModule, NULL);
+
+    return pipeline;
+}
+
+// Views and descriptor sets the compute downsampler records with, released once its commands have completed.
+typedef struct mip_scratch {
+    VkImageView views[MAX_MIP_LEVELS];
+    uint32_t viewCount;
+    descriptor_allocator_t descriptors;
+} mip_scratch_t;
+
+void ReleaseMipScratch(renderer_t *renderer, mip_scratch_t *scratch) {
+    for (uint32_t i = 0; i < scratch->viewCount; i++) {
+        vkDestroyImageView(renderer->logicalDevice, scratch->views[i], NULL);
+    }
+
+    DestroyDescriptorAllocator(renderer, &scratch->descriptors);
+    scratch->viewCount = 0;
+}
+
+// Each level is filtered from the one above with a linear blit, and handed to the fragment shader as soon as the
+// next level has read it.
+void RecordBlitMipmaps(VkCommandBuffer commandBuffer, texture_t *texture) {
+    for (uint32_t level = 1; level < texture->mipLevels; level++) {
+        VkExtent2D source = MipExtent(texture->extent, level - 1);
+        VkExtent2D destination = MipExtent(texture->extent, level);
+
+        TransitionImageLevels(commandBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1,
+                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+        VkImageBlit blit = {
+            .srcSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = level - 1, .baseArrayLayer = 0, .layerCount = 1 },
+            .srcOffsets = { { 0, 0, 0 }, { (int32_t)source.width, (int32_t)source.height, 1 } },
+            .dstSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = level, .baseArrayLayer = 0, .layerCount = 1 },
+            .dstOffsets = { { 0, 0, 0 }, { (int32_t)destination.width, (int32_t)destination.height, 1 } },
+        };
+
+        vkCmdBlitImage(commandBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       1, &blit, VK_FILTER_LINEAR);
+
+        TransitionImageLevels(commandBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1,
+                              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    TransitionImageLevels(commandBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, texture->mipLevels - 1, 1,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void CreateMipPipeline(renderer_t *renderer) {
+    // Source and destination level, as declared in shaders/downsample.comp.
+    VkDescriptorSetLayoutBinding bindings[] = {
+        { .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+        { .binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+    };
+
+    VkDescriptorSetLayout setLayout = GetDescriptorSetLayout(renderer, bindings, 2);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &setLayout,
+    };
+
+    if (vkCreatePipelineLayout(renderer->logicalDevice, &pipelineLayoutInfo, NULL, &renderer->mipPipelineLayout) != VK_SUCCESS) {
+        FatalError("Failed to create mipmap pipeline layout.");
+    }
+
+    renderer->mipPipeline = CreateComputePipeline(renderer, "downsample.comp.spv", renderer->mipPipelineLayout);
+}
+
+// One dispatch per level, each reading the level above through a storage image. The whole chain stays in GENERAL
+// until the last level is written.
+void RecordComputeMipmaps(renderer_t *renderer, VkCommandBuffer commandBuffer, texture_t *texture, mip_scratch_t *scratch) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(renderer->physicalDevice, texture->format, &formatProperties);
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+        FatalError("Texture format %d can neither be blitted nor used as a storage image, so its mip chain cannot be generated.", texture->format);
+    }
+
+    if (renderer->mipPipeline == VK_NULL_HANDLE) {
+        CreateMipPipeline(renderer);
+    }
+
+    for (uint32_t level = 0; level < texture->mipLevels; level++) {
+        VkImageViewCreateInfo viewInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = texture->image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = texture->format,
+            .subresourceRange = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .baseMipLevel = level, .levelCount = 1, .baseArrayLayer = 0, .layerCount = 1 },
+        };
+
+        if (vkCreateImageView(renderer->logicalDevice, &viewInfo, NULL, &scratch->views[scratch->viewCount++]) != VK_SUCCESS) {
+            FatalError("Failed to create mip level view.");
+        }
+    }
+
+    TransitionImageLevels(commandBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->mipLevels,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderer->mipPipeline);
+
+    for (uint32_t level = 1; level < texture->mipLevels; level++) {
+        descriptor_set_builder_t builder = BeginDescriptorSet(&scratch->descriptors);
+        AddDescriptorImage(&builder, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, scratch->views[level - 1], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL);
+        AddDescriptorImage(&builder, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, scratch->views[level], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL);
+        VkDescriptorSet set = BuildDescriptorSet(renderer, &builder, NULL);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderer->mipPipelineLayout, 0, 1, &set, 0, NULL);
+
+        VkExtent2D extent = MipExtent(texture->extent, level);
+        vkCmdDispatch(commandBuffer, (extent.width + 7) / 8, (extent.height + 7) / 8, 1);
+
+        TransitionImageLevels(commandBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, level, 1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    TransitionImageLevels(commandBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->mipLevels,
+                          VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+// Uploads level 0 and generates the rest of the chain on the GPU, leaving every level ready for sampling.
+void UploadTextureWithMipmaps(renderer_t *renderer, texture_t *texture, const uint8_t *pixels) {
+    VkCommandBuffer commandBuffer = BeginOneTimeCommands(renderer);
+    VkDeviceMemory stagingMemory;
+    VkBuffer stagingBuffer = RecordTextureUpload(renderer, commandBuffer, texture, pixels, &stagingMemory);
+
+    mip_scratch_t scratch = {};
+    if (CanBlitMipmaps(renderer, texture->format)) {
+        RecordBlitMipmaps(commandBuffer, texture);
+    } else {
+        RecordComputeMipmaps(renderer, commandBuffer, texture, &scratch);
+    }
+
+    EndOneTimeCommands(renderer, commandBuffer);
+
+    ReleaseMipScratch(renderer, &scratch);
+    vkDestroyBuffer(renderer->logicalDevice, stagingBuffer, NULL);
+    vkFreeMemory(renderer->logicalDevice, stagingMemory, NULL);
+}
+
+// Checkerboards of two random colors with a random square size, one per material.
+void CreateProceduralMaterials(renderer_t *renderer) {
+    renderer->materialCount = BINDLESS_MATERIAL_COUNT;
+    renderer->materialTextures = calloc(renderer->materialCount, sizeof(texture_t));
+    renderer->materialSlots = calloc(renderer->materialCount, sizeof(uint32_t));
+
+    VkExtent2D extent = { .width = MATERIAL_TEXTURE_SIZE, .height = MATERIAL_TEXTURE_SIZE };
+    uint8_t *pixels = malloc(MATERIAL_TEXTURE_SIZE * MATERIAL_TEXTURE_SIZE * 4);
+    uint32_t state = 0x9e3779b9;
+
+    for (uint32_t i = 0; i < renderer->materialCount; i++) {
+        uint8_t colors[2][4];
+        for (uint32_t c = 0; c < 2; c++) {
+            for (uint32_t channel = 0; channel < 3; channel++) {
+                colors[c][channel] = (uint8_t)RandomFloat(&state, 64.0f, 255.0f);
+            }
+            colors[c][3] = 255;
+        }
+
+        uint32_t square = 4u << (NextRandom(&state) % 3);
+        for (uint32_t y = 0; y < MATERIAL_TEXTURE_SIZE; y++) {
+            for (uint32_t x = 0; x < MATERIAL_TEXTURE_SIZE; x++) {
+                memcpy(&pixels[(y * MATERIAL_TEXTURE_SIZE + x) * 4], colors[(x / square + y / square) & 1], 4);
+            }
+        }
+
+        texture_t *texture = &renderer->materialTextures[i];
+        *texture = CreateTexture(renderer, extent, VK_FORMAT_R8G8B8A8_UNORM, MipLevelCount(extent));
+        UploadTextureWithMipmaps(renderer, texture, pixels);
+        AddBindlessTexture(renderer, texture);
+        renderer->materialSlots[i] = texture->bindlessIndex;
+    }
+
+    free(pixels);
+}
+
+void CreateMaterials(renderer_t *renderer) {
+    if (options.textureDirectory) {
+        StartTextureStreaming(renderer, options.textureDirectory, (VkDeviceSize)options.textureBudget << 20);
+    } else {
+        CreateProceduralMaterials(renderer);
+    }
+}
+
+// Growable array of floats, for OBJ attributes.
+typedef struct float_array {
+    float *data;
+    uint32_t count;
+    uint32_t capacity;
+} float_array_t;
+
+void PushFloats(float_array_t *array, const float *values, uint32_t count) {
+    if (array->count + count > array->capacity) {
+        array->capacity = MAX(array->capacity * 2, array->count + count + 1024);
+        array->data = realloc(array->data, array->capacity * sizeof(float));
+    }
+
+    memcpy(&array->data[array->count], values, count * sizeof(float));
+    array->count += count;
+}
+
+// Vertices of an OBJ file are unique combinations of position, texture coordinate and normal indices.
+typedef struct obj_vertex_key {
+    int32_t position;
+    int32_t uv;
+    int32_t normal;
+} obj_vertex_key_t;
+
+typedef struct obj_vertex_map {
+    obj_vertex_key_t *keys;
+    uint32_t *vertices;
+    uint32_t capacity;
+} obj_vertex_map_t;
+
+uint32_t HashVertexKey(obj_vertex_key_t key) {
+    uint32_t hash = (uint32_t)key.position * 0x9e3779b1u;
+    hash ^= (uint32_t)key.uv * 0x85ebca6bu + (hash << 6) + (hash >> 2);
+    hash ^= (uint32_t)key.normal * 0xc2b2ae35u + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+// Resolves an OBJ index, which counts from 1 or from the end when negative, to a 0-based index or -1 when absent.
+int32_t ResolveObjIndex(const char *path, uint32_t line, long index, uint32_t count) {
+    long resolved = index > 0 ? index - 1 : (long)count + index;
+    if (index == 0 || resolved < 0 || resolved >= (long)count) {
+        FatalError("%s:%u: index %ld is out of range.", path, line, index);
+    }
+
+    return (int32_t)resolved;
+}
+
+// Parses positions, texture coordinates, normals and polygonal faces, which are split into triangle fans. Everything
+// else in the file is ignored. Vertices without a normal get the area-weighted normal of their faces. The mesh is
+// centered and scaled to fit a unit cube, so instances size it like the triangle.
+void ImportObj(const char *path, mesh_vertex_t **verticesOut, uint32_t *vertexCountOut, uint32_t **indicesOut, uint32_t *indexCountOut) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        FatalError("Failed to open mesh %s.", path);
+    }
+
+    float_array_t positions = {}, uvs = {}, normals = {};
+    mesh_vertex_t *vertices = NULL;
+    uint32_t vertexCount = 0, vertexCapacity = 0;
+    uint32_t *indices = NULL;
+    uint32_t indexCount = 0, indexCapacity = 0;
+    bool *needsNormal = NULL;
+
+    obj_vertex_map_t map = { .capacity = 1 << 16 };
+    map.keys = malloc(map.capacity * sizeof(obj_vertex_key_t));
+    map.vertices = malloc(map.capacity * sizeof(uint32_t));
+    memset(map.vertices, 0xff, map.capacity * sizeof(uint32_t));
+
+    char line[4096];
+    uint32_t lineNumber = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineNumber++;
+        char *cursor = line;
+
+        if (strncmp(cursor, "v ", 2) == 0 || strncmp(cursor, "vn ", 3) == 0) {
+            float values[3];
+            cursor += cursor[1] == 'n' ? 3 : 2;
+            for (uint32_t i = 0; i < 3; i++) {
+                values[i] = strtof(cursor, &cursor);
+            }
+            PushFloats(line[1] == 'n' ? &normals : &positions, values, 3);
+        } else if (strncmp(cursor, "vt ", 3) == 0) {
+            cursor += 3;
+            float values[2];
+            values[0] = strtof(cursor, &cursor);
+            // OBJ texture coordinates start at the bottom of the image, Vulkan's at the top.
+            values[1] = 1.0f - strtof(cursor, &cursor);
+            PushFloats(&uvs, values, 2);
+        } else if (strncmp(cursor, "f ", 2) == 0) {
+            cursor += 2;
+            uint32_t polygon[64];
+            uint32_t cornerCount = 0;
+
+            for (;;) {
+                while (*cursor == ' ' || *cursor == '\t') {
+                    cursor++;
+                }
+                if (!isdigit((unsigned char)*cursor) && *cursor != '-') {
+                    break;
+                }
+
+                obj_vertex_key_t key = { .position = ResolveObjIndex(path, lineNumber, strtol(cursor, &cursor, 10), positions.count / 3), .uv = -1, .normal = -1 };
+                if (*cursor == '/') {
+                    cursor++;
+                    if (*cursor != '/') {
+                        key.uv = ResolveObjIndex(path, lineNumber, strtol(cursor, &cursor, 10), uvs.count / 2);
+                    }
+                    if (*cursor == '/') {
+                        cursor++;
+                        key.normal = ResolveObjIndex(path, lineNumber, strtol(cursor, &cursor, 10), normals.count / 3);
+                    }
+                }
+
+                if (cornerCount == 64) {
+                    FatalError("%s:%u: faces have at most 64 corners.", path, lineNumber);
+                }
+
+                // Grow the map at half load, so probes stay short.
+                if (vertexCount * 2 >= map.capacity) {
+                    obj_vertex_map_t grown = { .capacity = map.capacity * 2 };
+                    grown.keys = malloc(grown.capacity * sizeof(obj_vertex_key_t));
+                    grown.vertices = malloc(grown.capacity * sizeof(uint32_t));
+                    memset(grown.vertices, 0xff, grown.capacity * sizeof(uint32_t));
+                    for (uint32_t i = 0; i < map.capacity; i++) {
+                        if (map.vertices[i] != UINT32_MAX) {
+                            uint32_t slot = HashVertexKey(map.keys[i]) & (grown.capacity - 1);
+                            while (grown.vertices[slot] != UINT32_MAX) {
+                                slot = (slot + 1) & (grown.capacity - 1);
+                            }
+                            grown.keys[slot] = map.keys[i];
+                            grown.vertices[slot] = map.vertices[i];
+                        }
+                    }
+                    free(map.keys);
+                    free(map.vertices);
+                    map = grown;
+                }
+
+                uint32_t slot = HashVertexKey(key) & (map.capacity - 1);
+                while (map.vertices[slot] != UINT32_MAX && memcmp(&map.keys[slot], &key, sizeof(key)) != 0) {
+                    slot = (slot + 1) & (map.capacity - 1);
+                }
+
+                if (map.vertices[slot] == UINT32_MAX) {
+                    if (vertexCount == vertexCapacity) {
+                        vertexCapacity = MAX(vertexCapacity * 2, 1024);
+                        vertices = realloc(vertices, vertexCapacity * sizeof(mesh_vertex_t));
+                        needsNormal = realloc(needsNormal, vertexCapacity * sizeof(bool));
+                    }
+
+                    mesh_vertex_t *vertex = &vertices[vertexCount];
+                    memset(vertex, 0, sizeof(mesh_vertex_t));
+                    memcpy(vertex->position, &positions.data[key.position * 3], sizeof(vertex->position));
+                    if (key.uv >= 0) {
+                        memcpy(vertex->uv, &uvs.data[key.uv * 2], sizeof(vertex->uv));
+                    }
+                    if (key.normal >= 0) {
+                        memcpy(vertex->normal, &normals.data[key.normal * 3], sizeof(vertex->normal));
+                    }
+                    needsNormal[vertexCount] = key.normal < 0;
+
+                    map.keys[slot] = key;
+                    map.vertices[slot] = vertexCount++;
+                }
+
+                polygon[cornerCount++] = map.vertices[slot];
+            }
+
+            if (cornerCount < 3) {
+                FatalError("%s:%u: a face needs at least 3 corners.", path, lineNumber);
+            }
+
+            if (indexCount + (cornerCount - 2) * 3 > indexCapacity) {
+                indexCapacity = MAX(indexCapacity * 2, indexCount + (cornerCount - 2) * 3 + 3072);
+                indices = realloc(indices, indexCapacity * sizeof(uint32_t));
+            }
+
+            for (uint32_t i = 2; i < cornerCount; i++) {
+                indices[indexCount++] = polygon[0];
+                indices[indexCount++] = polygon[i - 1];
+                indices[indexCount++] = polygon[i];
+            }
+        }
+    }
+
+    fclose(f);
+    free(positions.data);
+    free(uvs.data);
+    free(normals.data);
+    free(map.keys);
+    free(map.vertices);
+
+    if (indexCount == 0) {
+        FatalError("%s contains no faces.", path);
+    }
+
+    // The cross product's length is twice the triangle's area, which weights each face's contribution.
+    for (uint32_t i = 0; i < indexCount; i += 3) {
+        float *a = vertices[indices[i]].position, *b = vertices[indices[i + 1]].position, *c = vertices[indices[i + 2]].position;
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+
+        for (uint32_t k = 0; k < 3; k++) {
+            if (needsNormal[indices[i + k]]) {
+                float *normal = vertices[indices[i + k]].normal;
+                normal[0] += n[0];
+                normal[1] += n[1];
+                normal[2] += n[2];
+            }
+        }
+    }
+
+    float minimum[3] = { INFINITY, INFINITY, INFINITY }, maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        float *normal = vertices[i].normal;
+        float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        for (uint32_t k = 0; k < 3; k++) {
+            normal[k] = length > 0 ? normal[k] / length : (k == 2);
+            minimum[k] = fminf(minimum[k], vertices[i].position[k]);
+            maximum[k] = fmaxf(maximum[k], vertices[i].position[k]);
+        }
+    }
+    free(needsNormal);
+
+    float extent = fmaxf(fmaxf(maximum[0] - minimum[0], maximum[1] - minimum[1]), maximum[2] - minimum[2]);
+    float scale = extent > 0 ? 1.0f / extent : 1.0f;
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            vertices[i].position[k] = (vertices[i].position[k] - (minimum[k] + maximum[k]) * 0.5f) * scale;
+        }
+    }
+
+    *verticesOut = vertices;
+    *vertexCountOut = vertexCount;
+    *indicesOut = indices;
+    *indexCountOut = indexCount;
+}
+
+// Average cache miss ratio: vertex shader invocations per triangle with a FIFO post-transform cache of the given size.
+// 3 is the worst case; 0.5 is the best a regular grid allows.
+float ComputeACMR(const uint32_t *indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize) {
+    // A vertex is cached while fewer than cacheSize other vertices have entered the cache since it did.
+    uint32_t *entered = calloc(vertexCount, sizeof(uint32_t));
+    uint32_t time = cacheSize + 1;
+    uint32_t misses = 0;
+
+    for (uint32_t i = 0; i < indexCount; i++) {
+        if (time - entered[indices[i]] > cacheSize) {
+            entered[indices[i]] = time++;
+            misses++;
+        }
+    }
+
+    free(entered);
+    return indexCount > 0 ? (float)misses / (float)(indexCount / 3) : 0.0f;
+}
+
+#define VERTEX_CACHE_SIZE 32
+
+// Tom Forsyth's scoring: recently used vertices score high, the three just used a little less so triangles do not
+// strip along, and vertices with few triangles left score high so they are finished off.
+float VertexCacheScore(int32_t cachePosition, uint32_t remainingTriangles) {
+    if (remainingTriangles == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        score = cachePosition < 3 ? 0.75f : powf(1.0f - (float)(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+    }
+
+    return score + 2.0f / sqrtf((float)remainingTriangles);
+}
+
+// Greedily emits the triangle whose vertices score highest, simulating an LRU cache (Forsyth, "Linear-Speed Vertex
+// Cache Optimisation").
+void OptimizeVertexCache(uint32_t *indices, uint32_t indexCount, uint32_t vertexCount) {
+    uint32_t triangleCount = indexCount / 3;
+
+    // Triangles of each vertex; a vertex's list shrinks as its triangles are emitted.
+    uint32_t *remaining = calloc(vertexCount, sizeof(uint32_t));
+    uint32_t *firstTriangle = calloc(vertexCount + 1, sizeof(uint32_t));
+    uint32_t *vertexTriangles = malloc(indexCount * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < indexCount; i++) {
+        remaining[indices[i]]++;
+    }
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+        remaining[v] = 0;
+    }
+    for (uint32_t i = 0; i < indexCount; i++) {
+        uint32_t v = indices[i];
+        vertexTriangles[firstTriangle[v] + remaining[v]++] = i / 3;
+    }
+
+    int32_t *cachePosition = malloc(vertexCount * sizeof(int32_t));
+    float *vertexScore = malloc(vertexCount * sizeof(float));
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        cachePosition[v] = -1;
+        vertexScore[v] = VertexCacheScore(-1, remaining[v]);
+    }
+
+    float *triangleScore = malloc(triangleCount * sizeof(float));
+    bool *emitted = calloc(triangleCount, sizeof(bool));
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    }
+
+    uint32_t *output = malloc(indexCount * sizeof(uint32_t));
+    uint32_t cache[VERTEX_CACHE_SIZE + 3];
+    uint32_t cacheCount = 0;
+    uint32_t scanCursor = 0;
+    uint32_t best = UINT32_MAX;
+
+    for (uint32_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+        // Nothing in the cache has triangles left: start over at the next unemitted triangle in input order.
+        if (best == UINT32_MAX) {
+            while (emitted[scanCursor]) {
+                scanCursor++;
+            }
+            best = scanCursor;
+        }
+
+        const uint32_t *triangle = &indices[best * 3];
+        memcpy(&output[emittedCount * 3], triangle, 3 * sizeof(uint32_t));
+        emitted[best] = true;
+
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t v = triangle[k];
+            uint32_t *list = &vertexTriangles[firstTriangle[v]];
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                if (list[j] == best) {
+                    list[j] = list[--remaining[v]];
+                    break;
+                }
+            }
+        }
+
+        // The triangle's vertices move to the front; whatever falls off the end leaves the cache.
+        uint32_t newCache[VERTEX_CACHE_SIZE + 3];
+        uint32_t newCount = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            newCache[newCount++] = triangle[k];
+        }
+        for (uint32_t j = 0; j < cacheCount; j++) {
+            uint32_t v = cache[j];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                newCache[newCount++] = v;
+            }
+        }
+
+        for (uint32_t j = VERTEX_CACHE_SIZE; j < newCount; j++) {
+            cachePosition[newCache[j]] = -1;
+            vertexScore[newCache[j]] = VertexCacheScore(-1, remaining[newCache[j]]);
+        }
+
+        cacheCount = MIN(newCount, VERTEX_CACHE_SIZE);
+        memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+
+        // Only triangles touching the cache change score, so the next triangle is the best of those.
+        for (uint32_t j = 0; j < cacheCount; j++) {
+            cachePosition[cache[j]] = (int32_t)j;
+            vertexScore[cache[j]] = VertexCacheScore((int32_t)j, remaining[cache[j]]);
+        }
+
+        best = UINT32_MAX;
+        float bestScore = -1.0f;
+        for (uint32_t j = 0; j < newCount; j++) {
+            uint32_t v = newCache[j];
+            const uint32_t *list = &vertexTriangles[firstTriangle[v]];
+            for (uint32_t k = 0; k < remaining[v]; k++) {
+                uint32_t t = list[k];
+                triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    memcpy(indices, output, indexCount * sizeof(uint32_t));
+
+    free(output);
+    free(emitted);
+    free(triangleScore);
+    free(vertexScore);
+    free(cachePosition);
+    free(vertexTriangles);
+    free(firstTriangle);
+    free(remaining);
+}
+
+// Clusters may cost this much more cache misses than the order they are cut from.
+#define OVERDRAW_ACMR_THRESHOLD 1.05f
+
+typedef struct triangle_cluster {
+    uint32_t start;
+    uint32_t count;
+    float sortKey;
+} triangle_cluster_t;
+
+int CompareClusters(const void *a, const void *b) {
+    float x = ((const triangle_cluster_t*)a)->sortKey;
+    float y = ((const triangle_cluster_t*)b)->sortKey;
+    return (x < y) - (x > y);
+}
+
+// Cuts the cache-optimized order into clusters wherever restarting the cache costs little, then draws the clusters
+// that face outwards from the mesh center first, as they are the most likely to occlude the rest (Sander et al.,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+void OptimizeOverdraw(uint32_t *indices, uint32_t indexCount, const mesh_vertex_t *vertices, uint32_t vertexCount) {
+    uint32_t triangleCount = indexCount / 3;
+    triangle_cluster_t *clusters = malloc(triangleCount * sizeof(triangle_cluster_t));
+    uint32_t clusterCount = 0;
+
+    // One cache simulation for the whole function; moving time on by more than the cache size empties the cache.
+    uint32_t *entered = calloc(vertexCount, sizeof(uint32_t));
+    uint32_t time = VERTEX_CACHE_SIZE + 1;
+
+    // Hard boundaries: triangles whose vertices all miss the cache begin a new region of the mesh.
+    uint32_t *regionStarts = malloc((triangleCount + 1) * sizeof(uint32_t));
+    uint32_t regionCount = 0;
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        uint32_t misses = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t v = indices[t * 3 + k];
+            if (time - entered[v] > VERTEX_CACHE_SIZE) {
+                entered[v] = time++;
+                misses++;
+            }
+        }
+
+        if (t == 0 || misses == 3) {
+            regionStarts[regionCount++] = t;
+        }
+    }
+    regionStarts[regionCount] = triangleCount;
+
+    for (uint32_t r = 0; r < regionCount; r++) {
+        uint32_t start = regionStarts[r], end = regionStarts[r + 1];
+
+        time += VERTEX_CACHE_SIZE + 1;
+        uint32_t regionMisses = 0;
+        for (uint32_t i = start * 3; i < end * 3; i++) {
+            if (time - entered[indices[i]] > VERTEX_CACHE_SIZE) {
+                entered[indices[i]] = time++;
+                regionMisses++;
+            }
+        }
+        float regionACMR = (float)regionMisses / (end - start);
+
+        // Soft boundaries: within the region, cut wherever the cluster so far already misses no more than
+        // the whole region does, relative to the threshold.
+        time += VERTEX_CACHE_SIZE + 1;
+        uint32_t clusterStart = start, clusterMisses = 0;
+
+        for (uint32_t c = start; c < end; c++) {
+            for (uint32_t k = 0; k < 3; k++) {
+                uint32_t v = indices[c * 3 + k];
+                if (time - entered[v] > VERTEX_CACHE_SIZE) {
+                    entered[v] = time++;
+                    clusterMisses++;
+                }
+            }
+
+            uint32_t clusterTriangles = c + 1 - clusterStart;
+            if (c + 1 == end || (float)clusterMisses / clusterTriangles <= regionACMR * OVERDRAW_ACMR_THRESHOLD) {
+                clusters[clusterCount++] = (triangle_cluster_t){ .start = clusterStart, .count = clusterTriangles };
+                clusterStart = c + 1;
+                clusterMisses = 0;
+                time += VERTEX_CACHE_SIZE + 1;
+            }
+        }
+    }
+    free(regionStarts);
+    free(entered);
+
+    // Area-weighted centers and normals, from the cross product of each triangle's edges.
+    float meshCenter[3] = {};
+    float meshArea = 0.0f;
+    float (*clusterCenters)[3] = calloc(clusterCount, sizeof(float[3]));
+    float (*clusterNormals)[3] = calloc(clusterCount, sizeof(float[3]));
+
+    for (uint32_t c = 0; c < clusterCount; c++) {
+        float clusterArea = 0.0f;
+        for (uint32_t t = clusters[c].start; t < clusters[c].start + clusters[c].count; t++) {
+            const float *a = vertices[indices[t * 3]].position, *b = vertices[indices[t * 3 + 1]].position, *p = vertices[indices[t * 3 + 2]].position;
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e2[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (uint32_t k = 0; k < 3; k++) {
+                float center = (a[k] + b[k] + p[k]) / 3.0f;
+                clusterCenters[c][k] += center * area;
+                clusterNormals[c][k] += n[k];
+                meshCenter[k] += center * area;
+            }
+            clusterArea += area;
+        }
+
+        meshArea += clusterArea;
+        for (uint32_t k = 0; k < 3; k++) {
+            clusterCenters[c][k] /= fmaxf(clusterArea, 1e-20f);
+        }
+    }
+
+    for (uint32_t k = 0; k < 3; k++) {
+        meshCenter[k] /= fmaxf(meshArea, 1e-20f);
+    }
+
+    for (uint32_t c = 0; c < clusterCount; c++) {
+        float *n = clusterNormals[c];
+        float length = fmaxf(sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]), 1e-20f);
+        clusters[c].sortKey = ((clusterCenters[c][0] - meshCenter[0]) * n[0] + (clusterCenters[c][1] - meshCenter[1]) * n[1] +
+                               (clusterCenters[c][2] - meshCenter[2]) * n[2]) / length;
+    }
+
+    qsort(clusters, clusterCount, sizeof(triangle_cluster_t), CompareClusters);
+
+    uint32_t *output = malloc(indexCount * sizeof(uint32_t));
+    uint32_t written = 0;
+    for (uint32_t c = 0; c < clusterCount; c++) {
+        memcpy(&output[written], &indices[clusters[c].start * 3], clusters[c].count * 3 * sizeof(uint32_t));
+        written += clusters[c].count * 3;
+    }
+    memcpy(indices, output, indexCount * sizeof(uint32_t));
+
+    free(output);
+    free(clusterNormals);
+    free(clusterCenters);
+    free(clusters);
+}
+
+// Renumbers vertices in the order the triangles first use them and drops unused ones, so vertex fetches walk
+// through memory instead of jumping around it. Returns the new vertex count.
+uint32_t OptimizeVertexFetch(uint32_t *indices, uint32_t indexCount, mesh_vertex_t *vertices, uint32_t vertexCount) {
+    uint32_t *remap = malloc(vertexCount * sizeof(uint32_t));
+    memset(remap, 0xff, vertexCount * sizeof(uint32_t));
+    mesh_vertex_t *reordered = malloc(vertexCount * sizeof(mesh_vertex_t));
+    uint32_t used = 0;
+
+    for (uint32_t i = 0; i < indexCount; i++) {
+        uint32_t v = indices[i];
+        if (remap[v] == UINT32_MAX) {
+            reordered[used] = vertices[v];
+            remap[v] = used++;
+        }
+        indices[i] = remap[v];
+    }
+
+    memcpy(vertices, reordered, used * sizeof(mesh_vertex_t));
+    free(reordered);
+    free(remap);
+    return used;
+}
+
+// Symmetric 4x4 matrix summing squared distances to planes: xx, xy, xz, xw, yy, yz, yw, zz, zw, ww.
+typedef struct quadric {
+    double m[10];
+} quadric_t;
+
+void AddPlaneQuadric(quadric_t *q, const double plane[4], double weight) {
+    const double *p = plane;
+    double terms[10] = { p[0] * p[0], p[0] * p[1], p[0] * p[2], p[0] * p[3], p[1] * p[1], p[1] * p[2], p[1] * p[3], p[2] * p[2], p[2] * p[3], p[3] * p[3] };
+    for (uint32_t i = 0; i < 10; i++) {
+        q->m[i] += terms[i] * weight;
+    }
+}
+
+double QuadricError(const quadric_t *q, const float position[3]) {
+    double x = position[0], y = position[1], z = position[2];
+    const double *m = q->m;
+    return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x + m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y +
+           m[7] * z * z + 2 * m[8] * z + m[9];
+}
+
+// Vertex clustering: every vertex in a cell of a gridSize^3 grid over the mesh's bounds collapses onto the one vertex of
+// the cell that best fits the planes of the cell's triangles, and triangles that lose a corner disappear. The kept
+// vertices are original ones, so the levels share the full mesh's vertex buffer. Returns the number of indices written.
+uint32_t SimplifyMesh(const mesh_vertex_t *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount,
+                      uint32_t gridSize, uint32_t *output, float *errorOut) {
+    float minimum[3] = { INFINITY, INFINITY, INFINITY }, maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            minimum[k] = fminf(minimum[k], vertices[i].position[k]);
+            maximum[k] = fmaxf(maximum[k], vertices[i].position[k]);
+        }
+    }
+
+    float extent = fmaxf(fmaxf(maximum[0] - minimum[0], maximum[1] - minimum[1]), fmaxf(maximum[2] - minimum[2], 1e-20f));
+
+    // Cells are found through an open addressing map from cell coordinates to a cluster number.
+    uint32_t capacity = 1;
+    while (capacity < vertexCount * 2) {
+        capacity *= 2;
+    }
+    uint32_t *cellKeys = malloc(capacity * sizeof(uint32_t));
+    uint32_t *cellClusters = malloc(capacity * sizeof(uint32_t));
+    memset(cellKeys, 0xff, capacity * sizeof(uint32_t));
+
+    uint32_t *clusters = malloc(MAX(vertexCount, 1) * sizeof(uint32_t));
+    uint32_t clusterCount = 0;
+
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        uint32_t cell[3];
+        for (uint32_t k = 0; k < 3; k++) {
+            cell[k] = MIN((uint32_t)((vertices[i].position[k] - minimum[k]) / extent * (float)gridSize), gridSize - 1);
+        }
+
+        uint32_t key = cell[0] + gridSize * (cell[1] + gridSize * cell[2]);
+        uint32_t slot = (key * 2654435761u) & (capacity - 1);
+        while (cellKeys[slot] != UINT32_MAX && cellKeys[slot] != key) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        if (cellKeys[slot] == UINT32_MAX) {
+            cellKeys[slot] = key;
+            cellClusters[slot] = clusterCount++;
+        }
+        clusters[i] = cellClusters[slot];
+    }
+
+    free(cellKeys);
+    free(cellClusters);
+
+    // Area-weighted plane quadrics of every triangle touching the cluster.
+    quadric_t *quadrics = calloc(MAX(clusterCount, 1), sizeof(quadric_t));
+    for (uint32_t i = 0; i < indexCount; i += 3) {
+        const float *a = vertices[indices[i]].position, *b = vertices[indices[i + 1]].position, *c = vertices[indices[i + 2]].position;
+        double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0) {
+            continue;
+        }
+
+        double plane[4] = { n[0] / length, n[1] / length, n[2] / length, 0 };
+        plane[3] = -(plane[0] * a[0] + plane[1] * a[1] + plane[2] * a[2]);
+        for (uint32_t k = 0; k < 3; k++) {
+            AddPlaneQuadric(&quadrics[clusters[indices[i + k]]], plane, length * 0.5);
+        }
+    }
+
+    uint32_t *representatives = malloc(MAX(clusterCount, 1) * sizeof(uint32_t));
+    double *bestErrors = malloc(MAX(clusterCount, 1) * sizeof(double));
+    for (uint32_t c = 0; c < clusterCount; c++) {
+        bestErrors[c] = INFINITY;
+    }
+
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        double error = QuadricError(&quadrics[clusters[i]], vertices[i].position);
+        if (error < bestErrors[clusters[i]]) {
+            bestErrors[clusters[i]] = error;
+            representatives[clusters[i]] = i;
+        }
+    }
+
+    uint32_t written = 0;
+    float maxDistance = 0.0f;
+    for (uint32_t i = 0; i < indexCount; i += 3) {
+        uint32_t a = clusters[indices[i]], b = clusters[indices[i + 1]], c = clusters[indices[i + 2]];
+        if (a == b || b == c || a == c) {
+            continue;
+        }
+
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t v = representatives[clusters[indices[i + k]]];
+            const float *from = vertices[indices[i + k]].position, *to = vertices[v].position;
+            float d[3] = { to[0] - from[0], to[1] - from[1], to[2] - from[2] };
+            maxDistance = fmaxf(maxDistance, sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+            output[written++] = v;
+        }
+    }
+
+    free(bestErrors);
+    free(representatives);
+    free(quadrics);
+    free(clusters);
+
+    *errorOut = maxDistance;
+    return written;
+}
+
+// Levels stop once they would have fewer triangles than this.
+#define MESH_MIN_LOD_TRIANGLES 8
+
+// Appends a chain of coarser index lists to the full mesh's, each with at most half the triangles of the level before.
+// Every level is simplified from the full mesh at the finest grid that reaches its triangle budget.
+uint32_t *BuildMeshLods(const mesh_vertex_t *vertices, uint32_t vertexCount, uint32_t *indices, uint32_t *indexCount,
+                        mesh_lod_t *lods, uint32_t *lodCountOut) {
+    uint32_t fullCount = *indexCount;
+    uint32_t *candidate = malloc(fullCount * sizeof(uint32_t));
+    uint32_t *best = malloc(fullCount * sizeof(uint32_t));
+
+    lods[0] = (mesh_lod_t){ .firstIndex = 0, .indexCount = fullCount, .error = 0.0f };
+    uint32_t lodCount = 1;
+    uint32_t maxGrid = 1024;
+
+    while (lodCount < MESH_MAX_LODS) {
+        uint32_t budget = lods[lodCount - 1].indexCount / 6 * 3;
+
+        // Coarser grids give fewer triangles, so binary search for the finest one within the budget.
+        uint32_t low = 1, high = maxGrid, bestCount = 0, bestGrid = 0;
+        float bestError = 0.0f;
+        while (low <= high) {
+            uint32_t grid = low + (high - low) / 2;
+            float error;
+            uint32_t count = SimplifyMesh(vertices, vertexCount, indices, fullCount, grid, candidate, &error);
+
+            if (count <= budget) {
+                uint32_t *swap = best;
+                best = candidate;
+                candidate = swap;
+                bestCount = count;
+                bestGrid = grid;
+                bestError = error;
+                low = grid + 1;
+            } else {
+                high = grid - 1;
+            }
+        }
+
+        if (bestCount < MESH_MIN_LOD_TRIANGLES * 3) {
+            break;
+        }
+
+        indices = realloc(indices, (*indexCount + bestCount) * sizeof(uint32_t));
+        memcpy(&indices[*indexCount], best, bestCount * sizeof(uint32_t));
+
+        // Errors only grow down the chain, so selection can stop at the first level that is too coarse.
+        lods[lodCount] = (mesh_lod_t){
+            .firstIndex = *indexCount,
+            .indexCount = bestCount,
+            .error = fmaxf(bestError, lods[lodCount - 1].error),
+        };
+        lodCount++;
+        *indexCount += bestCount;
+        maxGrid = bestGrid;
+    }
+
+    free(best);
+    free(candidate);
+
+    for (uint32_t i = 1; i < lodCount; i++) {
+        printf("Mesh LOD %u: %u triangles, error %.4f.\n", i, lods[i].indexCount / 3, lods[i].error);
+    }
+
+    *lodCountOut = lodCount;
+    return indices;
+}
+
+// Runs on import only; the optimized order is what the cache stores. Each LOD's triangles are reordered on their
+// own, then the vertices are renumbered for all of them together, since the levels share them. ACMR is the full mesh's.
+void OptimizeMesh(mesh_vertex_t *vertices, uint32_t *vertexCount, uint32_t *indices, uint32_t indexCount, const mesh_lod_t *lods, uint32_t lodCount) {
+    float before = ComputeACMR(indices, lods[0].indexCount, *vertexCount, 16);
+
+    for (uint32_t i = 0; i < lodCount; i++) {
+        OptimizeVertexCache(&indices[lods[i].firstIndex], lods[i].indexCount, *vertexCount);
+    }
+    float cacheOptimized = ComputeACMR(indices, lods[0].indexCount, *vertexCount, 16);
+
+    for (uint32_t i = 0; i < lodCount; i++) {
+        OptimizeOverdraw(&indices[lods[i].firstIndex], lods[i].indexCount, vertices, *vertexCount);
+    }
+    *vertexCount = OptimizeVertexFetch(indices, indexCount, vertices, *vertexCount);
+    float after = ComputeACMR(indices, lods[0].indexCount, *vertexCount, 16);
+
+    printf("Optimized mesh: ACMR %.3f before, %.3f after vertex cache ordering, %.3f after overdraw ordering (16-entry FIFO cache).\n",
+           before, cacheOptimized, after);
+}
+
+int16_t QuantizeSnorm16(float value) {
+    return (int16_t)lrintf(fminf(fmaxf(value, -1.0f), 1.0f) * 32767.0f);
+}
+
+int8_t QuantizeSnorm8(float value) {
+    return (int8_t)lrintf(fminf(fmaxf(value, -1.0f), 1.0f) * 127.0f);
+}
+
+// Rounds to nearest even. Values beyond the half range become infinity and NaN stays NaN.
+uint16_t FloatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000) {
+        return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+    }
+    if (magnitude >= 0x477ff000) {
+        return sign | 0x7c00;
+    }
+
+    // Below the smallest normal half, scale into the subnormal range and let the float add do the rounding.
+    if (magnitude < 0x38800000) {
+        float shifted;
+        memcpy(&shifted, &magnitude, sizeof(shifted));
+        shifted += 0.5f;
+        memcpy(&magnitude, &shifted, sizeof(magnitude));
+        return sign | (uint16_t)(magnitude - 0x3f000000);
+    }
+
+    uint32_t odd = (magnitude >> 13) & 1;
+    magnitude += 0xc8000fff + odd;
+    return sign | (uint16_t)(magnitude >> 13);
+}
+
+// Projects the unit normal onto the octahedron |x| + |y| + |z| = 1 and folds the lower half over the diagonals, so
+// two components cover the whole sphere with nearly uniform precision. shaders/mesh.vert reverses it.
+void EncodeOctahedral(const float normal[3], int8_t encoded[2]) {
+    float sum = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    float x = sum > 0 ? normal[0] / sum : 0.0f;
+    float y = sum > 0 ? normal[1] / sum : 0.0f;
+
+    if (normal[2] < 0) {
+        float foldedX = (1.0f - fabsf(y)) * (x >= 0 ? 1.0f : -1.0f);
+        float foldedY = (1.0f - fabsf(x)) * (y >= 0 ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    encoded[0] = QuantizeSnorm8(x);
+    encoded[1] = QuantizeSnorm8(y);
+}
+
+// Positions are quantized to the mesh's bounds on each axis, so every axis uses the full 16 bits.
+packed_vertex_t *PackVertices(const mesh_vertex_t *vertices, uint32_t vertexCount, float offsetOut[3], float scaleOut[3]) {
+    float minimum[3] = { INFINITY, INFINITY, INFINITY }, maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            minimum[k] = fminf(minimum[k], vertices[i].position[k]);
+            maximum[k] = fmaxf(maximum[k], vertices[i].position[k]);
+        }
+    }
+
+    for (uint32_t k = 0; k < 3; k++) {
+        offsetOut[k] = vertexCount > 0 ? (minimum[k] + maximum[k]) * 0.5f : 0.0f;
+        scaleOut[k] = vertexCount > 0 && maximum[k] > minimum[k] ? (maximum[k] - minimum[k]) * 0.5f : 1.0f;
+    }
+
+    packed_vertex_t *packed = calloc(MAX(vertexCount, 1), sizeof(packed_vertex_t));
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            packed[i].position[k] = QuantizeSnorm16((vertices[i].position[k] - offsetOut[k]) / scaleOut[k]);
+        }
+        packed[i].uv[0] = FloatToHalf(vertices[i].uv[0]);
+        packed[i].uv[1] = FloatToHalf(vertices[i].uv[1]);
+        EncodeOctahedral(vertices[i].normal, packed[i].normal);
+    }
+
+    return packed;
+}
+
+// Written to a temporary file and renamed, so a concurrent reader never maps a partial cache.
+void WriteMeshCache(const char *cachePath, const struct stat *source, const mesh_vertex_t *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount,
+                    const mesh_lod_t *lods, uint32_t lodCount, uint32_t flags) {
+    mesh_cache_header_t header = {
+        .magic = MESH_CACHE_MAGIC,
+        .version = MESH_CACHE_VERSION,
+        .vertexStride = sizeof(packed_vertex_t),
+        .vertexCount = vertexCount,
+        .indexCount = indexCount,
+        .sourceSize = (uint64_t)source->st_size,
+        .sourceTime = (int64_t)source->st_mtime,
+        .vertexOffset = sizeof(mesh_cache_header_t),
+        .indexOffset = sizeof(mesh_cache_header_t) + (uint64_t)vertexCount * sizeof(packed_vertex_t),
+        .acmr = ComputeACMR(indices, lods[0].indexCount, vertexCount, 16),
+        .flags = flags,
+        .lodCount = lodCount,
+    };
+    memcpy(header.lods, lods, lodCount * sizeof(mesh_lod_t));
+
+    packed_vertex_t *packed = PackVertices(vertices, vertexCount, header.positionOffset, header.positionScale);
+
+    size_t length = strlen(cachePath) + 5;
+    char *temporaryPath = malloc(length);
+    snprintf(temporaryPath, length, "%s.tmp", cachePath);
+
+    FILE *f = fopen(temporaryPath, "wb");
+    if (!f) {
+        fprintf(stderr, "Failed to write mesh cache %s; the mesh will be imported again next time.\n", cachePath);
+        free(packed);
+        free(temporaryPath);
+        return;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                   fwrite(packed, sizeof(packed_vertex_t), vertexCount, f) == vertexCount &&
+                   fwrite(indices, sizeof(uint32_t), indexCount, f) == indexCount;
+    written &= fclose(f) == 0;
+
+    if (!written || rename(temporaryPath, cachePath) != 0) {
+        fprintf(stderr, "Failed to write mesh cache %s; the mesh will be imported again next time.\n", cachePath);
+        remove(temporaryPath);
+    }
+
+    free(packed);
+    free(temporaryPath);
+}
+
+void UnmapMeshCache(mesh_cache_t *cache) {
+    if (cache->mapping) {
+        munmap(cache->mapping, cache->size);
+    }
+
+    memset(cache, 0, sizeof(mesh_cache_t));
+}
+
+// Maps the cache file, or returns false if it is missing, from another version or older than the source.
+bool MapMeshCache(const char *cachePath, const struct stat *source, uint32_t flags, mesh_cache_t *cacheOut) {
+    int fd = open(cachePath, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(mesh_cache_header_t)) {
+        close(fd);
+        return false;
+    }
+
+    mesh_cache_t cache = { .size = (size_t)status.st_size };
+    cache.mapping = mmap(NULL, cache.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (cache.mapping == MAP_FAILED) {
+        return false;
+    }
+
+    const mesh_cache_header_t *header = cache.mapping;
+    cache.header = header;
+    bool valid = memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->version == MESH_CACHE_VERSION &&
+                 header->flags == flags &&
+                 header->vertexStride == sizeof(packed_vertex_t) &&
+                 header->vertexOffset + (uint64_t)header->vertexCount * sizeof(packed_vertex_t) <= header->indexOffset &&
+                 header->indexOffset + (uint64_t)header->indexCount * sizeof(uint32_t) <= cache.size &&
+                 header->vertexOffset % 16 == 0 && header->indexOffset % 4 == 0 &&
+                 header->lodCount >= 1 && header->lodCount <= MESH_MAX_LODS;
+
+    for (uint32_t i = 0; valid && i < header->lodCount; i++) {
+        valid = (uint64_t)header->lods[i].firstIndex + header->lods[i].indexCount <= header->indexCount;
+    }
+
+    // Without the source there is nothing to compare with, so the cache is trusted.
+    if (source) {
+        valid &= header->sourceSize == (uint64_t)source->st_size && header->sourceTime == (int64_t)source->st_mtime;
+    }
+
+    if (!valid) {
+        UnmapMeshCache(&cache);
+        return false;
+    }
+
+    cache.vertices = (const packed_vertex_t*)((const uint8_t*)cache.mapping + header->vertexOffset);
+    cache.indices = (const uint32_t*)((const uint8_t*)cache.mapping + header->indexOffset);
+    *cacheOut = cache;
+    return true;
+}
+
+// Returns the mesh's cache, importing the source into it first when the cache is missing or stale.
+mesh_cache_t LoadMesh(const char *path) {
+    Uint64 startTime = SDL_GetPerformanceCounter();
+
+    size_t length = strlen(path) + 6;
+    char *cachePath = malloc(length);
+    snprintf(cachePath, length, "%s.mesh", path);
+
+    struct stat source;
+    bool hasSource = stat(path, &source) == 0;
+
+    uint32_t flags = options.optimizeMesh ? MESH_CACHE_OPTIMIZED : 0;
+
+    mesh_cache_t cache;
+    if (MapMeshCache(cachePath, hasSource ? &source : NULL, flags, &cache)) {
+        printf("Loaded mesh %s from %s: %u vertices, %u triangles, %u LODs, ACMR %.3f in %.2f ms.\n", path, cachePath, cache.header->vertexCount,
+               cache.header->lods[0].indexCount / 3, cache.header->lodCount, cache.header->acmr, (double)(SDL_GetPerformanceCounter() - startTime) * 1000.0 / (double)SDL_GetPerformanceFrequency());
+        free(cachePath);
+        return cache;
+    }
+
+    if (!hasSource) {
+        FatalError("Mesh %s does not exist.", path);
+    }
+
+    mesh_vertex_t *vertices;
+    uint32_t *indices;
+    uint32_t vertexCount, indexCount;
+    ImportObj(path, &vertices, &vertexCount, &indices, &indexCount);
+
+    mesh_lod_t lods[MESH_MAX_LODS];
+    uint32_t lodCount;
+    indices = BuildMeshLods(vertices, vertexCount, indices, &indexCount, lods, &lodCount);
+    if (options.optimizeMesh) {
+        OptimizeMesh(vertices, &vertexCount, indices, indexCount, lods, lodCount);
+    }
+    WriteMeshCache(cachePath, &source, vertices, vertexCount, indices, indexCount, lods, lodCount, flags);
+    free(vertices);
+    free(indices);
+
+    if (!MapMeshCache(cachePath, &source, flags, &cache)) {
+        FatalError("Failed to map mesh cache %s.", cachePath);
+    }
+
+    printf("Imported mesh %s into %s: %u vertices, %u triangles, %u LODs in %.2f ms.\n", path, cachePath, vertexCount, lods[0].indexCount / 3, lodCount,
+           (double)(SDL_GetPerformanceCounter() - startTime) * 1000.0 / (double)SDL_GetPerformanceFrequency());
+    free(cachePath);
+    return cache;
+}
+
+// The cache is laid out like the buffers, so its data is copied straight from the mapping into staging memory.
+void CreateMeshBuffers(renderer_t *renderer) {
+    mesh_cache_t cache = LoadMesh(options.meshPath);
+    VkDeviceSize vertexSize = (VkDeviceSize)cache.header->vertexCount * sizeof(packed_vertex_t);
+    VkDeviceSize indexSize = (VkDeviceSize)cache.header->indexCount * sizeof(uint32_t);
+
+    VkDeviceMemory stagingMemory;
+    VkBuffer stagingBuffer = CreateBuffer(renderer, vertexSize + indexSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingMemory);
+
+    void *data;
+    if (vkMapMemory(renderer->logicalDevice, stagingMemory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+        FatalError("Failed to map staging buffer.");
+    }
+    memcpy(data, cache.vertices, vertexSize);
+    memcpy((uint8_t*)data + vertexSize, cache.indices, indexSize);
+    vkUnmapMemory(renderer->logicalDevice, stagingMemory);
+
+    renderer->meshIndexCount = cache.header->indexCount;
+    memcpy(renderer->meshOffset, cache.header->positionOffset, sizeof(renderer->meshOffset));
+    memcpy(renderer->meshScale, cache.header->positionScale, sizeof(renderer->meshScale));
+    memcpy(renderer->meshLods, cache.header->lods, cache.header->lodCount * sizeof(mesh_lod_t));
+    renderer->meshLodCount = cache.header->lodCount;
+    UnmapMeshCache(&cache);
+
+    renderer->meshVertexBuffer = CreateBuffer(renderer, vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &renderer->meshVertexMemory);
+    renderer->meshIndexBuffer = CreateBuffer(renderer, indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &renderer->meshIndexMemory);
+
+    VkCommandBuffer commandBuffer = BeginOneTimeCommands(renderer);
+    VkBufferCopy vertexCopy = { .srcOffset = 0, .dstOffset = 0, .size = vertexSize };
+    VkBufferCopy indexCopy = { .srcOffset = vertexSize, .dstOffset = 0, .size = indexSize };
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, renderer->meshVertexBuffer, 1, &vertexCopy);
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, renderer->meshIndexBuffer, 1, &indexCopy);
+    EndOneTimeCommands(renderer, commandBuffer);
+
+    vkDestroyBuffer(renderer->logicalDevice, stagingBuffer, NULL);
+    vkFreeMemory(renderer->logicalDevice, stagingMemory, NULL);
+}
+
+// Gives each instance the coarsest LOD whose error, scaled to the largest target's pixels, stays within --lod-error.
+// Meshes map their unit cube straight to normalized device coordinates times the instance's scale, so an error of e
+// moves a vertex at most e * scale * max(width, height) / 2 pixels, whatever the --animate rotation. The instance
+// buffer holds the instances grouped by LOD, still front to back within each group. Returns whether the groups changed,
+// in which case recorded command buffers draw the wrong ranges.
+bool SelectMeshLods(renderer_t *renderer) {
+    if (renderer->meshInstances == NULL) {
+        return false;
+    }
+
+    VkExtent2D extent = renderer->extent;
+    for (uint32_t i = 0; i < renderer->windowCount; i++) {
+        extent.width = MAX(extent.width, renderer->windows[i].extent.width);
+        extent.height = MAX(extent.height, renderer->windows[i].extent.height);
+    }
+    float pixelsPerUnit = (float)MAX(extent.width, extent.height) * 0.5f;
+
+    uint8_t *levels = malloc(renderer->instanceCount);
+    uint32_t counts[MESH_MAX_LODS] = {};
+    uint64_t triangles = 0;
+
+    for (uint32_t i = 0; i < renderer->instanceCount; i++) {
+        float scale = renderer->meshInstances[i].offsetScale[3];
+        uint32_t lod = 0;
+        while (lod + 1 < renderer->meshLodCount && renderer->meshLods[lod + 1].error * scale * pixelsPerUnit <= options.lodError) {
+            lod++;
+        }
+
+        levels[i] = (uint8_t)lod;
+        counts[lod]++;
+        triangles += renderer->meshLods[lod].indexCount / 3;
+    }
+
+    // An instance's LOD only depends on its scale, so equal counts mean the same groups.
+    if (memcmp(counts, renderer->lodInstanceCounts, sizeof(counts)) == 0) {
+        free(levels);
+        return false;
+    }
+
+    uint32_t next[MESH_MAX_LODS];
+    for (uint32_t lod = 0, first = 0; lod < MESH_MAX_LODS; lod++) {
+        next[lod] = first;
+        first += counts[lod];
+    }
+
+    instance_data_t *data;
+    if (vkMapMemory(renderer->logicalDevice, renderer->instanceMemory, 0, VK_WHOLE_SIZE, 0, (void**)&data) != VK_SUCCESS) {
+        FatalError("Failed to map instance buffer.");
+    }
+    for (uint32_t i = 0; i < renderer->instanceCount; i++) {
+        data[next[levels[i]]++] = renderer->meshInstances[i];
+    }
+    vkUnmapMemory(renderer->logicalDevice, renderer->instanceMemory);
+
+    memcpy(renderer->lodInstanceCounts, counts, sizeof(counts));
+    free(levels);
+
+    printf("Mesh LODs at %ux%u:", extent.width, extent.height);
+    for (uint32_t lod = 0; lod < renderer->meshLodCount; lod++) {
+        printf(" %u", counts[lod]);
+    }
+    printf(" instance(s) per level, %llu of %llu triangles.\n", (unsigned long long)triangles,
+           (unsigned long long)renderer->instanceCount * (renderer->meshLods[0].indexCount / 3));
+    return true;
+}
+
+// The instances are static and small, so host-visible memory is read by the GPU directly.
+void CreateSceneBuffers(renderer_t *renderer) {
+    if (options.scene == SCENE_TRIANGLE) {
+        return;
+    }
+
+    if (options.scene == SCENE_MESH) {
+        CreateMeshBuffers(renderer);
+    }
+
+    renderer->instanceCount = options.instanceCount;
+    VkDeviceSize size = (VkDeviceSize)renderer->instanceCount * sizeof(instance_data_t);
+
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+
+    if (vkCreateBuffer(renderer->logicalDevice, &bufferInfo, NULL, &renderer->instanceBuffer) != VK_SUCCESS) {
+        FatalError("Failed to create instance buffer.");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(renderer->logicalDevice, renderer->instanceBuffer, &requirements);
+    renderer->instanceMemory = AllocateMemory(renderer, requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    vkBindBufferMemory(renderer->logicalDevice, renderer->instanceBuffer, renderer->instanceMemory, 0);
+
+    instance_data_t *instances = GenerateInstancedScene(renderer->instanceCount);
+    for (uint32_t i = 0; i < renderer->instanceCount && renderer->materialCount > 0; i++) {
+        instances[i].material = renderer->materialSlots[i % renderer->materialCount];
+    }
+
+    // Kept, to group again by LOD whenever a target changes size.
+    if (options.scene == SCENE_MESH) {
+        renderer->meshInstances = instances;
+        SelectMeshLods(renderer);
+        return;
+    }
+
+    void *data;
+    if (vkMapMemory(renderer->logicalDevice, renderer->instanceMemory, 0, size, 0, &data) != VK_SUCCESS) {
+        FatalError("Failed to map instance buffer.");
+    }
+    memcpy(data, instances, size);
+    vkUnmapMemory(renderer->logicalDevice, renderer->instanceMemory);
+
+    free(instances);
+}
+
+// Transient attachments never need backing memory on tile-based GPUs, so prefer lazily allocated memory.
+attachment_image_t CreateAttachmentImage(renderer_t *renderer, VkFormat format, VkSampleCountFlagBits samples, VkImageUsageFlags usage, VkImageAspectFlags aspect, VkExtent2D extent) {
+    attachment_image_t attachment = {};
+
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = { .width = extent.width, .height = extent.height, .depth = 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = samples,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+
+    if (vkCreateImage(renderer->logicalDevice, &imageInfo, NULL, &attachment.image) != VK_SUCCESS) {
+        FatalError("Failed to create attachment image.");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(renderer->logicalDevice, attachment.image, &requirements);
+
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    if (FindMemoryType(renderer, requirements.memoryTypeBits, properties) == UINT32_MAX) {
+        properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    }
+
+    attachment.memory = AllocateMemory(renderer, requirements, properties);
+    vkBindImageMemory(renderer->logicalDevice, attachment.image, attachment.memory, 0);
+
+    attachment.view = CreateImageView(renderer, attachment.image, format, aspect, 1);
+
+    return attachment;
+}
+
+void DestroyAttachmentImage(renderer_t *renderer, attachment_image_t *attachment) {
+    vkDestroyImageView(renderer->logicalDevice, attachment->view, NULL);
+    vkDestroyImage(renderer->logicalDevice, attachment->image, NULL);
+    vkFreeMemory(renderer->logicalDevice, attachment->memory, NULL);
+    memset(attachment, 0, sizeof(attachment_image_t));
+}
+
+// Returns an empty attachment when multisampling is off.
+attachment_image_t CreateMSAAColorImage(renderer_t *renderer, VkExtent2D extent) {
+    if (renderer->sampleCount == VK_SAMPLE_COUNT_1_BIT) {
+        return (attachment_image_t){};
+    }
+
+    return CreateAttachmentImage(renderer, renderer->colorFormat, renderer->sampleCount, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, extent);
+}
+
+attachment_image_t CreateDepthImage(renderer_t *renderer, VkExtent2D extent) {
+    return CreateAttachmentImage(renderer, renderer->depthFormat, renderer->sampleCount, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, extent);
+}
+
+// Uploads the scene's triangles and creates the compute raster pipelines. Targets are created per window or offscreen.
+void CreateComputeRaster(renderer_t *renderer) {
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(renderer->physicalDevice, &queueFamilyCount, NULL);
+    VkQueueFamilyProperties *queueFamilies = calloc(queueFamilyCount, sizeof(VkQueueFamilyProperties));
+    vkGetPhysicalDeviceQueueFamilyProperties(renderer->physicalDevice, &queueFamilyCount, queueFamilies);
+    bool computeQueue = queueFamilies[renderer->queueFamilyIndices.graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT;
+    free(queueFamilies);
+
+    if (!computeQueue) {
+        FatalError("The graphics queue does not support compute, which the compute rasterizer needs.");
+    }
+
+    scene_triangle_t *triangles = BuildSceneTriangles(&renderer->triangleCount);
+    VkDeviceSize size = (VkDeviceSize)renderer->triangleCount * sizeof(scene_triangle_t);
+    renderer->triangleBuffer = CreateBuffer(renderer, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &renderer->triangleMemory);
+
+    void *data;
+    if (vkMapMemory(renderer->logicalDevice, renderer->triangleMemory, 0, size, 0, &data) != VK_SUCCESS) {
+        FatalError("Failed to map triangle buffer.");
+    }
+    memcpy(data, triangles, size);
+    vkUnmapMemory(renderer->logicalDevice, renderer->triangleMemory);
+
+    renderer->triangleBounds = malloc(MAX(renderer->triangleCount, 1) * sizeof(float[4]));
+    for (uint32_t i = 0; i < renderer->triangleCount; i++) {
+        const float (*positions)[4] = triangles[i].positions;
+        renderer->triangleBounds[i][0] = fminf(positions[0][0], fminf(positions[1][0], positions[2][0]));
+        renderer->triangleBounds[i][1] = fminf(positions[0][1], fminf(positions[1][1], positions[2][1]));
+        renderer->triangleBounds[i][2] = fmaxf(positions[0][0], fmaxf(positions[1][0], positions[2][0]));
+        renderer->triangleBounds[i][3] = fmaxf(positions[0][1], fmaxf(positions[1][1], positions[2][1]));
+    }
+    free(triangles);
+
+    // Storage image, triangles, tile bins and bin offsets, as declared in shaders/raster-*.comp and written by
+    // CreateComputeTarget().
+    VkDescriptorSetLayoutBinding bindings[] = {
+        { .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+        { .binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+        { .binding = 2, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+        { .binding = 3, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+    };
+
+    VkDescriptorSetLayout setLayout = GetDescriptorSetLayout(renderer, bindings, 4);
+
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(raster_constants_t),
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &setLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange,
+    };
+
+    if (vkCreatePipelineLayout(renderer->logicalDevice, &pipelineLayoutInfo, NULL, &renderer->rasterPipelineLayout) != VK_SUCCESS) {
+        FatalError("Failed to create compute raster pipeline layout.");
+    }
+
+    renderer->rasterBinPipeline = CreateComputePipeline(renderer, "raster-bin.comp.spv", renderer->rasterPipelineLayout);
+    renderer->rasterShadePipeline = CreateComputePipeline(renderer, "raster-shade.comp.spv", renderer->rasterPipelineLayout);
+}
+
+// Counts the triangles whose bounds, grown by a pixel for rounding, touch each tile, the way shaders/raster-bin.comp
+// bins them, and returns where each tile's list starts followed by the total. Back faces are counted too; they only
+// cost unused entries.
+uint32_t* BuildTileOffsets(renderer_t *renderer, VkExtent2D extent, uint32_t tilesX, uint32_t tilesY) {
+    uint32_t tileCount = tilesX * tilesY;
+    uint64_t *counts = calloc(tileCount, sizeof(uint64_t));
+
+    for (uint32_t i = 0; i < renderer->triangleCount; i++) {
+        const float *bounds = renderer->triangleBounds[i];
+        float minimum[2] = { (bounds[0] * 0.5f + 0.5f) * (float)extent.width - 1.0f, (bounds[1] * 0.5f + 0.5f) * (float)extent.height - 1.0f };
+        float maximum[2] = { (bounds[2] * 0.5f + 0.5f) * (float)extent.width + 1.0f, (bounds[3] * 0.5f + 0.5f) * (float)extent.height + 1.0f };
+        if (minimum[0] >= (float)extent.width || minimum[1] >= (float)extent.height || maximum[0] < 0.0f || maximum[1] < 0.0f) {
+            continue;
+        }
+
+        uint32_t firstX = (uint32_t)fminf(fmaxf(minimum[0], 0.0f), (float)extent.width - 1.0f) / RASTER_TILE_SIZE;
+        uint32_t firstY = (uint32_t)fminf(fmaxf(minimum[1], 0.0f), (float)extent.height - 1.0f) / RASTER_TILE_SIZE;
+        uint32_t lastX = (uint32_t)fminf(fmaxf(maximum[0], 0.0f), (float)extent.width - 1.0f) / RASTER_TILE_SIZE;
+        uint32_t lastY = (uint32_t)fminf(fmaxf(maximum[1], 0.0f), (float)extent.height - 1.0f) / RASTER_TILE_SIZE;
+
+        for (uint32_t y = firstY; y <= lastY; y++) {
+            for (uint32_t x = firstX; x <= lastX; x++) {
+                counts[y * tilesX + x]++;
+            }
+        }
+    }
+
+    uint32_t *offsets = malloc((tileCount + 1) * sizeof(uint32_t));
+    uint64_t total = 0;
+    for (uint32_t t = 0; t < tileCount; t++) {
+        offsets[t] = (uint32_t)total;
+        total += counts[t];
+        if (total > UINT32_MAX - tileCount) {
+            FatalError("The compute rasterizer's tile bins would need more than 2^32 entries; use fewer instances or a smaller size.");
+        }
+    }
+    offsets[tileCount] = (uint32_t)total;
+
+    free(counts);
+    return offsets;
+}
+
+// The storage image is blitted into output images of renderer->colorFormat, which must support it.
+// The target's descriptor set comes from the allocator and is released with it.
+void CreateComputeTarget(renderer_t *renderer, compute_target_t *compute, VkExtent2D extent, descriptor_allocator_t *descriptors) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(renderer->physicalDevice, renderer->colorFormat, &formatProperties);
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT)) {
+        FatalError("The output format cannot be blitted to, which the compute rasterizer needs.");
+    }
+
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = RASTER_STORAGE_FORMAT,
+        .extent = { .width = extent.width, .height = extent.height, .depth = 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+
+    if (vkCreateImage(renderer->logicalDevice, &imageInfo, NULL, &compute->color.image) != VK_SUCCESS) {
+        FatalError("Failed to create compute raster image.");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(renderer->logicalDevice, compute->color.image, &requirements);
+    compute->color.memory = AllocateMemory(renderer, requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    vkBindImageMemory(renderer->logicalDevice, compute->color.image, compute->color.memory, 0);
+    compute->color.view = CreateImageView(renderer, compute->color.image, RASTER_STORAGE_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+    compute->tilesX = (extent.width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    compute->tilesY = (extent.height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+
+    // Per-tile counts followed by every tile's triangle list. The scene is static, so the lists are sized once here.
+    uint32_t tileCount = compute->tilesX * compute->tilesY;
+    uint32_t *offsets = BuildTileOffsets(renderer, extent, compute->tilesX, compute->tilesY);
+    VkDeviceSize binSize = ((VkDeviceSize)tileCount + offsets[tileCount]) * sizeof(uint32_t);
+    if (binSize > renderer->deviceProperties.limits.maxStorageBufferRange) {
+        FatalError("The compute rasterizer's tile bins need %llu MiB, over the device's %u MiB storage buffer limit; use fewer instances or a smaller size.",
+                   (unsigned long long)(binSize >> 20), renderer->deviceProperties.limits.maxStorageBufferRange >> 20);
+    }
+
+    compute->binBuffer = CreateBuffer(renderer, binSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &compute->binMemory);
+
+    // Small and written once, so the shaders read it from host-visible memory.
+    VkDeviceSize offsetSize = ((VkDeviceSize)tileCount + 1) * sizeof(uint32_t);
+    compute->offsetBuffer = CreateBuffer(renderer, offsetSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &compute->offsetMemory);
+
+    void *data;
+    if (vkMapMemory(renderer->logicalDevice, compute->offsetMemory, 0, offsetSize, 0, &data) != VK_SUCCESS) {
+        FatalError("Failed to map tile offset buffer.");
+    }
+    memcpy(data, offsets, offsetSize);
+    vkUnmapMemory(renderer->logicalDevice, compute->offsetMemory);
+    free(offsets);
+
+    descriptor_set_builder_t builder = BeginDescriptorSet(descriptors);
+    AddDescriptorImage(&builder, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, compute->color.view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL);
+    AddDescriptorBuffer(&builder, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, renderer->triangleBuffer, 0, VK_WHOLE_SIZE);
+    AddDescriptorBuffer(&builder, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, compute->binBuffer, 0, VK_WHOLE_SIZE);
+    AddDescriptorBuffer(&builder, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, compute->offsetBuffer, 0, VK_WHOLE_SIZE);
+    compute->descriptorSet = BuildDescriptorSet(renderer, &builder, NULL);
+}
+
+// Safe on a target that was never created. The descriptor set goes with its allocator.
+void DestroyComputeTarget(renderer_t *renderer, compute_target_t *compute) {
+    vkDestroyBuffer(renderer->logicalDevice, compute->binBuffer, NULL);
+    vkFreeMemory(renderer->logicalDevice, compute->binMemory, NULL);
+    vkDestroyBuffer(renderer->logicalDevice, compute->offsetBuffer, NULL);
+    vkFreeMemory(renderer->logicalDevice, compute->offsetMemory, NULL);
+    DestroyAttachmentImage(renderer, &compute->color);
+    memset(compute, 0, sizeof(compute_target_t));
+}
+
+void RecordOffscreenFrame(renderer_t *renderer, offscreen_frame_t *frame, VkCommandBuffer commandBuffer, const render_target_t *renderTarget, bool depthPrepass) {
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = 0,
+        .pInheritanceInfo = NULL,
+    };
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        FatalError("Failed to begin recording command buffer.");
+    }
+
+    if (renderer->statisticsPool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(commandBuffer, renderer->statisticsPool, frame->statisticsQuery, 1);
+        vkCmdBeginQuery(commandBuffer, renderer->statisticsPool, frame->statisticsQuery, 0);
+    }
+
+    RecordRenderPass(renderer, commandBuffer, renderTarget, depthPrepass);
+
+    if (renderer->statisticsPool != VK_NULL_HANDLE) {
+        vkCmdEndQuery(commandBuffer, renderer->statisticsPool, frame->statisticsQuery);
+    }
+
+    VkBufferImageCopy region = {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+        .imageOffset = { .x = 0, .y = 0, .z = 0 },
+        .imageExtent = { .width = renderTarget->extent.width, .height = renderTarget->extent.height, .depth = 1 },
+    };
+
+    vkCmdCopyImageToBuffer(commandBuffer, frame->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frame->readbackBuffer, 1, &region);
+
+    VkBufferMemoryBarrier hostBarrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = frame->readbackBuffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &hostBarrier, 0, NULL);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        FatalError("Failed to record command buffer.");
+    }
+}
+
+render_target_t OffscreenRenderTarget(renderer_t *renderer, offscreen_frame_t *frame) {
+    return (render_target_t){
+        .image = frame->image,
+        .imageView = frame->imageView,
+        .msaaColor = renderer->offscreenMSAAColor,
+        .depth = renderer->offscreenDepth,
+        .framebuffer = frame->framebuffer,
+        .extent = renderer->extent,
+        .compute = &renderer->offscreenCompute,
+        .bindlessSet = (uint32_t)(frame - renderer->offscreenFrames),
+    };
+}
+
+void CreateOffscreenFrame(renderer_t *renderer, offscreen_frame_t *frame) {
+    VkExtent2D extent = renderer->extent;
+
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = renderer->colorFormat,
+        .extent = { .width = extent.width, .height = extent.height, .depth = 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+
+    if (vkCreateImage(renderer->logicalDevice, &imageInfo, NULL, &frame->image) != VK_SUCCESS) {
+        FatalError("Failed to create offscreen image.");
+    }
+
+    VkMemoryRequirements imageRequirements;
+    vkGetImageMemoryRequirements(renderer->logicalDevice, frame->image, &imageRequirements);
+    frame->imageMemory = AllocateMemory(renderer, imageRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    vkBindImageMemory(renderer->logicalDevice, frame->image, frame->imageMemory, 0);
+
+    frame->imageView = CreateImageView(renderer, frame->image, renderer->colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    render_target_t renderTarget = OffscreenRenderTarget(renderer, frame);
+
+    if (!renderer->dynamicRendering) {
+        frame->framebuffer = CreateFramebuffer(renderer, &renderTarget);
+        renderTarget.framebuffer = frame->framebuffer;
+    }
+
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = (VkDeviceSize)extent.width * extent.height * 4,
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+
+    if (vkCreateBuffer(renderer->logicalDevice, &bufferInfo, NULL, &frame->readbackBuffer) != VK_SUCCESS) {
+        FatalError("Failed to create readback buffer.");
+    }
+
+    VkMemoryRequirements bufferRequirements;
+    vkGetBufferMemoryRequirements(renderer->logicalDevice, frame->readbackBuffer, &bufferRequirements);
+
+    // Cached memory makes CPU reads of the frame much faster; fall back to coherent memory without it.
+    VkMemoryPropertyFlags readbackProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    if (FindMemoryType(renderer, bufferRequirements.memoryTypeBits, readbackProperties) == UINT32_MAX) {
+        readbackProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+
+    uint32_t readbackType = FindMemoryType(renderer, bufferRequirements.memoryTypeBits, readbackProperties);
+    frame->readbackCoherent = readbackType != UINT32_MAX && (renderer->memoryProperties.memoryTypes[readbackType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    frame->readbackMemory = AllocateMemory(renderer, bufferRequirements, readbackProperties);
+    vkBindBufferMemory(renderer->logicalDevice, frame->readbackBuffer, frame->readbackMemory, 0);
+
+    if (vkMapMemory(renderer->logicalDevice, frame->readbackMemory, 0, VK_WHOLE_SIZE, 0, &frame->readbackData) != VK_SUCCESS) {
+        FatalError("Failed to map readback buffer.");
+    }
+
+    VkCommandBufferAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = renderer->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 2,
+    };
+
+    if (vkAllocateCommandBuffers(renderer->logicalDevice, &allocateInfo, frame->commandBuffers) != VK_SUCCESS) {
+        FatalError("Failed to allocate offscreen command buffer.");
+    }
+
+    frame->fence = CreateFence(renderer, 0);
+
+    // Unless animated the scene is static, so both variants of the frame are recorded once and resubmitted.
+    RecordOffscreenFrame(renderer, frame, frame->commandBuffers[0], &renderTarget, false);
+    RecordOffscreenFrame(renderer, frame, frame->commandBuffers[1], &renderTarget, true);
+}
+
+#define PIPELINE_STATISTICS (VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | \
+                             VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
+
+void CreateStatisticsQueries(renderer_t *renderer) {
+    VkQueryPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+        .queryCount = OFFSCREEN_FRAMES_PER_DEVICE,
+        .pipelineStatistics = PIPELINE_STATISTICS,
+    };
+
+    if (vkCreateQueryPool(renderer->logicalDevice, &poolInfo, NULL, &renderer->statisticsPool) != VK_SUCCESS) {
+        FatalError("Failed to create pipeline statistics query pool.");
+    }
+}
+
+// Called once the frame's fence has signaled. Results come in bit order: primitives, vertex then fragment shader invocations.
+void ReadFrameStatistics(renderer_t *renderer, offscreen_frame_t *frame) {
+    uint64_t results[3];
+    if (vkGetQueryPoolResults(renderer->logicalDevice, renderer->statisticsPool, frame->statisticsQuery, 1, sizeof(results), results,
+                              sizeof(results), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        for (uint32_t i = 0; i < 3; i++) {
+            renderer->statistics[i] += results[i];
+        }
+        renderer->statisticsFrames++;
+    }
+}
+
+// Vertex shader invocations per primitive is the post-transform cache's miss ratio as the hardware sees it.
+void PrintPipelineStatistics(renderer_t *renderer) {
+    if (renderer->statisticsFrames == 0) {
+        return;
+    }
+
+    double frames = (double)renderer->statisticsFrames;
+    double primitives = (double)renderer->statistics[0];
+    printf("    per frame: %.0f primitives, %.0f vertex shader invocations (%.3f per primitive), %.0f fragment shader invocations\n",
+           primitives / frames, (double)renderer->statistics[1] / frames, primitives > 0 ? (double)renderer->statistics[1] / primitives : 0.0,
+           (double)renderer->statistics[2] / frames);
+}
+
+void CreateOffscreenFrames(renderer_t *renderer) {
+    if (options.pipelineStatistics) {
+        CreateStatisticsQueries(renderer);
+    }
+
+    renderer->offscreenMSAAColor = CreateMSAAColorImage(renderer, renderer->extent);
+    renderer->offscreenDepth = CreateDepthImage(renderer, renderer->extent);
+
+    if (renderer->computeRaster) {
+        CreateComputeTarget(renderer, &renderer->offscreenCompute, renderer->extent, &renderer->persistentDescriptors);
+    }
+
+    for (uint32_t i = 0; i < OFFSCREEN_FRAMES_PER_DEVICE; i++) {
+        renderer->offscreenFrames[i].statisticsQuery = i;
+        CreateOffscreenFrame(renderer, &renderer->offscreenFrames[i]);
+    }
+}
+
+// Builds a complete headless renderer on the device at deviceIndex, or on the selected device if deviceIndex is negative.
+void InitHeadlessRenderer(renderer_t *renderer, int64_t deviceIndex) {
+    memset(renderer, 0, sizeof(renderer_t));
+
+    InitVulkanInstance(renderer, NULL);
+
+    if (deviceIndex < 0) {
+        PickPhysicalVulkanDevice(renderer);
+    } else {
+        uint32_t deviceCount = 0;
+        device_candidate_t *candidates = EnumerateDeviceCandidates(renderer, false, &deviceCount);
+        if (deviceIndex >= deviceCount) {
+            FatalError("Vulkan device %lld disappeared.", (long long)deviceIndex);
+        }
+        UsePhysicalDevice(renderer, &candidates[deviceIndex]);
+        free(candidates);
+    }
+
+    renderer->colorFormat = OFFSCREEN_FORMAT;
+    renderer->extent = options.offscreenExtent;
+    renderer->computeRaster = options.raster == RASTER_COMPUTE;
+    renderer->bindless = options.bindless;
+    renderer->animate = options.animate;
+
+    CreateLogicalDevice(renderer);
+
+    if (renderer->computeRaster) {
+        CreateComputeRaster(renderer);
+    }
+    if (renderer->bindless) {
+        CreateBindlessTable(renderer, OFFSCREEN_FRAMES_PER_DEVICE);
+    }
+    CreateRenderPass(renderer);
+    CreateGraphicsPipeline(renderer);
+    CreateCommandPool(renderer);
+    if (renderer->bindless) {
+        CreateMaterials(renderer);
+    }
+    CreateSceneBuffers(renderer);
+    CreateOffscreenFrames(renderer);
+}
+
+void CreateWindowSwapchain(renderer_t *renderer, window_target_t *target) {
+    swapchain_support_details_t swapchainDetails = QuerySwapchainSupport(renderer->physicalDevice, target->surface);
+    if (swapchainDetails.formatCount == 0 || swapchainDetails.presentModeCount == 0) {
+        FatalError("No valid swapchain configuration found.");
+    }
+
+    CreateSwapChain(renderer, target, swapchainDetails);
+
+    FreeSwapchainSupportDetails(swapchainDetails);
+
+    CreateImageViews(renderer, target);
+    target->msaaColor = CreateMSAAColorImage(renderer, target->extent);
+    target->depth = CreateDepthImage(renderer, target->extent);
+
+    if (renderer->computeRaster) {
+        CreateComputeTarget(renderer, &target->compute, target->extent, &target->descriptors);
+    }
+}
+
+// All windows share the renderer's device, render pass and pipeline; each gets its own surface and swapchain.
+void InitWindowRenderer(renderer_t *renderer, SDL_Window **windows, uint32_t windowCount) {
+    memset(renderer, 0, sizeof(renderer_t));
+
+    renderer->windows = calloc(windowCount, sizeof(window_target_t));
+    renderer->windowCount = windowCount;
+
+    InitVulkanInstance(renderer, windows[0]);
+
+    for (uint32_t i = 0; i < windowCount; i++) {
+        renderer->windows[i].window = windows[i];
+        CreateVulkanSurface(renderer, &renderer->windows[i]);
+    }
+
+    PickPhysicalVulkanDevice(renderer);
+    renderer->computeRaster = options.raster == RASTER_COMPUTE;
+    renderer->bindless = options.bindless;
+    renderer->animate = options.animate;
+    CreateLogicalDevice(renderer);
+
+    if (renderer->computeRaster) {
+        CreateComputeRaster(renderer);
+    }
+    if (renderer->bindless) {
+        CreateBindlessTable(renderer, MAX_FRAMES_IN_FLIGHT);
+    }
+
+    for (uint32_t i = 0; i < windowCount; i++) {
+        CreateWindowSwapchain(renderer, &renderer->windows[i]);
+    }
+
+    CreateRenderPass(renderer);
+    CreateGraphicsPipeline(renderer);
+    CreateCommandPool(renderer);
+    if (renderer->bindless) {
+        CreateMaterials(renderer);
+    }
+    CreateSceneBuffers(renderer);
+
+    for (uint32_t i = 0; i < windowCount; i++) {
+        CreateFramebuffers(renderer, &renderer->windows[i]);
+        CreateCommandBuffers(renderer, &renderer->windows[i]);
+    }
+
+    CreateSyncObjects(renderer);
+
+    if (options.targetFrameRate > 0) {
+        CreateTimestampQueries(renderer);
+    }
+}
+
+// Leaves the surface alone, so the swapchain can be rebuilt on it.
+void DestroyWindowSwapchain(renderer_t *renderer, window_target_t *target) {
+    VkDevice device = renderer->logicalDevice;
+
+    if (target->commandBuffers) {
+        vkFreeCommandBuffers(device, renderer->commandPool, target->swapchainImageCount, target->commandBuffers);
+        vkFreeCommandBuffers(device, renderer->commandPool, target->swapchainImageCount, target->prepassCommandBuffers);
+    }
+
+    for (size_t i = 0; i < target->swapchainImageCount; i++) {
+        if (target->swapchainFramebuffers) {
+            vkDestroyFramebuffer(device, target->swapchainFramebuffers[i], NULL);
+        }
+        vkDestroyImageView(device, target->swapchainImageViews[i], NULL);
+    }
+
+    DestroyAttachmentImage(renderer, &target->msaaColor);
+    DestroyAttachmentImage(renderer, &target->depth);
+    DestroyComputeTarget(renderer, &target->compute);
+    ResetDescriptorAllocator(renderer, &target->descriptors);
+    vkDestroySwapchainKHR(device, target->swapchain, NULL);
+
+    free(target->imageFences);
+    free(target->prepassCommandBuffers);
+    free(target->commandBuffers);
+    free(target->swapchainFramebuffers);
+    free(target->swapchainImageViews);
+    free(target->swapchainImages);
+
+    // Timings of the old swapchain's presents will never be reported.
+    memset(target->pendingTimings, 0, sizeof(target->pendingTimings));
+
+    target->imageFences = NULL;
+    target->prepassCommandBuffers = NULL;
+    target->commandBuffers = NULL;
+    target->swapchainFramebuffers = NULL;
+    target->swapchainImageViews = NULL;
+    target->swapchainImages = NULL;
+    target->swapchainImageCount = 0;
+    target->swapchain = VK_NULL_HANDLE;
+}
+
+// Called when presentation reports the swapchain no longer matches its surface.
+void RecreateWindowSwapchain(renderer_t *renderer, window_target_t *target) {
+    vkDeviceWaitIdle(renderer->logicalDevice);
+
+    DestroyWindowSwapchain(renderer, target);
+    CreateWindowSwapchain(renderer, target);
+    CreateFramebuffers(renderer, target);
+
+    // The other windows draw the same instance buffer, so they are recorded again too if the LODs were regrouped.
+    bool regrouped = SelectMeshLods(renderer);
+    CreateCommandBuffers(renderer, target);
+
+    for (uint32_t i = 0; i < renderer->windowCount && regrouped; i++) {
+        for (uint32_t image = 0; image < renderer->windows[i].swapchainImageCount && &renderer->windows[i] != target; image++) {
+            RecordWindowCommandBuffer(renderer, &renderer->windows[i], image, false);
+            RecordWindowCommandBuffer(renderer, &renderer->windows[i], image, true);
+        }
+    }
+}
+
+void DestroyWindowTarget(renderer_t *renderer, window_target_t *target) {
+    DestroyWindowSwapchain(renderer, target);
+    DestroyDescriptorAllocator(renderer, &target->descriptors);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkDestroySemaphore(renderer->logicalDevice, target->imageAvailableSemaphores[i], NULL);
+    }
+    vkDestroySurfaceKHR(renderer->instance, target->surface, NULL);
+}
+
+// Removes one window from a running renderer, e.g. when the user closes it.
+void RemoveWindow(renderer_t *renderer, uint32_t index) {
+    vkDeviceWaitIdle(renderer->logicalDevice);
+
+    DestroyWindowTarget(renderer, &renderer->windows[index]);
+    SDL_DestroyWindow(renderer->windows[index].window);
+
+    renderer->windowCount--;
+    memmove(&renderer->windows[index], &renderer->windows[index + 1], (renderer->windowCount - index) * sizeof(window_target_t));
+}
+
+uint64_t NowNanoseconds(void) {
+    // CLOCK_MONOTONIC is the clock VK_GOOGLE_display_timing reports present times in.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+void AddLatencySample(latency_samples_t *samples, uint64_t start, uint64_t end) {
+    if (samples->count == samples->capacity) {
+        samples->capacity = MAX(samples->capacity * 2, 256);
+        samples->values = realloc(samples->values, samples->capacity * sizeof(double));
+    }
+
+    samples->values[samples->count++] = (double)(end - start) / 1.0e6;
+}
+
+// Pass a display time of zero when the frame's present time cannot be known.
+void CompleteFrameTiming(renderer_t *renderer, frame_timing_t *timing, uint64_t displayTime) {
+    latency_stats_t *latency = &renderer->latency;
+    AddLatencySample(&latency->record, timing->inputTime, timing->recordTime);
+    AddLatencySample(&latency->submit, timing->inputTime, timing->submitTime);
+    AddLatencySample(&latency->present, timing->inputTime, timing->presentTime);
+
+    // Display times earlier than the present call come from a different clock and are useless.
+    if (displayTime >= timing->presentTime) {
+        AddLatencySample(&latency->photon, timing->inputTime, displayTime);
+    }
+
+    timing->presentID = 0;
+}
+
+// Matches present times reported by the driver to the window's pending frames.
+void CollectPresentTimings(renderer_t *renderer, window_target_t *target) {
+    if (renderer->displayTiming) {
+        uint32_t count = 0;
+        renderer->vkGetPastPresentationTimingGOOGLE(renderer->logicalDevice, target->swapchain, &count, NULL);
+        if (count > 0) {
+            VkPastPresentationTimingGOOGLE *timings = calloc(count, sizeof(VkPastPresentationTimingGOOGLE));
+            renderer->vkGetPastPresentationTimingGOOGLE(renderer->logicalDevice, target->swapchain, &count, timings);
+
+            for (uint32_t i = 0; i < count; i++) {
+                frame_timing_t *timing = &target->pendingTimings[timings[i].presentID % LATENCY_PENDING_FRAMES];
+                if (timing->presentID == timings[i].presentID) {
+                    CompleteFrameTiming(renderer, timing, timings[i].actualPresentTime);
+                }
+            }
+
+            free(timings);
+        }
+    } else if (renderer->presentWait) {
+        // Polling only bounds the present time from above, to within one frame.
+        uint64_t now = NowNanoseconds();
+        for (uint32_t i = 0; i < LATENCY_PENDING_FRAMES; i++) {
+            frame_timing_t *timing = &target->pendingTimings[i];
+            if (timing->presentID != 0 && renderer->vkWaitForPresentKHR(renderer->logicalDevice, target->swapchain, timing->presentID, 0) == VK_SUCCESS) {
+                CompleteFrameTiming(renderer, timing, now);
+            }
+        }
+    }
+}
+
+// Queues the frame until its present time is reported. Without a timing extension it completes immediately.
+void TrackFrameTiming(renderer_t *renderer, window_target_t *target, frame_timing_t timing) {
+    if (!renderer->displayTiming && !renderer->presentWait) {
+        CompleteFrameTiming(renderer, &timing, 0);
+        return;
+    }
+
+    frame_timing_t *slot = &target->pendingTimings[timing.presentID % LATENCY_PENDING_FRAMES];
+    if (slot->presentID != 0) {
+        renderer->latency.droppedFrames++;
+    }
+    *slot = timing;
+}
+
+int CompareDoubles(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void PrintLatencySamples(const char *name, latency_samples_t *samples) {
+    if (samples->count == 0) {
+        printf("  %-18s no samples\n", name);
+        return;
+    }
+
+    qsort(samples->values, samples->count, sizeof(double), CompareDoubles);
+
+    double *v = samples->values;
+    size_t last = samples->count - 1;
+    printf("  %-18s min %7.2f  p50 %7.2f  p95 %7.2f  p99 %7.2f  max %7.2f ms (%zu frames)\n", name, v[0], v[last / 2], v[last * 95 / 100], v[last * 99 / 100], v[last], samples->count);
+}
+
+void PrintLatencyReport(renderer_t *renderer) {
+    latency_stats_t *latency = &renderer->latency;
+
+    printf("Latency from input sampling:\n");
+    PrintLatencySamples("to record", &latency->record);
+    PrintLatencySamples("to submit", &latency->submit);
+    PrintLatencySamples("to present call", &latency->present);
+    PrintLatencySamples("to photon", &latency->photon);
+
+    if (latency->droppedFrames > 0) {
+        printf("  %llu frames had no present timing reported in time.\n", (unsigned long long)latency->droppedFrames);
+    }
+}
+
+// Renders every window in one submission and presents all of their swapchains with a single vkQueuePresentKHR.
+// Windows that are minimized or whose swapchain went out of date sit the frame out.
+// inputTime is when the input this frame reflects was sampled, for latency measurement.
+void DrawFrame(renderer_t *renderer, uint64_t inputTime) {
+    uint32_t windowCount = renderer->windowCount;
+    uint32_t frame = renderer->currentFrame;
+    VkFence inFlightFence = renderer->inFlightFences[frame];
+
+    vkWaitForFences(renderer->logicalDevice, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+    UpdateTextureStreaming(renderer, frame);
+
+    if (renderer->timestampsPending[frame]) {
+        ReadFrameGPUTime(renderer, frame);
+    }
+
+    if (options.measureLatency) {
+        for (uint32_t i = 0; i < windowCount; i++) {
+            CollectPresentTimings(renderer, &renderer->windows[i]);
+        }
+    }
+
+    window_target_t **targets = calloc(windowCount, sizeof(window_target_t*));
+    uint32_t *imageIndices = calloc(windowCount, sizeof(uint32_t));
+    VkSemaphore *waitSemaphores = calloc(windowCount, sizeof(VkSemaphore));
+    VkPipelineStageFlags *waitStages = calloc(windowCount, sizeof(VkPipelineStageFlags));
+    // Room for the timestamp command buffers around the windows' own.
+    VkCommandBuffer *commandBuffers = calloc(windowCount + 2, sizeof(VkCommandBuffer));
+    uint32_t firstCommandBuffer = renderer->timestampPool != VK_NULL_HANDLE ? 1 : 0;
+    VkSwapchainKHR *swapchains = calloc(windowCount, sizeof(VkSwapchainKHR));
+    VkResult *presentResults = calloc(windowCount, sizeof(VkResult));
+    uint32_t *presentIDs = calloc(windowCount, sizeof(uint32_t));
+    uint64_t *presentIDs64 = calloc(windowCount, sizeof(uint64_t));
+    VkPresentTimeGOOGLE *presentTimes = calloc(windowCount, sizeof(VkPresentTimeGOOGLE));
+    uint32_t count = 0;
+
+    if (renderer->animate) {
+        if (renderer->animationStart == 0) {
+            renderer->animationStart = NowNanoseconds();
+        }
+        renderer->animationTime = (double)(NowNanoseconds() - renderer->animationStart) / 1e9;
+    }
+
+    for (uint32_t i = 0; i < windowCount; i++) {
+        window_target_t *target = &renderer->windows[i];
+        if (SDL_GetWindowFlags(target->window) & SDL_WINDOW_MINIMIZED) {
+            continue;
+        }
+
+        uint32_t imageIndex;
+        VkResult result = vkAcquireNextImageKHR(renderer->logicalDevice, target->swapchain, UINT64_MAX, target->imageAvailableSemaphores[frame], VK_NULL_HANDLE, &imageIndex);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            RecreateWindowSwapchain(renderer, target);
+            continue;
+        } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            FatalError("Failed to acquire swapchain image.");
+        }
+
+        if (target->imageFences[imageIndex] != VK_NULL_HANDLE) {
+            vkWaitForFences(renderer->logicalDevice, 1, &target->imageFences[imageIndex], VK_TRUE, UINT64_MAX);
+        }
+        target->imageFences[imageIndex] = inFlightFence;
+
+        // The image's previous frame has retired, so its command buffer can be recorded again. Streamed textures
+        // change the bindless slots per frame slot, so the command buffer must bind this slot's copy of the table.
+        if (renderer->animate || renderer->streamer) {
+            RecordWindowCommandBuffer(renderer, target, imageIndex, renderer->depthPrepass);
+        }
+
+        targets[count] = target;
+        imageIndices[count] = imageIndex;
+        waitSemaphores[count] = target->imageAvailableSemaphores[frame];
+        // The compute rasterizer first touches the swapchain image with its blit.
+        waitStages[count] = renderer->computeRaster ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        commandBuffers[firstCommandBuffer + count] = renderer->depthPrepass ? target->prepassCommandBuffers[imageIndex] : target->commandBuffers[imageIndex];
+        swapchains[count] = target->swapchain;
+        presentIDs[count] = ++target->nextPresentID;
+        presentIDs64[count] = presentIDs[count];
+        presentTimes[count] = (VkPresentTimeGOOGLE){ .presentID = presentIDs[count], .desiredPresentTime = 0 };
+        count++;
+    }
+
+    // Unless animated the command buffers are prerecorded, so recording is done once every image is acquired.
+    uint64_t recordTime = NowNanoseconds();
+
+    if (count > 0) {
+        VkSemaphore signalSemaphores[] = { renderer->renderFinishedSemaphores[frame] };
+
+        if (renderer->timestampPool != VK_NULL_HANDLE) {
+            commandBuffers[0] = renderer->timestampBeginCommands[frame];
+            commandBuffers[count + 1] = renderer->timestampEndCommands[frame];
+        }
+
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .waitSemaphoreCount = count,
+            .pWaitSemaphores = waitSemaphores,
+            .pWaitDstStageMask = waitStages,
+            .commandBufferCount = count + 2 * firstCommandBuffer,
+            .pCommandBuffers = commandBuffers,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = signalSemaphores,
+        };
+
+        vkResetFences(renderer->logicalDevice, 1, &inFlightFence);
+
+        uint64_t submitTime = NowNanoseconds();
+        if (vkQueueSubmit(renderer->graphicsQueue, 1, &submitInfo, inFlightFence) != VK_SUCCESS) {
+            FatalError("Failed to submit draw command buffer.");
+        }
+
+        renderer->timestampsPending[frame] = firstCommandBuffer != 0;
+        renderer->lastSubmitTime = submitTime;
+
+        VkPresentIdKHR presentIdInfo = {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+            .swapchainCount = count,
+            .pPresentIds = presentIDs64,
+        };
+
+        VkPresentTimesInfoGOOGLE presentTimesInfo = {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE,
+            .swapchainCount = count,
+            .pTimes = presentTimes,
+        };
+
+        const void *presentChain = NULL;
+        if (renderer->presentWait) {
+            presentIdInfo.pNext = presentChain;
+            presentChain = &presentIdInfo;
+        }
+        if (renderer->displayTiming) {
+            presentTimesInfo.pNext = presentChain;
+            presentChain = &presentTimesInfo;
+        }
+
+        // Present waits on the semaphore once for all swapchains in the batch.
+        VkPresentInfoKHR presentInfo = {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+            .pNext = presentChain,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = signalSemaphores,
+            .swapchainCount = count,
+            .pSwapchains = swapchains,
+            .pImageIndices = imageIndices,
+            .pResults = presentResults,
+        };
+
+        uint64_t presentTime = NowNanoseconds();
+        vkQueuePresentKHR(renderer->presentQueue, &presentInfo);
+
+        if (options.measureLatency) {
+            for (uint32_t i = 0; i < count; i++) {
+                frame_timing_t timing = {
+                    .presentID = presentIDs[i],
+                    .inputTime = inputTime,
+                    .recordTime = recordTime,
+                    .submitTime = submitTime,
+                    .presentTime = presentTime,
+                };
+                TrackFrameTiming(renderer, targets[i], timing);
+            }
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (presentResults[i] == VK_ERROR_OUT_OF_DATE_KHR || presentResults[i] == VK_SUBOPTIMAL_KHR) {
+                RecreateWindowSwapchain(renderer, targets[i]);
+            } else if (presentResults[i] != VK_SUCCESS) {
+                FatalError("Failed to present swapchain image.");
+            }
+        }
+
+        renderer->framesRendered++;
+        renderer->currentFrame = (frame + 1) % MAX_FRAMES_IN_FLIGHT;
+    }
+
+    free(presentTimes);
+    free(presentIDs64);
+    free(presentIDs);
+    free(presentResults);
+    free(swapchains);
+    free(commandBuffers);
+    free(waitStages);
+    free(waitSemaphores);
+    free(imageIndices);
+    free(targets);
+}
+
+void DestroyRenderer(renderer_t *renderer) {
+    VkDevice device = renderer->logicalDevice;
+
+    vkDeviceWaitIdle(device);
+
+    for (uint32_t i = 0; i < renderer->windowCount; i++) {
+        DestroyWindowTarget(renderer, &renderer->windows[i]);
+    }
+
+    // Headless renderers have no per-frame sync objects; destroying VK_NULL_HANDLE is a no-op.
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkDestroySemaphore(device, renderer->renderFinishedSemaphores[i], NULL);
+        vkDestroyFence(device, renderer->inFlightFences[i], NULL);
+    }
+
+    // Only headless renderers create offscreen frames.
+    for (uint32_t i = 0; i < OFFSCREEN_FRAMES_PER_DEVICE && renderer->offscreenFrames[i].image != VK_NULL_HANDLE; i++) {
+        offscreen_frame_t *frame = &renderer->offscreenFrames[i];
+        vkDestroyFence(device, frame->fence, NULL);
+        vkUnmapMemory(device, frame->readbackMemory);
+        vkDestroyBuffer(device, frame->readbackBuffer, NULL);
+        vkFreeMemory(device, frame->readbackMemory, NULL);
+        vkDestroyFramebuffer(device, frame->framebuffer, NULL);
+        vkDestroyImageView(device, frame->imageView, NULL);
+        vkDestroyImage(device, frame->image, NULL);
+        vkFreeMemory(device, frame->imageMemory, NULL);
+    }
+
+    DestroyAttachmentImage(renderer, &renderer->offscreenMSAAColor);
+    DestroyAttachmentImage(renderer, &renderer->offscreenDepth);
+    DestroyComputeTarget(renderer, &renderer->offscreenCompute);
+    vkDestroyPipeline(device, renderer->rasterShadePipeline, NULL);
+    vkDestroyPipeline(device, renderer->rasterBinPipeline, NULL);
+    vkDestroyPipelineLayout(device, renderer->rasterPipelineLayout, NULL);
+    vkDestroyPipeline(device, renderer->mipPipeline, NULL);
+    vkDestroyPipelineLayout(device, renderer->mipPipelineLayout, NULL);
+    DestroyDescriptorAllocator(renderer, &renderer->persistentDescriptors);
+    DestroyDescriptorLayoutCache(renderer);
+    vkDestroyBuffer(device, renderer->triangleBuffer, NULL);
+    vkFreeMemory(device, renderer->triangleMemory, NULL);
+    free(renderer->triangleBounds);
+    vkDestroyBuffer(device, renderer->instanceBuffer, NULL);
+    vkFreeMemory(device, renderer->instanceMemory, NULL);
+    vkDestroyBuffer(device, renderer->meshVertexBuffer, NULL);
+    vkFreeMemory(device, renderer->meshVertexMemory, NULL);
+    vkDestroyBuffer(device, renderer->meshIndexBuffer, NULL);
+    vkFreeMemory(device, renderer->meshIndexMemory, NULL);
+    for (uint32_t i = 0; i < renderer->materialCount && renderer->materialTextures; i++) {
+        DestroyTexture(renderer, &renderer->materialTextures[i]);
+    }
+    free(renderer->materialTextures);
+    free(renderer->materialSlots);
+    free(renderer->meshInstances);
+    StopTextureStreaming(renderer);
+    DestroyBindlessTable(renderer);
+    vkDestroyQueryPool(device, renderer->timestampPool, NULL);
+    vkDestroyQueryPool(device, renderer->statisticsPool, NULL);
+    vkDestroyCommandPool(device, renderer->commandPool, NULL);
+    vkDestroyPipeline(device, renderer->depthEqualPipeline, NULL);
+    vkDestroyPipeline(device, renderer->depthPrepassPipeline, NULL);
+    vkDestroyPipeline(device, renderer->graphicsPipeline, NULL);
+    vkDestroyPipelineLayout(device, renderer->pipelineLayout, NULL);
+    vkDestroyRenderPass(device, renderer->renderPass, NULL);
+    vkDestroyDevice(device, NULL);
+    vkDestroyInstance(renderer->instance, NULL);
+
+    free(renderer->windows);
+    free(renderer->latency.record.values);
+    free(renderer->latency.submit.values);
+    free(renderer->latency.present.values);
+    free(renderer->latency.photon.values);
+
+    memset(renderer, 0, sizeof(renderer_t));
+}
+
+void InitFramePacer(frame_pacer_t *pacer, double targetFrameRate) {
+    memset(pacer, 0, sizeof(frame_pacer_t));
+    if (targetFrameRate > 0) {
+        pacer->period = (uint64_t)(1.0e9 / targetFrameRate);
+    }
+}
+
+// Sleeps coarsely, then spins out the last couple of milliseconds that SDL_Delay cannot hit reliably.
+void SleepUntil(uint64_t deadline) {
+    const uint64_t spinThreshold = 2000000;
+
+    uint64_t now = NowNanoseconds();
+    while (now < deadline) {
+        if (deadline - now > spinThreshold) {
+            SDL_Delay((Uint32)((deadline - now - spinThreshold) / 1000000));
+        }
+        now = NowNanoseconds();
+    }
+}
+
+// The worst frame of the recent history plus a margin, so a single slow frame does not blow the deadline.
+uint64_t PredictFrameTime(frame_pacer_t *pacer) {
+    const uint64_t safetyMargin = 500000;
+
+    uint64_t cpuTime = 0;
+    uint64_t gpuTime = 0;
+    for (uint32_t i = 0; i < PACER_HISTORY; i++) {
+        cpuTime = MAX(cpuTime, pacer->cpuTimes[i]);
+        gpuTime = MAX(gpuTime, pacer->gpuTimes[i]);
+    }
+
+    return cpuTime + gpuTime + safetyMargin;
+}
+
+// Call before sampling input. Waits until just late enough for the frame to finish by its deadline.
+void PaceFrame(frame_pacer_t *pacer) {
+    if (pacer->period == 0) {
+        return;
+    }
+
+    uint64_t now = NowNanoseconds();
+    uint64_t predicted = PredictFrameTime(pacer);
+
+    if (pacer->nextDeadline < now + predicted) {
+        // First frame, or the deadline is already lost: start now and realign the cadence on this frame.
+        pacer->nextDeadline = now + predicted;
+    } else {
+        SleepUntil(pacer->nextDeadline - predicted);
+    }
+}
+
+// Call after the frame is submitted, with the renderer's latest submit and GPU times.
+void FinishPacedFrame(frame_pacer_t *pacer, uint64_t inputTime, uint64_t submitTime, uint64_t gpuTime) {
+    if (pacer->period == 0) {
+        return;
+    }
+
+    pacer->cpuTimes[pacer->historyIndex] = submitTime > inputTime ? submitTime - inputTime : 0;
+    pacer->gpuTimes[pacer->historyIndex] = gpuTime;
+    pacer->historyIndex = (pacer->historyIndex + 1) % PACER_HISTORY;
+    pacer->nextDeadline += pacer->period;
+}
+
+bool UseDepthPrepass(uint64_t frameIndex) {
+    switch (options.depthPrepass) {
+        case DEPTH_PREPASS_ON: return true;
+        case DEPTH_PREPASS_ALTERNATE: return frameIndex % 2 == 1;
+        default: return false;
+    }
+}
+
+// Call as each frame starts. The time until the next frame starts is charged to this frame's mode,
+// which in steady state is the GPU time the mode costs.
+void RecordPrepassFrame(prepass_stats_t *stats, bool depthPrepass) {
+    uint64_t now = NowNanoseconds();
+    if (stats->lastFrameStart != 0) {
+        stats->frames[stats->lastPrepass]++;
+        stats->nanoseconds[stats->lastPrepass] += now - stats->lastFrameStart;
+    }
+
+    stats->lastFrameStart = now;
+    stats->lastPrepass = depthPrepass;
+}
+
+void PrintPrepassStats(const prepass_stats_t *stats) {
+    const char *names[] = { "without depth pre-pass", "with depth pre-pass" };
+
+    for (uint32_t i = 0; i < 2; i++) {
+        if (stats->frames[i] > 0) {
+            double milliseconds = (double)stats->nanoseconds[i] / (double)stats->frames[i] / 1.0e6;
+            printf("  %-24s %8llu frames, %.3f ms/frame\n", names[i], (unsigned long long)stats->frames[i], milliseconds);
+        }
+    }
+}
+
+// Snaps a normalized device coordinate to the viewport's pixel grid with the given number of sub-pixel bits.
+double SnapToSubpixel(float ndc, uint32_t size, uint32_t subpixelBits) {
+    double scale = (double)(1u << subpixelBits);
+    double pixels = ((double)ndc * 0.5 + 0.5) * size;
+    return floor(pixels * scale + 0.5) / scale;
+}
+
+// Returns false for triangles that are culled or entirely off screen.
+bool SetupReferenceTriangle(const scene_triangle_t *triangle, VkExtent2D extent, uint32_t subpixelBits, reference_triangle_t *out) {
+    double x[3], y[3];
+    for (uint32_t v = 0; v < 3; v++) {
+        x[v] = SnapToSubpixel(triangle->positions[v][0], extent.width, subpixelBits);
+        y[v] = SnapToSubpixel(triangle->positions[v][1], extent.height, subpixelBits);
+    }
+
+    // Clockwise front faces, as in the graphics pipeline; back faces and degenerate triangles are culled.
+    out->area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (out->area <= 0) {
+        return false;
+    }
+
+    for (uint32_t e = 0; e < 3; e++) {
+        uint32_t from = (e + 1) % 3;
+        uint32_t to = (e + 2) % 3;
+        double dx = x[to] - x[from];
+        double dy = y[to] - y[from];
+
+        out->a[e] = -dy;
+        out->b[e] = dx;
+        out->c[e] = dy * x[from] - dx * y[from];
+        out->topLeft[e] = dy < 0 || (dy == 0 && dx > 0);
+    }
+
+    for (uint32_t i = 0; i < 3; i++) {
+        double *coefficients = i == 0 ? out->a : i == 1 ? out->b : out->c;
+        out->depthPlane[i] = (coefficients[0] * triangle->positions[0][2] +
+                              coefficients[1] * triangle->positions[1][2] +
+                              coefficients[2] * triangle->positions[2][2]) / out->area;
+    }
+
+    out->minDepth = MIN(triangle->positions[0][2], MIN(triangle->positions[1][2], triangle->positions[2][2]));
+    memcpy(out->colors, triangle->colors, sizeof(out->colors));
+
+    out->minX = (int32_t)MAX(floor(MIN(x[0], MIN(x[1], x[2]))), 0);
+    out->minY = (int32_t)MAX(floor(MIN(y[0], MIN(y[1], y[2]))), 0);
+    out->maxX = (int32_t)MIN(ceil(MAX(x[0], MAX(x[1], x[2]))), (double)extent.width - 1);
+    out->maxY = (int32_t)MIN(ceil(MAX(y[0], MAX(y[1], y[2]))), (double)extent.height - 1);
+
+    return out->minX <= out->maxX && out->minY <= out->maxY;
+}
+
+// The span kernels round every multiply and add separately. A fused multiply-add in some kernels and not others
+// would round edge values differently, and pixels exactly on an edge would then depend on the kernel.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+void RasterizeSpanTail(const reference_span_t *span, uint32_t start, uint32_t count, float *depth, uint32_t *ids) {
+    for (uint32_t k = start; k < count; k++) {
+        bool inside = true;
+        for (uint32_t e = 0; e < 3; e++) {
+            float w = span->w[e] + span->dw[e] * (float)k;
+            inside = inside && (w > 0.0f || (w == 0.0f && span->topLeft[e]));
+        }
+
+        float z = span->depth + span->dDepth * (float)k;
+        if (inside && z >= 0.0f && z < depth[k]) {
+            depth[k] = z;
+            ids[k] = span->index;
+        }
+    }
+}
+
+void RasterizeSpanScalar(const reference_span_t *span, uint32_t count, float *depth, uint32_t *ids) {
+    RasterizeSpanTail(span, 0, count, depth, ids);
+}
+
+// The SIMD kernels compute every value with the same operations as RasterizeSpanTail(), so with contraction off all
+// kernels agree bit for bit.
+#if defined(__SSE2__)
+void RasterizeSpanSSE(const reference_span_t *span, uint32_t count, float *depth, uint32_t *ids) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128i index = _mm_set1_epi32((int)span->index);
+
+    uint32_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 offset = _mm_add_ps(_mm_set1_ps((float)k), lanes);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for (uint32_t e = 0; e < 3; e++) {
+            __m128 w = _mm_add_ps(_mm_set1_ps(span->w[e]), _mm_mul_ps(_mm_set1_ps(span->dw[e]), offset));
+            __m128 onEdge = _mm_and_ps(_mm_cmpeq_ps(w, zero), _mm_castsi128_ps(_mm_set1_epi32(-(int32_t)span->topLeft[e])));
+            inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(w, zero), onEdge));
+        }
+
+        __m128 z = _mm_add_ps(_mm_set1_ps(span->depth), _mm_mul_ps(_mm_set1_ps(span->dDepth), offset));
+        __m128 stored = _mm_loadu_ps(depth + k);
+        __m128 pass = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmplt_ps(z, stored)));
+
+        _mm_storeu_ps(depth + k, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, stored)));
+
+        __m128i passMask = _mm_castps_si128(pass);
+        __m128i storedIDs = _mm_loadu_si128((const __m128i*)(ids + k));
+        _mm_storeu_si128((__m128i*)(ids + k), _mm_or_si128(_mm_and_si128(passMask, index), _mm_andnot_si128(passMask, storedIDs)));
+    }
+
+    RasterizeSpanTail(span, k, count, depth, ids);
+}
+#endif
+
+#if defined(REFERENCE_AVX2)
+__attribute__((target("avx2")))
+void RasterizeSpanAVX2(const reference_span_t *span, uint32_t count, float *depth, uint32_t *ids) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 index = _mm256_castsi256_ps(_mm256_set1_epi32((int)span->index));
+
+    uint32_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256 offset = _mm256_add_ps(_mm256_set1_ps((float)k), lanes);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+        for (uint32_t e = 0; e < 3; e++) {
+            __m256 w = _mm256_add_ps(_mm256_set1_ps(span->w[e]), _mm256_mul_ps(_mm256_set1_ps(span->dw[e]), offset));
+            __m256 onEdge = _mm256_and_ps(_mm256_cmp_ps(w, zero, _CMP_EQ_OQ), _mm256_castsi256_ps(_mm256_set1_epi32(-(int32_t)span->topLeft[e])));
+            inside = _mm256_and_ps(inside, _mm256_or_ps(_mm256_cmp_ps(w, zero, _CMP_GT_OQ), onEdge));
+        }
+
+        __m256 z = _mm256_add_ps(_mm256_set1_ps(span->depth), _mm256_mul_ps(_mm256_set1_ps(span->dDepth), offset));
+        __m256 stored = _mm256_loadu_ps(depth + k);
+        __m256 pass = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(z, zero, _CMP_GE_OQ), _mm256_cmp_ps(z, stored, _CMP_LT_OQ)));
+
+        _mm256_storeu_ps(depth + k, _mm256_blendv_ps(stored, z, pass));
+
+        __m256 storedIDs = _mm256_loadu_ps((const float*)(ids + k));
+        _mm256_storeu_ps((float*)(ids + k), _mm256_blendv_ps(storedIDs, index, pass));
+    }
+
+    RasterizeSpanTail(span, k, count, depth, ids);
+}
+#endif
+
+#if defined(__ARM_NEON)
+void RasterizeSpanNEON(const reference_span_t *span, uint32_t count, float *depth, uint32_t *ids) {
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float laneValues[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    const float32x4_t lanes = vld1q_f32(laneValues);
+    const uint32x4_t index = vdupq_n_u32(span->index);
+
+    uint32_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        float32x4_t offset = vaddq_f32(vdupq_n_f32((float)k), lanes);
+        uint32x4_t inside = vdupq_n_u32(UINT32_MAX);
+
+        for (uint32_t e = 0; e < 3; e++) {
+            // Separate multiply and add rather than vmlaq_f32, which may fuse and round differently.
+            float32x4_t w = vaddq_f32(vdupq_n_f32(span->w[e]), vmulq_f32(vdupq_n_f32(span->dw[e]), offset));
+            uint32x4_t onEdge = vandq_u32(vceqq_f32(w, zero), vdupq_n_u32(span->topLeft[e] ? UINT32_MAX : 0));
+            inside = vandq_u32(inside, vorrq_u32(vcgtq_f32(w, zero), onEdge));
+        }
+
+        float32x4_t z = vaddq_f32(vdupq_n_f32(span->depth), vmulq_f32(vdupq_n_f32(span->dDepth), offset));
+        float32x4_t stored = vld1q_f32(depth + k);
+        uint32x4_t pass = vandq_u32(inside, vandq_u32(vcgeq_f32(z, zero), vcltq_f32(z, stored)));
+
+        vst1q_f32(depth + k, vbslq_f32(pass, z, stored));
+        vst1q_u32(ids + k, vbslq_u32(pass, index, vld1q_u32(ids + k)));
+    }
+
+    RasterizeSpanTail(span, k, count, depth, ids);
+}
+#endif
+
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT ON
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+reference_span_kernel_t ChooseSpanKernel(const char **nameOut) {
+#if defined(REFERENCE_AVX2)
+    if (SDL_HasAVX2()) {
+        *nameOut = "AVX2";
+        return RasterizeSpanAVX2;
+    }
+#endif
+#if defined(__SSE2__)
+    *nameOut = "SSE2";
+    return RasterizeSpanSSE;
+#elif defined(__ARM_NEON)
+    *nameOut = "NEON";
+    return RasterizeSpanNEON;
+#else
+    *nameOut = "scalar";
+    return RasterizeSpanScalar;
+#endif
+}
+
+// Interpolates the covering triangle's vertex colors at the pixel center, as the fragment shader does.
+void ShadeReferencePixel(const reference_triangle_t *triangle, double x, double y, uint8_t *pixel) {
+    double w[3];
+    for (uint32_t e = 0; e < 3; e++) {
+        w[e] = (triangle->a[e] * x + triangle->b[e] * y + triangle->c[e]) / triangle->area;
+    }
+
+    for (uint32_t channel = 0; channel < 3; channel++) {
+        double value = w[0] * triangle->colors[0][channel] + w[1] * triangle->colors[1][channel] + w[2] * triangle->colors[2][channel];
+        pixel[channel] = (uint8_t)floor(MIN(MAX(value, 0.0), 1.0) * 255.0 + 0.5);
+    }
+    pixel[3] = 255;
+}
+
+int RasterizeReferenceTiles(void *data) {
+    reference_job_t *job = data;
+    reference_image_t *image = job->image;
+    uint32_t tileCount = job->tilesX * job->tilesY;
+
+    float depth[REFERENCE_TILE_SIZE * REFERENCE_TILE_SIZE];
+    uint32_t ids[REFERENCE_TILE_SIZE * REFERENCE_TILE_SIZE];
+
+    for (;;) {
+        uint32_t tile = (uint32_t)SDL_AtomicAdd(&job->nextTile, 1);
+        if (tile >= tileCount) {
+            break;
+        }
+
+        int32_t tileX = (int32_t)(tile % job->tilesX) * REFERENCE_TILE_SIZE;
+        int32_t tileY = (int32_t)(tile / job->tilesX) * REFERENCE_TILE_SIZE;
+        int32_t tileMaxX = MIN(tileX + REFERENCE_TILE_SIZE, (int32_t)image->extent.width) - 1;
+        int32_t tileMaxY = MIN(tileY + REFERENCE_TILE_SIZE, (int32_t)image->extent.height) - 1;
+
+        for (uint32_t i = 0; i < REFERENCE_TILE_SIZE * REFERENCE_TILE_SIZE; i++) {
+            depth[i] = 1.0f;
+            ids[i] = REFERENCE_BACKGROUND;
+        }
+
+        // Farthest depth in the tile. Triangles entirely behind it cannot pass the depth test anywhere in the tile, which
+        // with a front-to-back scene rejects most of them without touching a pixel. Pixels outside the image stay at 1.
+        float tileMaxDepth = 1.0f;
+
+        for (uint32_t i = job->tileStarts[tile]; i < job->tileStarts[tile + 1]; i++) {
+            uint32_t index = job->tileTriangles[i];
+            const reference_triangle_t *triangle = &job->triangles[index];
+            if (triangle->minDepth >= tileMaxDepth) {
+                continue;
+            }
+            int32_t minX = MAX(triangle->minX, tileX);
+            int32_t maxX = MIN(triangle->maxX, tileMaxX);
+
+            for (int32_t y = MAX(triangle->minY, tileY); y <= MIN(triangle->maxY, tileMaxY); y++) {
+                double centerX = minX + 0.5;
+                double centerY = y + 0.5;
+
+                reference_span_t span = {
+                    .depth = (float)(triangle->depthPlane[0] * centerX + triangle->depthPlane[1] * centerY + triangle->depthPlane[2]),
+                    .dDepth = (float)triangle->depthPlane[0],
+                    .index = index,
+                };
+
+                for (uint32_t e = 0; e < 3; e++) {
+                    span.w[e] = (float)(triangle->a[e] * centerX + triangle->b[e] * centerY + triangle->c[e]);
+                    span.dw[e] = (float)triangle->a[e];
+                    span.topLeft[e] = triangle->topLeft[e];
+                }
+
+                uint32_t offset = (uint32_t)(y - tileY) * REFERENCE_TILE_SIZE + (uint32_t)(minX - tileX);
+                job->kernel(&span, (uint32_t)(maxX - minX + 1), depth + offset, ids + offset);
+            }
+
+            tileMaxDepth = 0.0f;
+            for (uint32_t p = 0; p < REFERENCE_TILE_SIZE * REFERENCE_TILE_SIZE; p++) {
+                tileMaxDepth = MAX(tileMaxDepth, depth[p]);
+            }
+        }
+
+        for (int32_t y = tileY; y <= tileMaxY; y++) {
+            for (int32_t x = tileX; x <= tileMaxX; x++) {
+                size_t pixel = (size_t)y * image->extent.width + (size_t)x;
+                uint32_t id = ids[(y - tileY) * REFERENCE_TILE_SIZE + (x - tileX)];
+
+                image->ids[pixel] = id;
+                if (id == REFERENCE_BACKGROUND) {
+                    // The clear color, as the UNORM attachment stores it.
+                    uint8_t *out = &image->pixels[pixel * 4];
+                    out[0] = out[1] = out[2] = (uint8_t)floor(0.3 * 255.0 + 0.5);
+                    out[3] = 255;
+                } else {
+                    ShadeReferencePixel(&job->triangles[id], x + 0.5, y + 0.5, &image->pixels[pixel * 4]);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+void MarkReferenceEdges(reference_image_t *image) {
+    int32_t width = (int32_t)image->extent.width;
+    int32_t height = (int32_t)image->extent.height;
+
+    for (int32_t y = 0; y < height; y++) {
+        for (int32_t x = 0; x < width; x++) {
+            uint32_t id = image->ids[(size_t)y * width + x];
+            bool edge = false;
+
+            for (int32_t dy = -1; dy <= 1 && !edge; dy++) {
+                for (int32_t dx = -1; dx <= 1 && !edge; dx++) {
+                    int32_t nx = x + dx;
+                    int32_t ny = y + dy;
+                    edge = nx >= 0 && ny >= 0 && nx < width && ny < height && image->ids[(size_t)ny * width + nx] != id;
+                }
+            }
+
+            image->edges[(size_t)y * width + x] = edge;
+        }
+    }
+}
+
+// Renders the scene on the CPU: triangles are binned into tiles in draw order, then the tiles are rasterized
+// in parallel, each tile keeping the nearest triangle per pixel as a LESS depth test would.
+void RenderReferenceImage(reference_image_t *image, VkExtent2D extent, uint32_t subpixelBits) {
+    uint32_t triangleCount;
+    scene_triangle_t *sceneTriangles = BuildSceneTriangles(&triangleCount);
+    reference_triangle_t *triangles = calloc(triangleCount, sizeof(reference_triangle_t));
+    bool *visible = calloc(triangleCount, sizeof(bool));
+
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        visible[i] = SetupReferenceTriangle(&sceneTriangles[i], extent, subpixelBits, &triangles[i]);
+    }
+    free(sceneTriangles);
+
+    reference_job_t job = {
+        .image = image,
+        .triangles = triangles,
+        .tilesX = (extent.width + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE,
+        .tilesY = (extent.height + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE,
+    };
+
+    const char *kernelName;
+    job.kernel = ChooseSpanKernel(&kernelName);
+
+    // Count each tile's triangles, turn the counts into offsets, then fill the lists in draw order.
+    uint32_t tileCount = job.tilesX * job.tilesY;
+    job.tileStarts = calloc(tileCount + 1, sizeof(uint32_t));
+
+    for (uint32_t pass = 0; pass < 2; pass++) {
+        uint32_t *cursors = pass ? calloc(tileCount, sizeof(uint32_t)) : NULL;
+
+        for (uint32_t i = 0; i < triangleCount; i++) {
+            if (!visible[i]) {
+                continue;
+            }
+
+            for (int32_t ty = triangles[i].minY / REFERENCE_TILE_SIZE; ty <= triangles[i].maxY / REFERENCE_TILE_SIZE; ty++) {
+                for (int32_t tx = triangles[i].minX / REFERENCE_TILE_SIZE; tx <= triangles[i].maxX / REFERENCE_TILE_SIZE; tx++) {
+                    uint32_t tile = (uint32_t)ty * job.tilesX + (uint32_t)tx;
+                    if (pass == 0) {
+                        job.tileStarts[tile + 1]++;
+                    } else {
+                        job.tileTriangles[job.tileStarts[tile] + cursors[tile]++] = i;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (uint32_t t = 0; t < tileCount; t++) {
+                job.tileStarts[t + 1] += job.tileStarts[t];
+            }
+            job.tileTriangles = malloc(MAX(job.tileStarts[tileCount], 1) * sizeof(uint32_t));
+        }
+
+        free(cursors);
+    }
+
+    image->extent = extent;
+    image->pixels = malloc((size_t)extent.width * extent.height * 4);
+    image->ids = malloc((size_t)extent.width * extent.height * sizeof(uint32_t));
+    image->edges = malloc((size_t)extent.width * extent.height);
+
+    uint32_t threadCount = (uint32_t)MAX(SDL_GetCPUCount(), 1);
+    SDL_Thread **threads = calloc(threadCount, sizeof(SDL_Thread*));
+    Uint64 startTime = SDL_GetPerformanceCounter();
+
+    // The calling thread works too, so a failed thread creation only costs parallelism.
+    for (uint32_t i = 1; i < threadCount; i++) {
+        threads[i] = SDL_CreateThread(RasterizeReferenceTiles, "reference", &job);
+    }
+    RasterizeReferenceTiles(&job);
+    for (uint32_t i = 1; i < threadCount; i++) {
+        if (threads[i]) {
+            SDL_WaitThread(threads[i], NULL);
+        }
+    }
+
+    double seconds = (double)(SDL_GetPerformanceCounter() - startTime) / (double)SDL_GetPerformanceFrequency();
+    printf("Rendered the CPU reference in %.1f ms with %u thread(s) and %s kernels.\n", seconds * 1000.0, threadCount, kernelName);
+
+    MarkReferenceEdges(image);
+
+    free(threads);
+    free(job.tileTriangles);
+    free(job.tileStarts);
+    free(visible);
+    free(triangles);
+}
+
+void DestroyReferenceImage(reference_image_t *image) {
+    free(image->pixels);
+    free(image->ids);
+    free(image->edges);
+    memset(image, 0, sizeof(reference_image_t));
+}
+
+// Compares a read back frame with the reference per tile. Differences on triangle edges are reported apart from
+// those inside triangles: the former are usually rasterization rule or precision differences, the latter real bugs.
+// Returns false if any pixel inside a triangle or the background differs by more than the tolerance.
+bool ValidateFrame(validation_t *validation, const uint8_t *pixels, uint64_t frameIndex) {
+    const uint32_t maxReportedTiles = 8;
+
+    reference_image_t *reference = &validation->reference;
+    uint32_t tilesX = (reference->extent.width + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE;
+    uint32_t tilesY = (reference->extent.height + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE;
+    uint32_t mismatchedTiles = 0;
+    uint64_t frameEdgeMismatches = 0;
+    uint64_t frameInteriorMismatches = 0;
+
+    for (uint32_t ty = 0; ty < tilesY; ty++) {
+        for (uint32_t tx = 0; tx < tilesX; tx++) {
+            uint32_t edgeMismatches = 0;
+            uint32_t interiorMismatches = 0;
+            int maxDifference = 0;
+
+            uint32_t maxX = MIN((tx + 1) * REFERENCE_TILE_SIZE, reference->extent.width);
+            uint32_t maxY = MIN((ty + 1) * REFERENCE_TILE_SIZE, reference->extent.height);
+
+            for (uint32_t y = ty * REFERENCE_TILE_SIZE; y < maxY; y++) {
+                for (uint32_t x = tx * REFERENCE_TILE_SIZE; x < maxX; x++) {
+                    size_t pixel = (size_t)y * reference->extent.width + x;
+                    int difference = 0;
+                    for (uint32_t channel = 0; channel < 3; channel++) {
+                        difference = MAX(difference, abs((int)pixels[pixel * 4 + channel] - (int)reference->pixels[pixel * 4 + channel]));
+                    }
+
+                    if (difference > (int)options.validateTolerance) {
+                        if (reference->edges[pixel]) {
+                            edgeMismatches++;
+                        } else {
+                            interiorMismatches++;
+                        }
+                        maxDifference = MAX(maxDifference, difference);
+                    }
+                }
+            }
+
+            if (edgeMismatches + interiorMismatches == 0) {
+                continue;
+            }
+
+            if (mismatchedTiles < maxReportedTiles) {
+                printf("  Frame %llu, tile (%u, %u): %u edge and %u interior pixel(s) differ, by up to %d.\n",
+                       (unsigned long long)frameIndex, tx, ty, edgeMismatches, interiorMismatches, maxDifference);
+            }
+
+            mismatchedTiles++;
+            frameEdgeMismatches += edgeMismatches;
+            frameInteriorMismatches += interiorMismatches;
+        }
+    }
+
+    if (mismatchedTiles > maxReportedTiles) {
+        printf("  Frame %llu: %u more tile(s) differ.\n", (unsigned long long)frameIndex, mismatchedTiles - maxReportedTiles);
+    }
+
+    validation->framesChecked++;
+    validation->edgeMismatches += frameEdgeMismatches;
+    validation->interiorMismatches += frameInteriorMismatches;
+
+    if (frameInteriorMismatches > 0) {
+        validation->framesFailed++;
+        return false;
+    }
+
+    return true;
+}
+
+void PrintValidationReport(const validation_t *validation) {
+    printf("Validation: %llu of %llu frame(s) match the CPU reference within %u; %llu edge and %llu interior pixel(s) differ in total.\n",
+           (unsigned long long)(validation->framesChecked - validation->framesFailed),
+           (unsigned long long)validation->framesChecked,
+           options.validateTolerance,
+           (unsigned long long)validation->edgeMismatches,
+           (unsigned long long)validation->interiorMismatches);
+}
+
+// Frames are dealt round-robin across renderers, and each renderer cycles through its own frame slots.
+offscreen_frame_t* OffscreenFrameForIndex(renderer_t *renderers, uint32_t rendererCount, uint64_t frameIndex, renderer_t **rendererOut) {
+    renderer_t *renderer = &renderers[frameIndex % rendererCount];
+    *rendererOut = renderer;
+    return &renderer->offscreenFrames[(frameIndex / rendererCount) % OFFSCREEN_FRAMES_PER_DEVICE];
+}
+
+// Pixels are RGBA; alpha is dropped.
+void WritePPM(const char *path, const uint8_t *pixels, VkExtent2D extent) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        FatalError("Failed to open %s for writing.", path);
+    }
+
+    fprintf(f, "P6\n%u %u\n255\n", extent.width, extent.height);
+
+    uint8_t *row = malloc((size_t)extent.width * 3);
+    for (uint32_t y = 0; y < extent.height; y++) {
+        const uint8_t *source = pixels + (size_t)y * extent.width * 4;
+        for (uint32_t x = 0; x < extent.width; x++) {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+        fwrite(row, 1, (size_t)extent.width * 3, f);
+    }
+
+    free(row);
+    fclose(f);
+}
+
+void AppendBytes(byte_buffer_t *buffer, const void *bytes, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        buffer->capacity = MAX(buffer->capacity * 2, buffer->size + size);
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+
+    memcpy(buffer->data + buffer->size, bytes, size);
+    buffer->size += size;
+}
+
+void AppendByte(byte_buffer_t *buffer, uint8_t byte) {
+    AppendBytes(buffer, &byte, 1);
+}
+
+void EncodePPM(const uint8_t *pixels, VkExtent2D extent, byte_buffer_t *out) {
+    char header[64];
+    int headerSize = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", extent.width, extent.height);
+    AppendBytes(out, header, (size_t)headerSize);
+
+    size_t pixelCount = (size_t)extent.width * extent.height;
+    for (size_t i = 0; i < pixelCount; i++) {
+        AppendBytes(out, &pixels[i * 4], 3);
+    }
+}
+
+// The Quite OK Image format (qoiformat.org): runs, a 64-entry cache of recent colors, and small deltas.
+void EncodeQOI(const uint8_t *pixels, VkExtent2D extent, byte_buffer_t *out) {
+    uint8_t header[14] = {
+        'q', 'o', 'i', 'f',
+        (uint8_t)(extent.width >> 24), (uint8_t)(extent.width >> 16), (uint8_t)(extent.width >> 8), (uint8_t)extent.width,
+        (uint8_t)(extent.height >> 24), (uint8_t)(extent.height >> 16), (uint8_t)(extent.height >> 8), (uint8_t)extent.height,
+        4, 0,
     };
+    AppendBytes(out, header, sizeof(header));
+
+    uint8_t cache[64][4] = {};
+    uint8_t previous[4] = { 0, 0, 0, 255 };
+    uint32_t run = 0;
+    size_t pixelCount = (size_t)extent.width * extent.height;
+
+    for (size_t i = 0; i < pixelCount; i++) {
+        const uint8_t *pixel = &pixels[i * 4];
+
+        if (memcmp(pixel, previous, 4) == 0) {
+            run++;
+            if (run == 62 || i == pixelCount - 1) {
+                AppendByte(out, 0xc0 | (uint8_t)(run - 1));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0) {
+            AppendByte(out, 0xc0 | (uint8_t)(run - 1));
+            run = 0;
+        }
+
+        uint32_t hash = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+        if (memcmp(cache[hash], pixel, 4) == 0) {
+            AppendByte(out, (uint8_t)hash);
+        } else {
+            memcpy(cache[hash], pixel, 4);
+
+            int8_t dr = (int8_t)(pixel[0] - previous[0]);
+            int8_t dg = (int8_t)(pixel[1] - previous[1]);
+            int8_t db = (int8_t)(pixel[2] - previous[2]);
+            int8_t drdg = (int8_t)(dr - dg);
+            int8_t dbdg = (int8_t)(db - dg);
+
+            if (pixel[3] != previous[3]) {
+                uint8_t rgba[5] = { 0xff, pixel[0], pixel[1], pixel[2], pixel[3] };
+                AppendBytes(out, rgba, sizeof(rgba));
+            } else if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                AppendByte(out, 0x40 | (uint8_t)((dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+            } else if (dg >= -32 && dg <= 31 && drdg >= -8 && drdg <= 7 && dbdg >= -8 && dbdg <= 7) {
+                uint8_t luma[2] = { 0x80 | (uint8_t)(dg + 32), (uint8_t)((drdg + 8) << 4 | (dbdg + 8)) };
+                AppendBytes(out, luma, sizeof(luma));
+            } else {
+                uint8_t rgb[4] = { 0xfe, pixel[0], pixel[1], pixel[2] };
+                AppendBytes(out, rgb, sizeof(rgb));
+            }
+        }
 
-    if (vkCreateRenderPass(logicalDevice, &renderPassInfo, NULL, &renderPass) != VK_SUCCESS) {
-        FatalError("Failed to create render pass.");
+        memcpy(previous, pixel, 4);
     }
+
+    static const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    AppendBytes(out, end, sizeof(end));
 }
 
-void CreateGraphicsPipeline(void) {
-    long vertexShaderCodeSize, fragmentShaderCodeSize;
-    char *vertexShaderCode = ReadBytesFromResource("vertex.spv", &vertexShaderCodeSize);
-    char *fragmentShaderCode = ReadBytesFromResource("fragment.spv", &fragmentShaderCodeSize);
+// One YUV4MPEG2 frame with planar, limited range BT.601 4:4:4 YUV.
+void EncodeY4MFrame(const uint8_t *pixels, VkExtent2D extent, byte_buffer_t *out) {
+    AppendBytes(out, "FRAME\n", 6);
 
-    VkShaderModule vertexShaderModule = CreateShaderModule(vertexShaderCode, vertexShaderCodeSize);
-    VkShaderModule fragmentShaderModule = CreateShaderModule(fragmentShaderCode, fragmentShaderCodeSize);
+    size_t pixelCount = (size_t)extent.width * extent.height;
+    if (out->capacity < out->size + pixelCount * 3) {
+        out->capacity = out->size + pixelCount * 3;
+        out->data = realloc(out->data, out->capacity);
+    }
 
-    VkPipelineShaderStageCreateInfo vertexShaderStageInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_VERTEX_BIT,
-        .module = vertexShaderModule,
-        .pName = "main",
-    };
+    uint8_t *y = out->data + out->size;
+    uint8_t *u = y + pixelCount;
+    uint8_t *v = u + pixelCount;
+
+    for (size_t i = 0; i < pixelCount; i++) {
+        int r = pixels[i * 4 + 0];
+        int g = pixels[i * 4 + 1];
+        int b = pixels[i * 4 + 2];
+        y[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        u[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        v[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
 
-    VkPipelineShaderStageCreateInfo fragmentShaderStageInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-        .module = fragmentShaderModule,
-        .pName = "main",
-    };
+    out->size += pixelCount * 3;
+}
 
-    VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageInfo, fragmentShaderStageInfo };
+// Oldest first, so the writer, which needs frames in order, is never starved by newer ones.
+encoder_slot_t* OldestEncoderSlot(frame_encoder_t *encoder, encoder_slot_state_t state) {
+    encoder_slot_t *oldest = NULL;
+    for (uint32_t i = 0; i < encoder->slotCount; i++) {
+        encoder_slot_t *slot = &encoder->slots[i];
+        if (slot->state == state && (!oldest || slot->frameIndex < oldest->frameIndex)) {
+            oldest = slot;
+        }
+    }
 
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = 0,
-        .pVertexBindingDescriptions = NULL,
-        .vertexAttributeDescriptionCount = 0,
-        .pVertexAttributeDescriptions = NULL,
-    };
+    return oldest;
+}
 
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-        .primitiveRestartEnable = VK_FALSE,
-    };
+int EncodeFrames(void *data) {
+    frame_encoder_t *encoder = data;
 
-    VkViewport viewport = {
-        .x = 0,
-        .y = 0,
-        .width = (float)swapchainExtent.width,
-        .height = (float)swapchainExtent.height,
-        .minDepth = 0,
-        .maxDepth = 1,
-    };
+    SDL_LockMutex(encoder->mutex);
 
-    VkRect2D scissor = {
-        .offset = { .x = 0, .y = 0 },
-        .extent = swapchainExtent,
-    };
+    for (;;) {
+        encoder_slot_t *slot = OldestEncoderSlot(encoder, ENCODER_SLOT_QUEUED);
+        if (!slot) {
+            if (encoder->finishing) {
+                break;
+            }
+            SDL_CondWait(encoder->frameQueued, encoder->mutex);
+            continue;
+        }
 
-    VkPipelineViewportStateCreateInfo viewportState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-        .viewportCount = 1,
-        .pViewports = &viewport,
-        .scissorCount = 1,
-        .pScissors = &scissor,
-    };
+        slot->state = ENCODER_SLOT_ENCODING;
+        SDL_UnlockMutex(encoder->mutex);
 
-    VkPipelineRasterizationStateCreateInfo rasterizer = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-        .depthClampEnable = VK_FALSE,
-        .rasterizerDiscardEnable = VK_FALSE,
-        .polygonMode = VK_POLYGON_MODE_FILL,
-        .lineWidth = 1,
-        .cullMode = VK_CULL_MODE_BACK_BIT,
-        .frontFace = VK_FRONT_FACE_CLOCKWISE,
-        .depthBiasEnable = VK_FALSE,
-        .depthBiasConstantFactor = 0,
-        .depthBiasClamp = 0,
-        .depthBiasSlopeFactor = 0,
-    };
+        slot->encoded.size = 0;
+        switch (encoder->format) {
+            case ENCODE_PPM:
+                EncodePPM(slot->pixels, encoder->extent, &slot->encoded);
+                break;
+            case ENCODE_QOI:
+                EncodeQOI(slot->pixels, encoder->extent, &slot->encoded);
+                break;
+            case ENCODE_Y4M:
+                EncodeY4MFrame(slot->pixels, encoder->extent, &slot->encoded);
+                break;
+        }
 
-    VkPipelineMultisampleStateCreateInfo multisampling = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-        .sampleShadingEnable = VK_FALSE,
-        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-        .minSampleShading = 1,
-        .pSampleMask = NULL,
-        .alphaToCoverageEnable = VK_FALSE,
-        .alphaToOneEnable = VK_FALSE,
-    };
+        SDL_LockMutex(encoder->mutex);
+        slot->state = ENCODER_SLOT_ENCODED;
+        SDL_CondBroadcast(encoder->frameEncoded);
+    }
 
-    VkPipelineColorBlendAttachmentState colorBlendAttachment = {
-        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-        .blendEnable = VK_FALSE,
-        .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
-        .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-        .colorBlendOp = VK_BLEND_OP_ADD,
-        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-        .alphaBlendOp = VK_BLEND_OP_ADD,
-    };
+    SDL_UnlockMutex(encoder->mutex);
+    return 0;
+}
 
-    VkPipelineColorBlendStateCreateInfo colorBlending = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-        .logicOpEnable = VK_FALSE,
-        .logicOp = VK_LOGIC_OP_COPY,
-        .attachmentCount = 1,
-        .pAttachments = &colorBlendAttachment,
-        .blendConstants = { 0, 0, 0, 0 },
-    };
+void WriteEncodedFrame(frame_encoder_t *encoder, const encoder_slot_t *slot) {
+    FILE *f = encoder->stream;
+    char path[4096];
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = 0,
-        .pSetLayouts = NULL,
-        .pushConstantRangeCount = 0,
-        .pPushConstantRanges = NULL,
-    };
+    if (!f) {
+        snprintf(path, sizeof(path), "%s/frame_%06llu.%s", options.outputDirectory, (unsigned long long)slot->frameIndex,
+                 encoder->format == ENCODE_QOI ? "qoi" : "ppm");
+        f = fopen(path, "wb");
+        if (!f) {
+            FatalError("Failed to open %s for writing.", path);
+        }
+    }
 
-    if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, NULL, &pipelineLayout) != VK_SUCCESS) {
-        FatalError("Failed to create pipeline layout.");
+    // The whole frame in one write, which bypasses stdio buffering.
+    if (fwrite(slot->encoded.data, 1, slot->encoded.size, f) != slot->encoded.size) {
+        FatalError("Failed to write frame %llu.", (unsigned long long)slot->frameIndex);
     }
 
-    VkGraphicsPipelineCreateInfo pipelineInfo = {
-        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .stageCount = 2,
-        .pStages = shaderStages,
-        .pVertexInputState = &vertexInputInfo,
-        .pInputAssemblyState = &inputAssembly,
-        .pViewportState = &viewportState,
-        .pMultisampleState = &multisampling,
-        .pDepthStencilState = NULL,
-        .pColorBlendState = &colorBlending,
-        .pRasterizationState = &rasterizer,
-        .pDynamicState = NULL,
-        .layout = pipelineLayout,
-        .renderPass = renderPass,
-        .subpass = 0,
-        .basePipelineHandle = VK_NULL_HANDLE,
-        .basePipelineIndex = -1,
-    };
+    if (!encoder->stream) {
+        fclose(f);
+    }
+}
 
-    if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &graphicsPipeline) != VK_SUCCESS) {
-        FatalError("Failed to create graphics pipeline.");
+int WriteFrames(void *data) {
+    frame_encoder_t *encoder = data;
+
+    SDL_LockMutex(encoder->mutex);
+
+    for (;;) {
+        encoder_slot_t *slot = OldestEncoderSlot(encoder, ENCODER_SLOT_ENCODED);
+        if (!slot || slot->frameIndex != encoder->nextWriteIndex) {
+            if (encoder->finishing && encoder->nextWriteIndex == encoder->submittedCount) {
+                break;
+            }
+            SDL_CondWait(encoder->frameEncoded, encoder->mutex);
+            continue;
+        }
+
+        SDL_UnlockMutex(encoder->mutex);
+        WriteEncodedFrame(encoder, slot);
+        SDL_LockMutex(encoder->mutex);
+
+        encoder->bytesWritten += slot->encoded.size;
+        encoder->nextWriteIndex++;
+        slot->state = ENCODER_SLOT_FREE;
+        SDL_CondSignal(encoder->slotFreed);
     }
 
-    vkDestroyShaderModule(logicalDevice, fragmentShaderModule, NULL);
-    vkDestroyShaderModule(logicalDevice, vertexShaderModule, NULL);
+    SDL_UnlockMutex(encoder->mutex);
+    return 0;
 }
 
-void CreateFramebuffers(void) {
-    swapchainFramebuffers = calloc(swapchainImageCount, sizeof(VkFramebuffer));
+void StartFrameEncoder(frame_encoder_t *encoder, VkExtent2D extent, encode_format_t format) {
+    memset(encoder, 0, sizeof(frame_encoder_t));
+    encoder->format = format;
+    encoder->extent = extent;
+
+    // Leave a core to the render thread. Two slots per worker keep every worker busy while the writer catches up.
+    encoder->workerCount = (uint32_t)MAX(SDL_GetCPUCount() - 1, 1);
+    encoder->slotCount = encoder->workerCount * 2;
+    encoder->slots = calloc(encoder->slotCount, sizeof(encoder_slot_t));
+    for (uint32_t i = 0; i < encoder->slotCount; i++) {
+        encoder->slots[i].pixels = malloc((size_t)extent.width * extent.height * 4);
+    }
 
-    for (size_t i = 0; i < swapchainImageCount; i++) {
-        VkImageView attachments[] = {
-            swapChainImageViews[i]
-        };
+    if (format == ENCODE_Y4M) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/frames.y4m", options.outputDirectory);
+        encoder->stream = fopen(path, "wb");
+        if (!encoder->stream) {
+            FatalError("Failed to open %s for writing.", path);
+        }
 
-        VkFramebufferCreateInfo framebufferInfo = {
-            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-            .renderPass = renderPass,
-            .attachmentCount = 1,
-            .pAttachments = attachments,
-            .width = swapchainExtent.width,
-            .height = swapchainExtent.height,
-            .layers = 1,
-        };
+        uint32_t frameRate = options.targetFrameRate > 0 ? (uint32_t)(options.targetFrameRate + 0.5) : 60;
+        fprintf(encoder->stream, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", extent.width, extent.height, frameRate);
+    }
+
+    encoder->mutex = SDL_CreateMutex();
+    encoder->slotFreed = SDL_CreateCond();
+    encoder->frameQueued = SDL_CreateCond();
+    encoder->frameEncoded = SDL_CreateCond();
 
-        if (vkCreateFramebuffer(logicalDevice, &framebufferInfo, NULL, &swapchainFramebuffers[i]) != VK_SUCCESS) {
-            FatalError("Failed to create framebuffer.");
+    encoder->workers = calloc(encoder->workerCount, sizeof(SDL_Thread*));
+    for (uint32_t i = 0; i < encoder->workerCount; i++) {
+        encoder->workers[i] = SDL_CreateThread(EncodeFrames, "encoder", encoder);
+        if (!encoder->workers[i]) {
+            FatalError("Failed to create encoder thread: %s", SDL_GetError());
         }
     }
+
+    encoder->writer = SDL_CreateThread(WriteFrames, "writer", encoder);
+    if (!encoder->writer) {
+        FatalError("Failed to create writer thread: %s", SDL_GetError());
+    }
 }
 
-void CreateCommandPool(void) {
-    VkCommandPoolCreateInfo poolInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .queueFamilyIndex = queueFamilyIndices.graphicsFamily,
-        .flags = 0,
-    };
+// Called by the render thread with frames in order. Copies the pixels, so the readback buffer can be reused at once.
+void EncodeFrame(frame_encoder_t *encoder, uint64_t frameIndex, const uint8_t *pixels) {
+    SDL_LockMutex(encoder->mutex);
 
-    if (vkCreateCommandPool(logicalDevice, &poolInfo, NULL, &commandPool) != VK_SUCCESS) {
-        FatalError("Failed to create command pool.");
+    encoder_slot_t *slot;
+    while (!(slot = OldestEncoderSlot(encoder, ENCODER_SLOT_FREE))) {
+        uint64_t waitStart = NowNanoseconds();
+        SDL_CondWait(encoder->slotFreed, encoder->mutex);
+        encoder->waitNanoseconds += NowNanoseconds() - waitStart;
     }
+
+    slot->state = ENCODER_SLOT_FILLING;
+    slot->frameIndex = frameIndex;
+    SDL_UnlockMutex(encoder->mutex);
+
+    memcpy(slot->pixels, pixels, (size_t)encoder->extent.width * encoder->extent.height * 4);
+
+    SDL_LockMutex(encoder->mutex);
+    slot->state = ENCODER_SLOT_QUEUED;
+    encoder->submittedCount++;
+    SDL_CondSignal(encoder->frameQueued);
+    SDL_UnlockMutex(encoder->mutex);
 }
 
-void CreateCommandBuffers(void) {
-    commandBuffers = calloc(swapchainImageCount, sizeof(VkCommandBuffer));
+// Waits for every submitted frame to be written.
+void FinishFrameEncoder(frame_encoder_t *encoder) {
+    SDL_LockMutex(encoder->mutex);
+    encoder->finishing = true;
+    SDL_CondBroadcast(encoder->frameQueued);
+    SDL_CondBroadcast(encoder->frameEncoded);
+    SDL_UnlockMutex(encoder->mutex);
 
-    VkCommandBufferAllocateInfo allocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = commandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = swapchainImageCount,
+    for (uint32_t i = 0; i < encoder->workerCount; i++) {
+        SDL_WaitThread(encoder->workers[i], NULL);
+    }
+    SDL_WaitThread(encoder->writer, NULL);
+
+    if (encoder->stream) {
+        fclose(encoder->stream);
+    }
+
+    printf("Encoded %llu frame(s) into %s with %u thread(s): %.1f MB written, render thread waited %.1f ms for the encoder.\n",
+           (unsigned long long)encoder->submittedCount,
+           options.outputDirectory,
+           encoder->workerCount,
+           (double)encoder->bytesWritten / (1024.0 * 1024.0),
+           (double)encoder->waitNanoseconds / 1.0e6);
+
+    for (uint32_t i = 0; i < encoder->slotCount; i++) {
+        free(encoder->slots[i].pixels);
+        free(encoder->slots[i].encoded.data);
+    }
+
+    SDL_DestroyCond(encoder->frameEncoded);
+    SDL_DestroyCond(encoder->frameQueued);
+    SDL_DestroyCond(encoder->slotFreed);
+    SDL_DestroyMutex(encoder->mutex);
+    free(encoder->workers);
+    free(encoder->slots);
+}
+
+// Animated frames advance at a fixed 60 frames per second of animation time, so the output does not depend on the render speed.
+void SubmitOffscreenFrame(renderer_t *renderer, offscreen_frame_t *frame, uint64_t frameIndex, bool depthPrepass) {
+    UpdateTextureStreaming(renderer, (uint32_t)(frame - renderer->offscreenFrames));
+    vkResetFences(renderer->logicalDevice, 1, &frame->fence);
+
+    // The slot's previous frame has been consumed, so its command buffer is idle.
+    if (renderer->animate) {
+        renderer->animationTime = frameIndex / 60.0;
+        render_target_t renderTarget = OffscreenRenderTarget(renderer, frame);
+        RecordOffscreenFrame(renderer, frame, frame->commandBuffers[depthPrepass], &renderTarget, depthPrepass);
+    }
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount = 0,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &frame->commandBuffers[depthPrepass],
+        .signalSemaphoreCount = 0,
     };
 
-    if (vkAllocateCommandBuffers(logicalDevice, &allocateInfo, commandBuffers) != VK_SUCCESS) {
-        FatalError("Failed to allocate command buffers.");
+    if (vkQueueSubmit(renderer->graphicsQueue, 1, &submitInfo, frame->fence) != VK_SUCCESS) {
+        FatalError("Failed to submit offscreen frame on %s.", renderer->deviceProperties.deviceName);
     }
+}
 
-    for (size_t i = 0; i < swapchainImageCount; i++) {
-        VkCommandBufferBeginInfo beginInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .flags = 0,
-            .pInheritanceInfo = NULL,
+// Readback stage: frames are consumed strictly in submission order, whichever device rendered them.
+// Encoder is NULL unless frames are written out, and validation unless frames are checked against the CPU reference.
+void ConsumeOffscreenFrame(renderer_t *renderer, offscreen_frame_t *frame, uint64_t frameIndex, frame_encoder_t *encoder, validation_t *validation) {
+    vkWaitForFences(renderer->logicalDevice, 1, &frame->fence, VK_TRUE, UINT64_MAX);
+
+    if (!frame->readbackCoherent) {
+        VkMappedMemoryRange range = {
+            .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+            .memory = frame->readbackMemory,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
         };
+        vkInvalidateMappedMemoryRanges(renderer->logicalDevice, 1, &range);
+    }
 
-        if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-            FatalError("Failed to begin recording command buffer.");
-        }
+    renderer->framesRendered++;
 
-        VkClearValue clearColor = { 0.3f, 0.3f, 0.3f, 1.0f }; // Light grey background.
+    if (renderer->statisticsPool != VK_NULL_HANDLE) {
+        ReadFrameStatistics(renderer, frame);
+    }
 
-        VkRenderPassBeginInfo renderPassInfo = {
-            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-            .renderPass = renderPass,
-            .framebuffer = swapchainFramebuffers[i],
-            .renderArea = {
-                .offset = { .x = 0, .y = 0 },
-                .extent = swapchainExtent,
-            },
-            .clearValueCount = 1,
-            .pClearValues = &clearColor,
-        };
+    if (encoder) {
+        EncodeFrame(encoder, frameIndex, frame->readbackData);
+    }
 
-        vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    if (validation) {
+        ValidateFrame(validation, frame->readbackData, frameIndex);
+    }
+}
 
-        vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-        vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
+// Returns the process exit status, which reports validation failures.
+int RunHeadless(void) {
+    renderer_t *renderers;
+    uint32_t rendererCount = 0;
+
+    if (options.multiGPU) {
+        // A throwaway renderer lists the devices; each device then gets its own complete renderer.
+        renderer_t probe;
+        memset(&probe, 0, sizeof(renderer_t));
+        InitVulkanInstance(&probe, NULL);
+
+        uint32_t candidateCount = 0;
+        device_candidate_t *candidates = EnumerateDeviceCandidates(&probe, true, &candidateCount);
+        renderers = calloc(candidateCount, sizeof(renderer_t));
+
+        for (uint32_t i = 0; i < candidateCount; i++) {
+            if (candidates[i].score >= 0) {
+                printf("Using device [%u] %s\n", i, candidates[i].properties.deviceName);
+                InitHeadlessRenderer(&renderers[rendererCount++], i);
+            }
+        }
 
-        vkCmdEndRenderPass(commandBuffers[i]);
+        free(candidates);
+        vkDestroyInstance(probe.instance, NULL);
 
-        if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-            FatalError("Failed to record command buffer.");
+        if (rendererCount == 0) {
+            FatalError("Failed to find a suitable Vulkan device.");
         }
+    } else {
+        renderers = calloc(1, sizeof(renderer_t));
+        InitHeadlessRenderer(&renderers[rendererCount++], -1);
     }
-}
 
-void CreateSemaphores(void) {
-    VkSemaphoreCreateInfo semaphoreInfo = {
-        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-    };
+    // The reference snaps vertices like the first device; devices with a different sub-pixel precision differ on edges only.
+    validation_t validationState = {};
+    validation_t *validation = NULL;
+    if (options.validate) {
+        validation = &validationState;
+        RenderReferenceImage(&validation->reference, options.offscreenExtent, renderers[0].deviceProperties.limits.subPixelPrecisionBits);
+    }
+
+    frame_encoder_t encoderState;
+    frame_encoder_t *encoder = NULL;
+    if (options.outputDirectory) {
+        encoder = &encoderState;
+        StartFrameEncoder(encoder, options.offscreenExtent, options.encodeFormat);
+    }
+
+    uint64_t slotCount = (uint64_t)rendererCount * OFFSCREEN_FRAMES_PER_DEVICE;
+    uint64_t consumedCount = 0;
+    prepass_stats_t prepassStats = {};
+    Uint64 startTime = SDL_GetPerformanceCounter();
+
+    for (uint64_t frameIndex = 0; frameIndex < options.frameCount; frameIndex++) {
+        // This frame reuses the slot of frame (frameIndex - slotCount); drain up to it in order first.
+        while (frameIndex >= slotCount && consumedCount <= frameIndex - slotCount) {
+            renderer_t *renderer;
+            offscreen_frame_t *frame = OffscreenFrameForIndex(renderers, rendererCount, consumedCount, &renderer);
+            ConsumeOffscreenFrame(renderer, frame, consumedCount, encoder, validation);
+            consumedCount++;
+        }
+
+        bool depthPrepass = UseDepthPrepass(frameIndex);
+        RecordPrepassFrame(&prepassStats, depthPrepass);
+
+        renderer_t *renderer;
+        offscreen_frame_t *frame = OffscreenFrameForIndex(renderers, rendererCount, frameIndex, &renderer);
+        SubmitOffscreenFrame(renderer, frame, frameIndex, depthPrepass);
+    }
+
+    while (consumedCount < options.frameCount) {
+        renderer_t *renderer;
+        offscreen_frame_t *frame = OffscreenFrameForIndex(renderers, rendererCount, consumedCount, &renderer);
+        ConsumeOffscreenFrame(renderer, frame, consumedCount, encoder, validation);
+        consumedCount++;
+    }
+
+    // Rendering is done once the last frame is handed to the encoder; writing out the rest is not part of the frame rate.
+    double seconds = (double)(SDL_GetPerformanceCounter() - startTime) / (double)SDL_GetPerformanceFrequency();
+
+    if (encoder) {
+        FinishFrameEncoder(encoder);
+    }
 
-    if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, NULL, &imageAvailableSemaphore) != VK_SUCCESS) {
-        FatalError("Failed to create image available semaphore.");
+    printf("Rendered %llu frame(s) at %ux%u in %.3f s (%.1f frames/s) on %u device(s)\n",
+           (unsigned long long)options.frameCount,
+           options.offscreenExtent.width,
+           options.offscreenExtent.height,
+           seconds,
+           seconds > 0 ? options.frameCount / seconds : 0.0,
+           rendererCount);
+
+    PrintPrepassStats(&prepassStats);
+
+    for (uint32_t i = 0; i < rendererCount; i++) {
+        printf("  %s: %llu frame(s)\n", renderers[i].deviceProperties.deviceName, (unsigned long long)renderers[i].framesRendered);
+        PrintPipelineStatistics(&renderers[i]);
+        DestroyRenderer(&renderers[i]);
     }
 
-    if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, NULL, &renderFinishedSemaphore) != VK_SUCCESS) {
-        FatalError("Failed to create render finished semaphore.");
+    free(renderers);
+
+    if (validation) {
+        PrintValidationReport(validation);
+        DestroyReferenceImage(&validation->reference);
+        return validation->framesFailed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
     }
+
+    return EXIT_SUCCESS;
 }
 
-void DrawFrame(void) {
-    uint32_t imageIndex;
-    vkAcquireNextImageKHR(logicalDevice, swapChain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+// Perceived difference between two RGBA pixels from 0 to 1, as a weighted distance in the YIQ color space
+// (Kotsarenko and Ramos, "Measuring perceived color difference using YIQ NTSC transmission color space").
+double PerceptualDifference(const uint8_t *a, const uint8_t *b) {
+    double r = (double)a[0] - b[0];
+    double g = (double)a[1] - b[1];
+    double bl = (double)a[2] - b[2];
 
-    VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
+    double y = r * 0.29889531 + g * 0.58662247 + bl * 0.11448223;
+    double i = r * 0.59597799 - g * 0.27417610 - bl * 0.32180189;
+    double q = r * 0.21147017 - g * 0.52261711 + bl * 0.31114694;
 
-    VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = waitSemaphores,
-        .pWaitDstStageMask = waitStages,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &commandBuffers[imageIndex],
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = signalSemaphores,
-    };
+    // The largest possible value, between black and white.
+    const double maxDelta = 35215.0;
+    return sqrt((0.5053 * y * y + 0.299 * i * i + 0.1957 * q * q) / maxDelta);
+}
+
+// Renders frames on the offscreen slots in turn, reading each back, and returns the average seconds per frame.
+// The last frame stays in its slot's readback buffer.
+double RenderGoldenFrames(renderer_t *renderer, uint32_t frameCount) {
+    Uint64 startTime = SDL_GetPerformanceCounter();
 
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
-        FatalError("Failed to submit draw command buffer.");
+    for (uint32_t i = 0; i < frameCount + OFFSCREEN_FRAMES_PER_DEVICE; i++) {
+        if (i >= OFFSCREEN_FRAMES_PER_DEVICE) {
+            uint32_t consumed = i - OFFSCREEN_FRAMES_PER_DEVICE;
+            ConsumeOffscreenFrame(renderer, &renderer->offscreenFrames[consumed % OFFSCREEN_FRAMES_PER_DEVICE], consumed, NULL, NULL);
+        }
+        if (i < frameCount) {
+            SubmitOffscreenFrame(renderer, &renderer->offscreenFrames[i % OFFSCREEN_FRAMES_PER_DEVICE], i, false);
+        }
     }
 
-    VkSwapchainKHR swapchains[] = { swapChain };
+    return (double)(SDL_GetPerformanceCounter() - startTime) / (double)SDL_GetPerformanceFrequency() / frameCount;
+}
 
-    VkPresentInfoKHR presentInfo = {
-        .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = signalSemaphores,
-        .swapchainCount = 1,
-        .pSwapchains = swapchains,
-        .pImageIndices = &imageIndex,
-    };
+char* GoldenPath(const golden_case_t *goldenCase, const char *suffix) {
+    size_t length = strlen(options.goldenDirectory) + strlen(goldenCase->name) + strlen(suffix) + 2;
+    char *path = malloc(length);
+    snprintf(path, length, "%s/%s%s", options.goldenDirectory, goldenCase->name, suffix);
+    return path;
+}
+
+// Returns whether the case matches its reference image and recorded frame time, or records both when updating.
+bool RunGoldenCase(const golden_case_t *goldenCase) {
+    options.scene = goldenCase->scene;
+    options.offscreenExtent = goldenCase->extent;
+    options.sampleCount = goldenCase->sampleCount;
+
+    renderer_t renderer;
+    InitHeadlessRenderer(&renderer, -1);
+
+    RenderGoldenFrames(&renderer, GOLDEN_WARMUP_FRAMES);
+    double frameTime = RenderGoldenFrames(&renderer, GOLDEN_TIMED_FRAMES) * 1000.0;
+    const uint8_t *pixels = renderer.offscreenFrames[(GOLDEN_TIMED_FRAMES - 1) % OFFSCREEN_FRAMES_PER_DEVICE].readbackData;
+
+    char *imagePath = GoldenPath(goldenCase, ".ppm");
+    char *timePath = GoldenPath(goldenCase, ".time");
+    bool passed = true;
+
+    if (options.goldenUpdate) {
+        // Reference images are checked in, so only missing ones are recorded; frame times are per machine.
+        FILE *existing = fopen(imagePath, "rb");
+        if (existing) {
+            fclose(existing);
+        } else {
+            WritePPM(imagePath, pixels, goldenCase->extent);
+        }
+
+        FILE *f = fopen(timePath, "w");
+        if (!f) {
+            FatalError("Failed to open %s for writing.", timePath);
+        }
+        fprintf(f, "%.4f\n", frameTime);
+        fclose(f);
+
+        printf("UPDATED %s: %.3f ms/frame%s\n", goldenCase->name, frameTime, existing ? "" : ", new reference image");
+    } else {
+        VkExtent2D referenceExtent;
+        uint8_t *reference = ReadPPM(imagePath, &referenceExtent);
+
+        if (!reference) {
+            printf("FAIL %s: no reference image at %s\n", goldenCase->name, imagePath);
+            passed = false;
+        } else if (referenceExtent.width != goldenCase->extent.width || referenceExtent.height != goldenCase->extent.height) {
+            printf("FAIL %s: reference image is %ux%u\n", goldenCase->name, referenceExtent.width, referenceExtent.height);
+            passed = false;
+        } else {
+            size_t pixelCount = (size_t)goldenCase->extent.width * goldenCase->extent.height;
+            size_t differentPixels = 0;
+            for (size_t i = 0; i < pixelCount; i++) {
+                differentPixels += PerceptualDifference(&pixels[i * 4], &reference[i * 4]) > GOLDEN_PIXEL_THRESHOLD;
+            }
+
+            double differentFraction = (double)differentPixels / (double)pixelCount;
+            passed = differentFraction <= GOLDEN_MAX_DIFFERENT_PIXELS;
+
+            double recordedTime = 0;
+            FILE *f = fopen(timePath, "r");
+            if (f) {
+                if (fscanf(f, "%lf", &recordedTime) != 1) {
+                    recordedTime = 0;
+                }
+                fclose(f);
+            }
+
+            bool slower = recordedTime > 0 && frameTime > recordedTime * GOLDEN_MAX_SLOWDOWN;
+            passed = passed && !slower;
+
+            printf("%s %s: %.3f%% of pixels differ, %.3f ms/frame", passed ? "PASS" : "FAIL", goldenCase->name, differentFraction * 100.0, frameTime);
+            if (recordedTime > 0) {
+                printf(" (recorded %.3f ms%s)", recordedTime, slower ? ", too slow" : "");
+            }
+            printf("\n");
+        }
+
+        // Keep what was rendered next to the reference so failures can be inspected.
+        if (!passed) {
+            char *actualPath = GoldenPath(goldenCase, ".actual.ppm");
+            WritePPM(actualPath, pixels, goldenCase->extent);
+            free(actualPath);
+        }
 
-    vkQueuePresentKHR(presentQueue, &presentInfo);
+        free(reference);
+    }
+
+    free(timePath);
+    free(imagePath);
+    DestroyRenderer(&renderer);
+
+    return passed;
+}
+
+// Runs every golden case headlessly. Options that are not part of a case, such as --raster or --legacy-render-pass,
+// apply to all of them, so each rendering path can be checked against the same images.
+int RunGolden(void) {
+    uint32_t failures = 0;
+
+    for (uint32_t i = 0; i < goldenCaseCount; i++) {
+        failures += !RunGoldenCase(&goldenCases[i]);
+    }
+
+    if (!options.goldenUpdate) {
+        printf("%u of %u golden case(s) passed.\n", goldenCaseCount - failures, goldenCaseCount);
+    }
+
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 int main(int argc, const char * argv[]) {
-    SDL_Init(SDL_INIT_VIDEO);
+    ParseOptions(argc, argv);
 
-    SDL_Window *window = SDL_CreateWindow(APP_NAME, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 800, 600, SDL_WINDOW_VULKAN | SDL_WINDOW_ALLOW_HIGHDPI);
+    if (options.goldenDirectory) {
+        return RunGolden();
+    }
 
-    if (!window) {
-        FatalError("Failed to create window: %s", SDL_GetError());
+    if (options.headless) {
+        return RunHeadless();
     }
 
-    InitVulkanInstance(window);
-    CreateVulkanSurface(window);
-    PickPhysicalVulkanDevice();
-    CreateLogicalDevice();
+    SDL_Init(SDL_INIT_VIDEO);
 
-    swapchain_support_details_t swapchainDetails = QuerySwapchainSupport();
-    if (swapchainDetails.formatCount == 0 || swapchainDetails.presentModeCount == 0) {
-        FatalError("No valid swapchain configuration found.");
+    SDL_Window **windows = calloc(options.windowCount, sizeof(SDL_Window*));
+
+    for (uint32_t i = 0; i < options.windowCount; i++) {
+        char title[64];
+        if (options.windowCount > 1) {
+            snprintf(title, sizeof(title), "%s (%u)", APP_NAME, i + 1);
+        } else {
+            snprintf(title, sizeof(title), "%s", APP_NAME);
+        }
+
+        windows[i] = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WIDTH, HEIGHT, SDL_WINDOW_VULKAN | SDL_WINDOW_ALLOW_HIGHDPI);
+
+        if (!windows[i]) {
+            FatalError("Failed to create window: %s", SDL_GetError());
+        }
     }
 
-    CreateSwapChain(swapchainDetails);
+    renderer_t renderer;
+    InitWindowRenderer(&renderer, windows, options.windowCount);
 
-    FreeSwapchainSupportDetails(swapchainDetails);
+    free(windows);
 
-    CreateImageViews();
-    CreateRenderPass();
-    CreateGraphicsPipeline();
-    CreateFramebuffers();
-    CreateCommandPool();
-    CreateCommandBuffers();
-    CreateSemaphores();
+    frame_pacer_t pacer;
+    InitFramePacer(&pacer, options.targetFrameRate);
 
-    DrawFrame();
+    prepass_stats_t prepassStats = {};
+    uint64_t frameIndex = 0;
 
     SDL_Event event;
+    bool running = true;
+    uint64_t startTime = SDL_GetPerformanceCounter();
 
-    while (SDL_WaitEvent(&event)) {
-        if (event.type == SDL_QUIT) {
-            break;
+    while (running && renderer.windowCount > 0) {
+        PaceFrame(&pacer);
+
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                running = false;
+            }
+
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_p) {
+                options.depthPrepass = renderer.depthPrepass ? DEPTH_PREPASS_OFF : DEPTH_PREPASS_ON;
+                printf("Depth pre-pass %s.\n", options.depthPrepass == DEPTH_PREPASS_ON ? "on" : "off");
+            }
+
+            if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE) {
+                for (uint32_t i = 0; i < renderer.windowCount; i++) {
+                    if (SDL_GetWindowID(renderer.windows[i].window) == event.window.windowID) {
+                        RemoveWindow(&renderer, i);
+                        break;
+                    }
+                }
+            }
         }
-    }
 
-    vkDestroySemaphore(logicalDevice, renderFinishedSemaphore, NULL);
-    vkDestroySemaphore(logicalDevice, imageAvailableSemaphore, NULL);
+        // Input for the frame is whatever the event loop has just drained.
+        uint64_t inputTime = NowNanoseconds();
 
-    vkDestroyCommandPool(logicalDevice, commandPool, NULL);
+        if (running && renderer.windowCount > 0) {
+            renderer.depthPrepass = UseDepthPrepass(frameIndex++);
+            RecordPrepassFrame(&prepassStats, renderer.depthPrepass);
 
-    for (size_t i = 0; i < swapchainImageCount; i++) {
-        vkDestroyFramebuffer(logicalDevice, swapchainFramebuffers[i], NULL);
+            DrawFrame(&renderer, inputTime);
+            FinishPacedFrame(&pacer, inputTime, renderer.lastSubmitTime, renderer.lastGPUTime);
+        }
     }
 
-    vkDestroyPipeline(logicalDevice, graphicsPipeline, NULL);
-    vkDestroyPipelineLayout(logicalDevice, pipelineLayout, NULL);
-    vkDestroyRenderPass(logicalDevice, renderPass, NULL);
+    double seconds = (double)(SDL_GetPerformanceCounter() - startTime) / (double)SDL_GetPerformanceFrequency();
+    printf("Rendered %llu frames in %.2f s (%.1f frames/s).\n", (unsigned long long)renderer.framesRendered, seconds, seconds > 0 ? (double)renderer.framesRendered / seconds : 0.0);
+    PrintPrepassStats(&prepassStats);
+
+    if (options.measureLatency) {
+        // Pick up the timings of the last few frames before reporting.
+        vkDeviceWaitIdle(renderer.logicalDevice);
+        for (uint32_t i = 0; i < renderer.windowCount; i++) {
+            CollectPresentTimings(&renderer, &renderer.windows[i]);
+        }
 
-    for (size_t i = 0; i < swapchainImageCount; i++) {
-        vkDestroyImageView(logicalDevice, swapChainImageViews[i], NULL);
+        PrintLatencyReport(&renderer);
     }
 
-    vkDestroySwapchainKHR(logicalDevice, swapChain, NULL);
-    vkDestroySurfaceKHR(vulkanInstance, vulkanSurface, NULL);
-    vkDestroyDevice(logicalDevice, NULL);
-    vkDestroyInstance(vulkanInstance, NULL);
+    DestroyRenderer(&renderer);
 
     SDL_Quit();
 
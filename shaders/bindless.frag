@@ -0,0 +1,16 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Every texture of the renderer, as written by AddBindlessTexture() in hello-triangle.c.
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragMaterial;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Neighbouring fragments of one draw can belong to different instances, so the index is not uniform.
+    outColor = vec4(fragColor, 1.0) * texture(textures[nonuniformEXT(fragMaterial)], fragTexCoord);
+}
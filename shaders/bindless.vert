@@ -0,0 +1,37 @@
+#version 450
+
+// shaders/instanced.vert with texture coordinates and the instance's slot in the bindless texture array.
+layout(location = 0) in vec4 instanceOffsetScale;
+layout(location = 1) in vec4 instanceColor;
+layout(location = 2) in uint instanceMaterial;
+
+// Per-draw parameters, matching draw_constants_t in hello-triangle.c.
+layout(push_constant) uniform DrawConstants {
+    mat4 transform;
+    vec4 color;
+    vec4 meshOffset;
+    vec4 meshScale;
+    float time;
+} draw;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragMaterial;
+
+// The depth pre-pass and the EQUAL color pass must compute bit-identical depth.
+invariant gl_Position;
+
+vec2 positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+void main() {
+    vec2 position = positions[gl_VertexIndex] * instanceOffsetScale.w + instanceOffsetScale.xy;
+    gl_Position = draw.transform * vec4(position, instanceOffsetScale.z, 1.0);
+    fragColor = instanceColor.rgb * draw.color.rgb;
+    // The textures scroll as the scene animates.
+    fragTexCoord = positions[gl_VertexIndex] + 0.5 + vec2(draw.time * 0.1, 0.0);
+    fragMaterial = instanceMaterial;
+}
@@ -0,0 +1,31 @@
+#version 450
+
+// Draws the tutorial triangle once per instance. Instance attributes come from instance_data_t in hello-triangle.c.
+layout(location = 0) in vec4 instanceOffsetScale;
+layout(location = 1) in vec4 instanceColor;
+
+// Per-draw parameters, matching draw_constants_t in hello-triangle.c.
+layout(push_constant) uniform DrawConstants {
+    mat4 transform;
+    vec4 color;
+    vec4 meshOffset;
+    vec4 meshScale;
+    float time;
+} draw;
+
+layout(location = 0) out vec3 fragColor;
+
+// The depth pre-pass and the EQUAL color pass must compute bit-identical depth.
+invariant gl_Position;
+
+vec2 positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+void main() {
+    vec2 position = positions[gl_VertexIndex] * instanceOffsetScale.w + instanceOffsetScale.xy;
+    gl_Position = draw.transform * vec4(position, instanceOffsetScale.z, 1.0);
+    fragColor = instanceColor.rgb * draw.color.rgb;
+}
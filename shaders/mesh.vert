@@ -0,0 +1,52 @@
+#version 450
+
+// Draws the imported mesh once per instance with per-vertex lighting. Vertex attributes come from packed_vertex_t and
+// instance attributes from instance_data_t in hello-triangle.c.
+layout(location = 0) in vec4 instanceOffsetScale;
+layout(location = 1) in vec4 instanceColor;
+// 16-bit normalized within the mesh's bounds.
+layout(location = 3) in vec4 quantizedPosition;
+// Octahedral, 8 bits per component.
+layout(location = 4) in vec2 octahedralNormal;
+
+// Per-draw parameters, matching draw_constants_t in hello-triangle.c.
+layout(push_constant) uniform DrawConstants {
+    mat4 transform;
+    vec4 color;
+    vec4 meshOffset;
+    vec4 meshScale;
+    float time;
+} draw;
+
+layout(location = 0) out vec3 fragColor;
+
+// The depth pre-pass and the EQUAL color pass must compute bit-identical depth.
+invariant gl_Position;
+
+// Towards the light, from the upper left and in front.
+const vec3 lightDirection = normalize(vec3(-0.4, -0.6, -0.7));
+
+// Reverses EncodeOctahedral() in hello-triangle.c: the lower hemisphere was folded over the diagonals.
+vec3 DecodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+void main() {
+    vec3 position = quantizedPosition.xyz * draw.meshScale.xyz + draw.meshOffset.xyz;
+    vec3 normal = DecodeOctahedral(octahedralNormal);
+
+    // OBJ meshes are y-up and face +z. Half a turn about x stands them upright, facing the viewer.
+    vec3 local = vec3(position.x, -position.y, -position.z) * instanceOffsetScale.w;
+    vec3 n = normalize(vec3(normal.x, -normal.y, -normal.z));
+
+    // Meshes fit in a unit cube and scale at most 0.6, so their depth stays inside the instance's slice of [0, 1].
+    float depth = 0.05 + 0.9 * instanceOffsetScale.z + 0.1 * local.z;
+    gl_Position = draw.transform * vec4(local.xy + instanceOffsetScale.xy, depth, 1.0);
+
+    float diffuse = max(dot(n, lightDirection), 0.0);
+    fragColor = instanceColor.rgb * draw.color.rgb * (0.25 + 0.75 * diffuse);
+}